@@ -0,0 +1,58 @@
+#!/bin/sh
+# Сравнение интерпретатора и скрипта, оттранслированного через --emit-c.
+# Запуск из корня репозитория: sh bench/emit_c_bench.sh [число_строк] [повторы]
+set -e
+
+LINES=${1:-10000}
+RUNS=${2:-10}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CC=${CC:-gcc}
+SRC=$(ls *.c | grep -v '^main.c$')
+
+# Интерпретатор
+$CC -O2 *.c -o "$WORK/dino"
+
+# Скрипт: обход поля 100x100 с покраской, прыжками и IF
+awk -v n="$LINES" 'BEGIN {
+    print "SIZE 100 100"
+    print "START 0 0"
+    for (i = 0; i < n; i++) {
+        k = i % 8
+        if (k == 0 || k == 7) print "MOVE RIGHT"
+        else if (k == 1) printf "PAINT %c\n", 97 + i % 26
+        else if (k == 2) print "MOVE DOWN"
+        else if (k == 3) print "JUMP RIGHT 3"
+        else if (k == 4) printf "IF CELL %d %d IS _ THEN MOVE LEFT\n", i % 100, i % 97
+        else if (k == 5) print "MOVE UP"
+        else print "PUSH LEFT"
+    }
+}' > "$WORK/script.txt"
+
+# Трансляция и сборка
+"$WORK/dino" --emit-c "$WORK/script.txt" "$WORK/script.c"
+$CC -O1 -I. "$WORK/script.c" $SRC -o "$WORK/script_bin"
+
+now() { date +%s%N; }
+
+start=$(now)
+r=0
+while [ $r -lt "$RUNS" ]; do
+    "$WORK/dino" "$WORK/script.txt" "$WORK/out_interp.txt" --no-display
+    r=$((r + 1))
+done
+interp=$(( ($(now) - start) / RUNS / 1000 ))
+
+start=$(now)
+r=0
+while [ $r -lt "$RUNS" ]; do
+    "$WORK/script_bin" "$WORK/out_compiled.txt" --no-display
+    r=$((r + 1))
+done
+compiled=$(( ($(now) - start) / RUNS / 1000 ))
+
+cmp "$WORK/out_interp.txt" "$WORK/out_compiled.txt"
+echo "строк: $LINES, повторов: $RUNS"
+echo "интерпретатор: ${interp} мкс на запуск"
+echo "--emit-c:      ${compiled} мкс на запуск"
@@ -0,0 +1,63 @@
+/**
+ * Загрузка поля LOAD из обычного файла и из RLE: одно и то же
+ * разреженное поле 100x100 (density — доля клеток с объектами, в процентах)
+ * сохраняется в обоих форматах и загружается много раз.
+ * Печатает строки "формат байт мкс_на_загрузку".
+ * Собирается вместе с исходниками интерпретатора (без main.c),
+ * см. bench/rle_bench.sh.
+ */
+#include "field.h"
+#include "parser.h"
+#include "eventlog.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static long file_size(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return -1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+static void bench_load(const char* name, const char* path, long n) {
+    uint64_t t = monotonic_ns();
+    for (long i = 0; i < n; i++) {
+        Field f = {0};
+        if (!command_load(&f, path, 1)) exit(1);
+        free_field_cells(&f);
+    }
+    printf("%s %ld %.2f\n", name, file_size(path), (double)(monotonic_ns() - t) / n / 1000);
+}
+
+int main(int argc, char* argv[]) {
+    long n = argc > 1 ? atol(argv[1]) : 20000;
+    int density = argc > 2 ? atoi(argv[2]) : 3;
+    const char* dir = argc > 3 ? argv[3] : ".";
+    event_log_init(true, 0);
+
+    Field* f = create_field(MAX_WIDTH, MAX_HEIGHT);
+    if (!f) return 1;
+    srand(1);
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) {
+            if (rand() % 100 >= density) continue;
+            int k = rand() % 8;
+            if (k < 4) cell_set_object(&f->grid[y][x], CELL_PIT + k); // Яма, гора, дерево, камень
+            else cell_set_color(&f->grid[y][x], "abcz"[k - 4]);
+        }
+    }
+    place_dinosaur(f, 0, 0);
+
+    char plain[512], rle[512];
+    snprintf(plain, sizeof(plain), "%s/field.txt", dir);
+    snprintf(rle, sizeof(rle), "%s/field.rle", dir);
+    if (!save_field_to_file(f, plain) || !save_field_as(f, rle, FIELD_FORMAT_RLE)) return 1;
+    free_field(f);
+
+    bench_load("plain", plain, n);
+    bench_load("rle", rle, n);
+    return 0;
+}
@@ -0,0 +1,15 @@
+#!/bin/sh
+# LOAD обычного файла поля против RLE на одном и том же разреженном поле 100x100.
+# Запуск из корня репозитория: sh bench/rle_bench.sh [загрузок] [процент_объектов]
+set -e
+
+ITER=${1:-20000}
+DENSITY=${2:-3}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CC=${CC:-gcc}
+$CC -O2 -I. bench/rle_bench.c $(ls *.c | grep -v '^main.c$') -o "$WORK/bench" -lpthread
+
+echo "формат  байт  мкс"
+"$WORK/bench" "$ITER" "$DENSITY" "$WORK" | awk '{ printf "%-6s %6s %5s\n", $1, $2, $3 }'
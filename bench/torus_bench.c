@@ -0,0 +1,99 @@
+/**
+ * Микробенчмарк адресации на торе: команды вызываются напрямую,
+ * без разбора строк и истории UNDO, поэтому время — это сама команда.
+ * Печатает строки "команда размер нс_на_команду".
+ * Собирается вместе с исходниками интерпретатора (без main.c),
+ * см. bench/torus_bench.sh.
+ */
+#include "field.h"
+#include "command.h"
+#include "parser.h"
+#include "eventlog.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static volatile int sink;
+
+static Field* fresh_field(int size) {
+    Field* f = create_field(size, size);
+    if (!f) exit(1);
+    place_dinosaur(f, size / 2, size / 2);
+    return f;
+}
+
+static void report(const char* name, int size, uint64_t start, long ops) {
+    printf("%s %d %.2f\n", name, size, (double)(monotonic_ns() - start) / ops);
+}
+
+static void bench_size(int size, long n) {
+    Field* f = fresh_field(size);
+    uint64_t t = monotonic_ns();
+    for (long i = 0; i < n; i++) move_dino(f, (i & 1024) ? "DOWN" : "RIGHT");
+    report("MOVE", size, t, n);
+    free_field(f);
+
+    f = fresh_field(size);
+    t = monotonic_ns();
+    for (long i = 0; i < n; i++) jump_dino(f, (i & 1) ? "LEFT" : "DOWN", 7);
+    report("JUMP_7", size, t, n);
+    free_field(f);
+
+    // Дерево ставится и срубается: две команды за итерацию
+    f = fresh_field(size);
+    t = monotonic_ns();
+    for (long i = 0; i < n; i++) {
+        modify_adjacent(f, "UP", '&', true);
+        cut_tree(f, "UP");
+    }
+    report("GROW+CUT", size, t, 2 * n);
+    free_field(f);
+
+    // Динозавр идёт за камнем: две команды за итерацию
+    f = fresh_field(size);
+    modify_adjacent(f, "LEFT", '@', true);
+    t = monotonic_ns();
+    for (long i = 0; i < n; i++) {
+        push_stone(f, "LEFT");
+        move_dino(f, "LEFT");
+    }
+    report("PUSH+MOVE", size, t, 2 * n);
+    free_field(f);
+
+    // Камень обходит тор и останавливается с другой стороны от динозавра
+    f = fresh_field(size);
+    modify_adjacent(f, "RIGHT", '@', true);
+    t = monotonic_ns();
+    for (long i = 0; i < n / 16; i++) push_stone_slide(f, (i & 1) ? "RIGHT" : "LEFT");
+    report("PUSH_SLIDE", size, t, n / 16);
+    free_field(f);
+
+    f = fresh_field(size);
+    Predicate p;
+    int len;
+    parse_predicate("AHEAD LEFT IS _", &p, &len);
+    t = monotonic_ns();
+    int hits = 0;
+    for (long i = 0; i < n; i++) hits += predicate_holds(f, &p);
+    report("IF_AHEAD", size, t, n);
+
+    // Координаты за пределами поля, в том числе отрицательные
+    parse_predicate("CELL 0 0 IS _", &p, &len);
+    t = monotonic_ns();
+    for (long i = 0; i < n; i++) {
+        p.x = (int)(i % 1000) - 500;
+        p.y = (int)(i % 997) - 300;
+        hits += predicate_holds(f, &p);
+    }
+    report("IF_CELL", size, t, n);
+    sink = hits;
+    free_field(f);
+}
+
+int main(int argc, char* argv[]) {
+    long n = argc > 1 ? atol(argv[1]) : 2000000;
+    event_log_init(true, 0);
+    bench_size(64, n);   // Степень двойки
+    bench_size(100, n);  // Общий случай
+    return 0;
+}
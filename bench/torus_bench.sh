@@ -0,0 +1,33 @@
+#!/bin/sh
+# Адресация на торе: таблицы соседей против wrap() с делением.
+# bench/torus_bench.c собирается с исходниками текущего дерева и ревизии
+# BASE (ревизия, с которой сравнивать, например та, где команды ещё
+# вызывают wrap()) и печатает время одной команды на полях 64x64 и 100x100.
+# Запуск из корня репозитория: sh bench/torus_bench.sh BASE [итераций]
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "Использование: sh bench/torus_bench.sh BASE [итераций]" >&2
+    exit 1
+fi
+BASE=$1
+ITER=${2:-2000000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CC=${CC:-gcc}
+
+mkdir "$WORK/base"
+git archive "$BASE" | tar -x -C "$WORK/base"
+
+build() {
+    $CC -O2 -I"$1" bench/torus_bench.c $(ls "$1"/*.c | grep -v '/main.c$') -o "$2" -lpthread
+}
+build . "$WORK/new"
+build "$WORK/base" "$WORK/old"
+
+"$WORK/old" "$ITER" > "$WORK/old.txt"
+"$WORK/new" "$ITER" > "$WORK/new.txt"
+
+echo "команда     поле  $BASE нс  сейчас нс"
+paste "$WORK/old.txt" "$WORK/new.txt" | awk '{ printf "%-11s %4s %10s %10s\n", $1, $2, $3, $6 }'
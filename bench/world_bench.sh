@@ -0,0 +1,50 @@
+#!/bin/sh
+# Масштабирование --world: каждый агент работает в своём квадрате 25x25
+# поля 100x100 (одна плитка), число агентов растёт, работа агента — нет.
+# При почти линейном масштабировании время почти не меняется.
+# Запуск из корня репозитория: sh bench/world_bench.sh [строк_на_агента]
+set -e
+
+LINES=${1:-200000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CC=${CC:-gcc}
+$CC -O2 *.c -o "$WORK/dino"
+
+echo "SIZE 100 100" > "$WORK/setup.txt"
+
+# Агент i ходит змейкой по квадрату с левым верхним углом (25*(i%4), 25*(i/4))
+i=0
+while [ $i -lt 16 ]; do
+    awk -v n="$LINES" -v x0=$((25 * (i % 4) + 2)) -v y0=$((25 * (i / 4) + 2)) 'BEGIN {
+        printf "START %d %d\n", x0, y0
+        for (k = 0; k < n; k++) {
+            s = k % 40
+            if (s < 10) print "MOVE RIGHT"
+            else if (s < 20) print "MOVE DOWN"
+            else if (s < 30) print "MOVE LEFT"
+            else if (s < 39) print "MOVE UP"
+            else printf "PAINT %c\n", 97 + k % 26
+        }
+    }' > "$WORK/agent$i.txt"
+    i=$((i + 1))
+done
+
+now() { date +%s%N; }
+
+for n in 1 2 4 8 16; do
+    agents=""
+    i=0
+    while [ $i -lt $n ]; do
+        agents="$agents $WORK/agent$i.txt"
+        i=$((i + 1))
+    done
+    start=$(now)
+    "$WORK/dino" --world "$WORK/out.txt" "$WORK/setup.txt" $agents --tile 25
+    par=$(( ($(now) - start) / 1000000 ))
+    start=$(now)
+    "$WORK/dino" --world "$WORK/out_det.txt" "$WORK/setup.txt" $agents --tile 25 --deterministic
+    det=$(( ($(now) - start) / 1000000 ))
+    echo "агентов: $n  параллельно: $par мс  --deterministic: $det мс"
+done
@@ -0,0 +1,551 @@
+#include "checkpoint.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC   "DINOCKP1"
+#define CHECKPOINT_VERSION 3
+
+// =============== Запись в буфер ===============
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t cap;
+    bool failed;
+} Buffer;
+
+static void put_bytes(Buffer* b, const void* src, size_t n) {
+    if (b->failed) return;
+    if (b->size + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->size + n) cap *= 2;
+        unsigned char* data = realloc(b->data, cap);
+        if (!data) {
+            b->failed = true;
+            return;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->size, src, n);
+    b->size += n;
+}
+
+static void put_u8(Buffer* b, unsigned v) {
+    unsigned char c = (unsigned char)v;
+    put_bytes(b, &c, 1);
+}
+
+static void put_u16(Buffer* b, unsigned v) {
+    unsigned char c[2] = { (unsigned char)v, (unsigned char)(v >> 8) };
+    put_bytes(b, c, 2);
+}
+
+static void put_u32(Buffer* b, uint32_t v) {
+    unsigned char c[4];
+    for (int i = 0; i < 4; i++) c[i] = (unsigned char)(v >> (8 * i));
+    put_bytes(b, c, 4);
+}
+
+static void put_u64(Buffer* b, uint64_t v) {
+    put_u32(b, (uint32_t)v);
+    put_u32(b, (uint32_t)(v >> 32));
+}
+
+static void put_varint(Buffer* b, size_t v) {
+    unsigned char c[10];
+    int n = 0;
+    do {
+        c[n] = v & 0x7F;
+        v >>= 7;
+        if (v) c[n] |= 0x80;
+        n++;
+    } while (v);
+    put_bytes(b, c, n);
+}
+
+/**
+ * Записывает клетки cur как XOR с prev: серия нулей кодируется длиной,
+ * отличающиеся клетки — как есть.
+ */
+static void put_delta(Buffer* b, const Field* prev, const Field* cur) {
+    unsigned char x[MAX_WIDTH * MAX_HEIGHT];
+    size_t total = 0;
+    for (int y = 0; y < cur->height; y++) {
+        for (int i = 0; i < cur->width; i++) x[total++] = prev->grid[y][i] ^ cur->grid[y][i];
+    }
+
+    size_t pos = 0;
+    while (pos < total) {
+        size_t zeros = 0;
+        while (pos + zeros < total && x[pos + zeros] == 0) zeros++;
+        pos += zeros;
+        size_t lit = 0;
+        while (pos + lit < total && x[pos + lit] != 0) lit++;
+        put_varint(b, zeros);
+        put_varint(b, lit);
+        put_bytes(b, x + pos, lit);
+        pos += lit;
+    }
+}
+
+/**
+ * Записывает версию v: динозавр и клетки как XOR с полем prev.
+ * Версия собирается в cur, который становится prev для следующей.
+ */
+static void put_version(Buffer* b, const Version* v, const Field* prev, Field* cur) {
+    version_to_field(v, cur);
+    put_u32(b, (uint32_t)cur->dino_x);
+    put_u32(b, (uint32_t)cur->dino_y);
+    put_u8(b, cur->dino_placed);
+    put_delta(b, prev, cur);
+}
+
+// Сериализует состояние. Возвращает false, если не хватило памяти
+static bool serialize(Buffer* b, const Field* f, const History* hist,
+                      const CheckpointFrame* frames, int depth, long lines) {
+    put_bytes(b, CHECKPOINT_MAGIC, 8);
+    put_u32(b, CHECKPOINT_VERSION);
+    put_u64(b, (uint64_t)lines);
+
+    put_u32(b, (uint32_t)f->width);
+    put_u32(b, (uint32_t)f->height);
+    put_u32(b, (uint32_t)f->dino_x);
+    put_u32(b, (uint32_t)f->dino_y);
+    put_u8(b, f->field_created);
+    put_u8(b, f->dino_placed);
+    if (f->field_created) {
+        for (int y = 0; y < f->height; y++) put_bytes(b, f->grid[y], f->width);
+    }
+
+    // Размеры поля после SIZE/LOAD не меняются, поэтому все версии одного размера.
+    // Версии собираются в поле по очереди в двух буферах: текущее и предыдущее
+    Field* fields[2] = { NULL, NULL };
+    if (hist->top || hist->redo || hist->branches) {
+        fields[0] = create_field(f->width, f->height);
+        fields[1] = create_field(f->width, f->height);
+        if (!fields[0] || !fields[1]) b->failed = true;
+    }
+    const Field* prev = f;
+    int k = 0;
+
+    put_u32(b, (uint32_t)(hist->count - hist->skipped));
+    put_u32(b, (uint32_t)hist->skipped);
+    for (const State* s = hist->top; s && !b->failed; s = s->next) {
+        put_version(b, &s->version, prev, fields[k]);
+        prev = fields[k];
+        k ^= 1;
+    }
+
+    uint32_t redo = 0;
+    for (const State* s = hist->redo; s; s = s->next) redo++;
+    put_u32(b, redo);
+    for (const State* s = hist->redo; s && !b->failed; s = s->next) {
+        put_version(b, &s->version, prev, fields[k]);
+        prev = fields[k];
+        k ^= 1;
+    }
+
+    uint32_t branches = 0;
+    for (const Branch* br = hist->branches; br; br = br->next) branches++;
+    put_u32(b, branches);
+    for (const Branch* br = hist->branches; br && !b->failed; br = br->next) {
+        size_t len = strlen(br->name);
+        put_u16(b, (unsigned)len);
+        put_bytes(b, br->name, len);
+        put_version(b, &br->version, prev, fields[k]);
+        prev = fields[k];
+        k ^= 1;
+    }
+    free_field(fields[0]);
+    free_field(fields[1]);
+
+    put_u32(b, (uint32_t)depth);
+    for (int i = 0; i < depth; i++) {
+        size_t len = strlen(frames[i].filename);
+        put_u16(b, (unsigned)len);
+        put_bytes(b, frames[i].filename, len);
+        put_u32(b, (uint32_t)frames[i].pc);
+    }
+    return !b->failed;
+}
+
+// Записывает данные во временный файл и переименовывает его в path
+static bool write_atomically(const char* path, const unsigned char* data, size_t size) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return false;
+    bool ok = fwrite(data, 1, size, fp) == size;
+    if (fclose(fp) != 0) ok = false;
+#ifdef _WIN32
+    if (ok) remove(path); // rename в Windows не заменяет существующий файл
+#endif
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+// =============== Фоновая запись ===============
+
+#ifdef _WIN32
+
+// Без потоков POSIX контрольная точка записывается сразу
+static void hand_off(const char* path, unsigned char* data, size_t size) {
+    if (!write_atomically(path, data, size)) {
+        fprintf(stderr, "ОШИБКА: Невозможно записать контрольную точку '%s'\n", path);
+    }
+    free(data);
+}
+
+void checkpoint_finish(void) {}
+
+#else
+
+#include <pthread.h>
+
+static struct {
+    bool active;
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned char* pending;     // Сериализованная точка, ждущая записи (NULL — нет)
+    size_t pending_size;
+    char path[512];
+} ckp = { .lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER };
+
+static void* checkpoint_thread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&ckp.lock);
+    for (;;) {
+        if (!ckp.pending) {
+            if (ckp.stop) break;
+            pthread_cond_wait(&ckp.changed, &ckp.lock);
+            continue;
+        }
+        unsigned char* data = ckp.pending;
+        size_t size = ckp.pending_size;
+        char path[512];
+        memcpy(path, ckp.path, sizeof(path));
+        ckp.pending = NULL;
+        pthread_mutex_unlock(&ckp.lock);
+
+        if (!write_atomically(path, data, size)) {
+            fprintf(stderr, "ОШИБКА: Невозможно записать контрольную точку '%s'\n", path);
+        }
+        free(data);
+
+        pthread_mutex_lock(&ckp.lock);
+    }
+    pthread_mutex_unlock(&ckp.lock);
+    return NULL;
+}
+
+static void hand_off(const char* path, unsigned char* data, size_t size) {
+    pthread_mutex_lock(&ckp.lock);
+    if (!ckp.active) {
+        ckp.stop = false;
+        ckp.active = pthread_create(&ckp.thread, NULL, checkpoint_thread, NULL) == 0;
+    }
+    if (!ckp.active) {
+        // Поток не создан — пишем сразу
+        pthread_mutex_unlock(&ckp.lock);
+        if (!write_atomically(path, data, size)) {
+            fprintf(stderr, "ОШИБКА: Невозможно записать контрольную точку '%s'\n", path);
+        }
+        free(data);
+        return;
+    }
+    // Незаписанная предыдущая точка устарела
+    free(ckp.pending);
+    ckp.pending = data;
+    ckp.pending_size = size;
+    snprintf(ckp.path, sizeof(ckp.path), "%s", path);
+    pthread_cond_signal(&ckp.changed);
+    pthread_mutex_unlock(&ckp.lock);
+}
+
+void checkpoint_finish(void) {
+    if (!ckp.active) return;
+    pthread_mutex_lock(&ckp.lock);
+    ckp.stop = true;
+    pthread_cond_signal(&ckp.changed);
+    pthread_mutex_unlock(&ckp.lock);
+    // Поток завершается, когда запишет последнюю точку
+    pthread_join(ckp.thread, NULL);
+    ckp.active = false;
+}
+
+#endif
+
+void checkpoint_save(const char* path, const Field* f, const History* hist,
+                     const CheckpointFrame* frames, int depth, long lines) {
+    Buffer b = { NULL, 0, 0, false };
+    if (!serialize(&b, f, hist, frames, depth, lines)) {
+        fprintf(stderr, "ОШИБКА: Недостаточно памяти для контрольной точки\n");
+        free(b.data);
+        return;
+    }
+    hand_off(path, b.data, b.size);
+}
+
+// =============== Чтение ===============
+
+typedef struct {
+    const unsigned char* p;
+    size_t left;
+    bool bad;
+} Reader;
+
+static const unsigned char* get_bytes(Reader* r, size_t n) {
+    if (r->bad || r->left < n) {
+        r->bad = true;
+        return NULL;
+    }
+    const unsigned char* p = r->p;
+    r->p += n;
+    r->left -= n;
+    return p;
+}
+
+static unsigned get_u8(Reader* r) {
+    const unsigned char* p = get_bytes(r, 1);
+    return p ? p[0] : 0;
+}
+
+static unsigned get_u16(Reader* r) {
+    const unsigned char* p = get_bytes(r, 2);
+    return p ? (unsigned)(p[0] | p[1] << 8) : 0;
+}
+
+static uint32_t get_u32(Reader* r) {
+    const unsigned char* p = get_bytes(r, 4);
+    if (!p) return 0;
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int get_i32(Reader* r) {
+    return (int)(int32_t)get_u32(r);
+}
+
+static uint64_t get_u64(Reader* r) {
+    uint64_t lo = get_u32(r);
+    return lo | (uint64_t)get_u32(r) << 32;
+}
+
+static size_t get_varint(Reader* r) {
+    size_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned c = get_u8(r);
+        if (r->bad) return 0;
+        v |= (size_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return v;
+    }
+    r->bad = true;
+    return 0;
+}
+
+// Восстанавливает клетки cur из prev и XOR-серий
+static void get_delta(Reader* r, const Field* prev, Field* cur) {
+    unsigned char x[MAX_WIDTH * MAX_HEIGHT];
+    size_t total = (size_t)cur->width * cur->height;
+    size_t pos = 0;
+    while (pos < total && !r->bad) {
+        size_t zeros = get_varint(r);
+        size_t lit = get_varint(r);
+        if (r->bad || zeros > total - pos || lit > total - pos - zeros) {
+            r->bad = true;
+            return;
+        }
+        memset(x + pos, 0, zeros);
+        pos += zeros;
+        const unsigned char* bytes = get_bytes(r, lit);
+        if (!bytes) return;
+        memcpy(x + pos, bytes, lit);
+        pos += lit;
+    }
+
+    size_t k = 0;
+    for (int y = 0; y < cur->height; y++) {
+        for (int i = 0; i < cur->width; i++) cur->grid[y][i] = prev->grid[y][i] ^ x[k++];
+    }
+    field_recount(cur);
+}
+
+// Читает файл целиком. Возвращает NULL при ошибке
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    size_t cap = 65536, used = 0;
+    unsigned char* data = malloc(cap);
+    while (data) {
+        used += fread(data + used, 1, cap - used, fp);
+        if (used < cap) break;
+        unsigned char* grown = realloc(data, cap * 2);
+        if (!grown) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        cap *= 2;
+    }
+    fclose(fp);
+    *size = used;
+    return data;
+}
+
+// Версия, прочитанная из файла; name — имя ветки (у состояний UNDO и REDO пустое)
+typedef struct {
+    Field* field;
+    char name[BRANCH_NAME_MAX];
+} LoadedVersion;
+
+/**
+ * Читает n версий, записанных put_version подряд после поля *prev.
+ * named — перед каждой версией записано имя ветки. Поля выделяются в out,
+ * *prev указывает на последнее прочитанное. Возвращает false при ошибке,
+ * уже созданные поля освобождает вызывающий.
+ */
+static bool get_versions(Reader* r, int w, int h, uint32_t n, bool named,
+                         LoadedVersion* out, const Field** prev) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (named) {
+            unsigned len = get_u16(r);
+            const unsigned char* name = get_bytes(r, len);
+            if (!name || len == 0 || len >= BRANCH_NAME_MAX) return false;
+            memcpy(out[i].name, name, len);
+            out[i].name[len] = '\0';
+        }
+        Field* s = create_field(w, h);
+        if (!s) return false;
+        out[i].field = s;
+        s->dino_x = get_i32(r);
+        s->dino_y = get_i32(r);
+        s->dino_placed = get_u8(r);
+        get_delta(r, *prev, s);
+        if (r->bad) return false;
+        *prev = s;
+    }
+    return true;
+}
+
+static void free_versions(LoadedVersion* v, uint32_t n) {
+    if (!v) return;
+    for (uint32_t i = 0; i < n; i++) free_field(v[i].field);
+    free(v);
+}
+
+/**
+ * Разбирает поле, стеки UNDO и REDO и ветки. Версии записаны одной цепочкой
+ * XOR, поэтому читаются все, а стеки собираются со дна в конце.
+ */
+static bool load_state(Reader* r, Field* f, History* hist) {
+    int w = get_i32(r);
+    int h = get_i32(r);
+    int dx = get_i32(r);
+    int dy = get_i32(r);
+    bool created = get_u8(r);
+    bool placed = get_u8(r);
+    if (r->bad) return false;
+
+    if (created) {
+        Field* loaded = create_field(w, h);
+        if (!loaded) return false;
+        *f = *loaded;
+        free(loaded);
+        for (int y = 0; y < h; y++) {
+            const unsigned char* row = get_bytes(r, w);
+            if (!row) return false;
+            memcpy(f->grid[y], row, w);
+        }
+        field_recount(f);
+    }
+    f->dino_x = dx;
+    f->dino_y = dy;
+    f->dino_placed = placed;
+
+    uint32_t count = get_u32(r);
+    uint32_t skipped = get_u32(r);
+    if (r->bad || count > MAX_UNDO_DEPTH || skipped > MAX_UNDO_DEPTH - count || (count && !created)) return false;
+    hist->count = (int)skipped;
+    hist->skipped = (int)skipped;
+
+    const Field* prev = f;
+    LoadedVersion* undo = calloc(count ? count : 1, sizeof(LoadedVersion));
+    bool ok = undo && get_versions(r, w, h, count, false, undo, &prev);
+
+    // REDO не длиннее стека UNDO, из которого снят; ветки ограничены только файлом
+    uint32_t redo_count = ok ? get_u32(r) : 0;
+    ok = ok && !r->bad && redo_count <= MAX_UNDO_DEPTH && (created || !redo_count);
+    LoadedVersion* redo = ok ? calloc(redo_count ? redo_count : 1, sizeof(LoadedVersion)) : NULL;
+    ok = redo && get_versions(r, w, h, redo_count, false, redo, &prev);
+
+    uint32_t branch_count = ok ? get_u32(r) : 0;
+    ok = ok && !r->bad && branch_count <= 65536 && (created || !branch_count);
+    LoadedVersion* branches = ok ? calloc(branch_count ? branch_count : 1, sizeof(LoadedVersion)) : NULL;
+    ok = branches && get_versions(r, w, h, branch_count, true, branches, &prev);
+
+    // Записаны от вершины ко дну (ветки — в порядке списка): собираем со дна
+    for (uint32_t i = count; ok && i-- > 0;) push_field_copy(hist, undo[i].field);
+    ok = ok && hist->count == (int)(skipped + count);
+    for (uint32_t i = redo_count; ok && i-- > 0;) ok = push_redo_copy(hist, redo[i].field);
+    for (uint32_t i = branch_count; ok && i-- > 0;) ok = branch_field_copy(hist, branches[i].field, branches[i].name);
+
+    free_versions(undo, count);
+    free_versions(redo, redo_count);
+    free_versions(branches, branch_count);
+    return ok;
+}
+
+bool checkpoint_load(const char* path, Field* f, History* hist,
+                     CheckpointFrame** frames, int* depth, long* lines) {
+    size_t size = 0;
+    unsigned char* data = read_file(path, &size);
+    if (!data) return false;
+
+    Reader r = { data, size, false };
+    const unsigned char* magic = get_bytes(&r, 8);
+    bool ok = magic && memcmp(magic, CHECKPOINT_MAGIC, 8) == 0 && get_u32(&r) == CHECKPOINT_VERSION;
+    if (ok) {
+        *lines = (long)get_u64(&r);
+        ok = load_state(&r, f, hist);
+    }
+
+    *frames = NULL;
+    *depth = 0;
+    uint32_t n = ok ? get_u32(&r) : 0;
+    if (ok && (r.bad || n == 0 || n > 65536)) ok = false;
+    if (ok) {
+        *frames = calloc(n, sizeof(CheckpointFrame));
+        ok = *frames != NULL;
+    }
+    for (uint32_t i = 0; ok && i < n; i++) {
+        unsigned len = get_u16(&r);
+        const unsigned char* name = get_bytes(&r, len);
+        char* copy = name ? malloc(len + 1) : NULL;
+        if (!copy) {
+            ok = false;
+            break;
+        }
+        memcpy(copy, name, len);
+        copy[len] = '\0';
+        (*frames)[i].filename = copy;
+        (*frames)[i].pc = get_i32(&r);
+        *depth = i + 1;
+        ok = !r.bad;
+    }
+    free(data);
+    return ok;
+}
+
+void checkpoint_free_frames(CheckpointFrame* frames, int depth) {
+    if (!frames) return;
+    for (int i = 0; i < depth; i++) free((char*)frames[i].filename);
+    free(frames);
+}
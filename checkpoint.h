@@ -0,0 +1,62 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "field.h"
+#include "history.h"
+#include <stdbool.h>
+
+/**
+ * Контрольные точки (--checkpoint file --every N, --resume file).
+ * Контрольная точка — полное состояние интерпретатора в двоичном виде:
+ * поле, динозавр, стеки UNDO и REDO, ветки BRANCH и стек выполняемых
+ * файлов (EXEC). Версии поля хранятся как XOR с соседней версией, сжатый
+ * по сериям нулей: соседние версии обычно отличаются парой клеток.
+ *
+ * Формат (числа — little-endian, v — varint):
+ *   "DINOCKP1", u32 версия, u64 число выполненных строк
+ *   поле: i32 width, height, dino_x, dino_y, u8 field_created, dino_placed,
+ *         width * height байт клеток (если поле создано)
+ *   u32 число сохранённых состояний UNDO, u32 число пропущенных (без копии поля),
+ *   затем сохранённые состояния от верхнего к нижнему, каждое — версия:
+ *         i32 dino_x, dino_y, u8 dino_placed,
+ *         клетки: пары (v нулей, v n, n байт XOR) с предыдущей записанной версией
+ *   u32 число состояний REDO, затем версии от верхнего к нижнему
+ *   u32 число веток, для каждой: u16 длина имени, имя, версия
+ *   u32 глубина стека файлов, для каждого: u16 длина имени, имя, i32 строка
+ */
+
+/**
+ * Файл в стеке выполнения.
+ * - filename: имя файла (как в EXEC или в командной строке)
+ * - pc: номер строки скрипта (с нуля, после пропуска пустых и комментариев).
+ *   Во внешних файлах — строка EXEC, которая сейчас выполняется,
+ *   в самом вложенном — строка, с которой продолжить.
+ */
+typedef struct {
+    const char* filename;
+    int pc;
+} CheckpointFrame;
+
+/**
+ * Записывает контрольную точку в path. Состояние сериализуется в память
+ * (время пропорционально его размеру), файл пишет фоновый поток через
+ * временный файл path.tmp и переименование. Если предыдущая точка ещё
+ * не записана, она заменяется новой.
+ */
+void checkpoint_save(const char* path, const Field* f, const History* hist,
+                     const CheckpointFrame* frames, int depth, long lines);
+
+// Дожидается записи последней контрольной точки и останавливает поток
+void checkpoint_finish(void);
+
+/**
+ * Читает контрольную точку из path в пустые f и hist.
+ * frames выделяется (вместе с именами файлов) и освобождается checkpoint_free_frames.
+ * Возвращает false, если файл не читается или повреждён.
+ */
+bool checkpoint_load(const char* path, Field* f, History* hist,
+                     CheckpointFrame** frames, int* depth, long* lines);
+
+void checkpoint_free_frames(CheckpointFrame* frames, int depth);
+
+#endif
@@ -1,6 +1,8 @@
 #include "command.h"
 #include "utils.h"
-#include <stdio.h>
+#include "eventlog.h"
+#include "heatmap.h"
+#include "journal.h"
 #include <string.h>
 
 /**
@@ -10,11 +12,10 @@
  */
 bool can_move_to(Field* f, int x, int y) {
     // Нормализуем координаты (тор)
-    x = wrap(x, f->width);
-    y = wrap(y, f->height);
+    x = field_wrap_x(f, x);
+    y = field_wrap_y(f, y);
 
-    char sym = f->grid[y][x].symbol;
-    return sym != '%' && sym != '^' && sym != '&' && sym != '@';
+    return !cell_is_blocked(f->grid[y][x]);
 }
 
 /**
@@ -31,33 +32,34 @@ bool move_dino(Field* f, const char* dir) {
     get_delta(dir, &dx, &dy); // Получаем вектор смещения
 
     // Новые координаты с учётом тора
-    int nx = wrap(f->dino_x + dx, f->width);
-    int ny = wrap(f->dino_y + dy, f->height);
+    int nx = field_step_x(f, f->dino_x, dx);
+    int ny = field_step_y(f, f->dino_y, dy);
 
     // Проверяем, что находится в целевой клетке
-    char target = f->grid[ny][nx].symbol;
+    Cell target = f->grid[ny][nx];
 
     // Случай 1: яма — критическая ошибка
-    if (target == '%') {
-        fprintf(stderr, "ОШИБКА: Динозавр свалился в яму!\n");
+    if (cell_object(target) == CELL_PIT) {
+        event_log_emit(EV_FELL_INTO_PIT, nx, ny);
         return false; // Программа завершится
     }
 
     // Случай 2: препятствие — просто игнорируем команду
-    if (target == '^' || target == '&' || target == '@') {
-        fprintf(stderr, "ВНИМАНИЕ: Движение блокируется препятствием.\n");
+    if (cell_is_solid(target)) {
+        event_log_emit(EV_MOVE_BLOCKED, nx, ny);
+        heat_add(HEAT_BLOCKED, nx, ny, 1);
         return true; // Не ошибка, просто ничего не делаем
     }
 
     // Случай 3: можно идти
     // Сначала очищаем старую позицию:
     // Если там был цвет — оставляем его, иначе ставим '_'
-    f->grid[f->dino_y][f->dino_x].symbol =
-        f->grid[f->dino_y][f->dino_x].color ?
-        f->grid[f->dino_y][f->dino_x].color : '_';
+    journal_touch(f, f->dino_x, f->dino_y);
+    field_vacate(f, f->dino_x, f->dino_y);
 
     // Ставим динозавра на новое место
     place_dinosaur(f, nx, ny);
+    heat_add(HEAT_VISIT, nx, ny, 1);
     return true;
 }
 
@@ -75,47 +77,48 @@ bool jump_dino(Field* f, const char* dir, int n) {
     int dx = 0, dy = 0;
     get_delta(dir, &dx, &dy);
 
-    int cx = f->dino_x; // Текущая позиция
-    int cy = f->dino_y;
+    // Таблицы соседей для этого направления
+    const unsigned char* step_x = f->col_step[dx + 1];
+    const unsigned char* step_y = f->row_step[dy + 1];
 
-    // Предварительно вычисляем конечную точку (с тором)
-    int final_x = wrap(cx + dx * n, f->width);
-    int final_y = wrap(cy + dy * n, f->height);
+    // Последняя пройденная клетка — она и будет точкой приземления
+    int final_x = f->dino_x;
+    int final_y = f->dino_y;
 
     // Проверяем путь по каждой промежуточной клетке
     for (int step = 1; step <= n; step++) {
-        int px = wrap(cx + dx * step, f->width);
-        int py = wrap(cy + dy * step, f->height);
-        char sym = f->grid[py][px].symbol;
-
+        int px = step_x[final_x];
+        int py = step_y[final_y];
         // Если встречаем непроходимый объект — останавливаемся перед ним
-        if (sym == '&' || sym == '@' || sym == '^') {
+        if (cell_is_solid(f->grid[py][px])) {
             if (step == 1) {
                 // Препятствие сразу рядом — прыжок невозможен
-                fprintf(stderr, "ВНИМАНИЕ: Прыжок блокируется немедленно.\n");
+                event_log_emit(EV_JUMP_BLOCKED, px, py);
+                heat_add(HEAT_BLOCKED, px, py, 1);
                 return true;
             }
-            // Останавливаемся на предыдущей клетке
-            final_x = wrap(cx + dx * (step - 1), f->width);
-            final_y = wrap(cy + dy * (step - 1), f->height);
-            fprintf(stderr, "ВНИМАНИЕ: Прыжок остановлен перед препятствием.\n");
+            // Остаёмся на предыдущей клетке
+            event_log_emit(EV_JUMP_STOPPED, px, py);
+            heat_add(HEAT_BLOCKED, px, py, 1);
             break; // Дальше не летим
         }
         //Ямы (%) не блокируют полёт, только приземление
+        final_x = px;
+        final_y = py;
     }
 
     // Проверяем клетку приземления
-    if (f->grid[final_y][final_x].symbol == '%') {
-        fprintf(stderr, "ОШИБКА: Динозавр приземлился в яму во время прыжка!\n");
+    if (cell_object(f->grid[final_y][final_x]) == CELL_PIT) {
+        event_log_emit(EV_LANDED_IN_PIT, final_x, final_y);
         return false;
     }
 
     // Перемещаем динозавра
-    f->grid[f->dino_y][f->dino_x].symbol =
-        f->grid[f->dino_y][f->dino_x].color ?
-        f->grid[f->dino_y][f->dino_x].color : '_';
+    journal_touch(f, f->dino_x, f->dino_y);
+    field_vacate(f, f->dino_x, f->dino_y);
 
     place_dinosaur(f, final_x, final_y);
+    heat_add(HEAT_VISIT, final_x, final_y, 1);
     return true;
 }
 
@@ -125,7 +128,8 @@ bool jump_dino(Field* f, const char* dir, int n) {
  */
 bool paint_cell(Field* f, char c) {
     if (c < 'a' || c > 'z') return false; // Только строчные латинские буквы
-    f->grid[f->dino_y][f->dino_x].color = c;
+    journal_touch(f, f->dino_x, f->dino_y);
+    field_set_color(f, f->dino_x, f->dino_y, c);
     return true;
 }
 
@@ -143,34 +147,39 @@ bool modify_adjacent(Field* f, const char* dir, char new_symbol, bool require_em
     get_delta(dir, &dx, &dy);
 
     // Координаты соседней клетки
-    int nx = wrap(f->dino_x + dx, f->width);
-    int ny = wrap(f->dino_y + dy, f->height);
+    int nx = field_step_x(f, f->dino_x, dx);
+    int ny = field_step_y(f, f->dino_y, dy);
 
-    char current = f->grid[ny][nx].symbol;
-    char current_color = f->grid[ny][nx].color;
+    int current = cell_object(f->grid[ny][nx]);
+    int new_object = cell_object_from_symbol(new_symbol);
+    if (new_object < 0) return false; // Неизвестный объект
 
     // Общий запрет: нельзя создавать на непустой клетке (если require_empty=true),
     // за исключением специального случая: MOUND в яму
-    if (require_empty && current != '_' && !(current == '%' && new_symbol == '^')) {
+    if (require_empty && current != CELL_EMPTY &&
+        !(current == CELL_PIT && new_object == CELL_MOUND)) {
         return false; // Нельзя создать
     }
 
     // Специальный случай: засыпание ямы горой
-    if (current == '%' && new_symbol == '^') {
+    if (current == CELL_PIT && new_object == CELL_MOUND) {
         // Яма исчезает, остаётся цвет (если был)
-        f->grid[ny][nx].symbol = current_color ? current_color : '_';
-        f->grid[ny][nx].color = current_color;
+        journal_touch(f, nx, ny);
+        field_vacate(f, nx, ny);
+        heat_add(HEAT_FILLED, nx, ny, 1);
         return true;
     }
 
     // Для дерева и камня — дополнительная проверка: только на '_'
-    if ((new_symbol == '&' || new_symbol == '@') && current != '_') {
+    if ((new_object == CELL_TREE || new_object == CELL_STONE) && current != CELL_EMPTY) {
         return false;
     }
 
     // Обычное создание объекта
-    f->grid[ny][nx].symbol = new_symbol;
     // Цвет НЕ перезаписываем — он сохраняется!
+    journal_touch(f, nx, ny);
+    field_set_object(f, nx, ny, new_object);
+    heat_add(HEAT_DUG, nx, ny, new_object == CELL_PIT);
     return true;
 }
 
@@ -182,19 +191,17 @@ bool cut_tree(Field* f, const char* dir) {
     int dx = 0, dy = 0;
     get_delta(dir, &dx, &dy);
 
-    int nx = wrap(f->dino_x + dx, f->width);
-    int ny = wrap(f->dino_y + dy, f->height);
+    int nx = field_step_x(f, f->dino_x, dx);
+    int ny = field_step_y(f, f->dino_y, dy);
 
     // Проверяем, есть ли там дерево
-    if (f->grid[ny][nx].symbol != '&') {
+    if (cell_object(f->grid[ny][nx]) != CELL_TREE) {
         return false; // Нечего рубить
     }
 
-    // Сохраняем цвет клетки
-    char col = f->grid[ny][nx].color;
-
     // Делаем клетку пустой, но с цветом (если был)
-    f->grid[ny][nx].symbol = col ? col : '_';
+    journal_touch(f, nx, ny);
+    field_vacate(f, nx, ny);
     return true;
 }
 
@@ -212,35 +219,35 @@ bool push_stone(Field* f, const char* dir) {
     get_delta(dir, &dx, &dy);
 
     // Позиция камня (соседняя клетка)
-    int sx = wrap(f->dino_x + dx, f->width);
-    int sy = wrap(f->dino_y + dy, f->height);
+    int sx = field_step_x(f, f->dino_x, dx);
+    int sy = field_step_y(f, f->dino_y, dy);
 
     // Проверяем, есть ли там камень
-    if (f->grid[sy][sx].symbol != '@') {
+    if (cell_object(f->grid[sy][sx]) != CELL_STONE) {
         return false; // Нечего толкать
     }
 
     // Позиция, куда летит камень (на шаг дальше)
-    int tx = wrap(sx + dx, f->width);
-    int ty = wrap(sy + dy, f->height);
+    int tx = field_step_x(f, sx, dx);
+    int ty = field_step_y(f, sy, dy);
 
-    char target = f->grid[ty][tx].symbol;
-    char target_color = f->grid[ty][tx].color;
+    Cell target = f->grid[ty][tx];
 
     // Если там неподвижное препятствие — камень не двигается
-    if (target == '^' || target == '&' || target == '@') {
+    if (cell_is_solid(target)) {
         return true; // Просто ничего не делаем
     }
 
     // Если камень попадает в яму — яма засыпается
-    if (target == '%') {
+    journal_touch(f, tx, ty);
+    if (cell_object(target) == CELL_PIT) {
         // Яма исчезает, цвет сохраняется
-        f->grid[ty][tx].symbol = target_color ? target_color : '_';
-        f->grid[ty][tx].color = target_color;
+        field_vacate(f, tx, ty);
+        heat_add(HEAT_FILLED, tx, ty, 1);
     }
     // Если клетка пустая — просто ставим туда камень
-    else if (target == '_') {
-        f->grid[ty][tx].symbol = '@';
+    else if (cell_object(target) == CELL_EMPTY) {
+        field_set_object(f, tx, ty, CELL_STONE);
         // Цвет остаётся как есть (обычно 0)
     } else {
         // Неожиданный символ — ошибка (не должно происходить)
@@ -248,9 +255,392 @@ bool push_stone(Field* f, const char* dir) {
     }
 
     // Убираем камень со старого места
-    char old_col = f->grid[sy][sx].color;
-    f->grid[sy][sx].symbol = old_col ? old_col : '_';
-    f->grid[sy][sx].color = old_col;
+    journal_touch(f, sx, sy);
+    field_vacate(f, sx, sy);
+
+    return true;
+}
+
+// Номер младшего единичного бита v (v != 0)
+static inline int lowest_bit(uint64_t v) {
+#ifdef __GNUC__
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Номер старшего единичного бита v (v != 0)
+static inline int highest_bit(uint64_t v) {
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(v);
+#else
+    int n = 63;
+    while (!(v >> 63)) {
+        v <<= 1;
+        n--;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Первый (up) или последний единичный бит карты занятости bits в диапазоне [lo, hi).
+ * Возвращает -1, если в диапазоне нет занятых клеток.
+ */
+static int find_busy(const uint64_t* bits, int lo, int hi, bool up) {
+    if (lo >= hi) return -1;
+    int first = lo >> 6, last = (hi - 1) >> 6;
+    for (int k = 0; k <= last - first; k++) {
+        int wi = up ? first + k : last - k;
+        uint64_t v = bits[wi];
+        if (wi == first) v &= ~(uint64_t)0 << (lo & 63);
+        if (wi == last && (hi & 63)) v &= ~(~(uint64_t)0 << (hi & 63));
+        if (v) return wi * 64 + (up ? lowest_bit(v) : highest_bit(v));
+    }
+    return -1;
+}
+
+/**
+ * Обход клеток линии по одной — только для общих клеток --world:
+ * их меняют другие агенты, и карты занятости этого поля не ведутся.
+ * Возвращает то же, что find_slide_stop.
+ */
+static int scan_slide_stop(Field* f, int sx, int sy, int dx, int dy, int* stop_x, int* stop_y) {
+    int steps = 0;
+    int x = sx, y = sy;
+    int size = dy == 0 ? f->width : f->height;
+    for (int i = 1; i < size; i++) {
+        x = field_step_x(f, x, dx);
+        y = field_step_y(f, y, dy);
+        if (cell_object(f->grid[y][x]) != CELL_EMPTY) break;
+        steps++;
+    }
+    // Свободна вся линия — поиск вернулся к самому камню
+    *stop_x = steps == size - 1 ? sx : x;
+    *stop_y = steps == size - 1 ? sy : y;
+    return steps;
+}
+
+/**
+ * Ищет ближайшую несвободную клетку на линии движения камня из (sx, sy).
+ * Свободной считается только пустая клетка '_' (как и в push_stone).
+ * Клетки не обходятся: ближайший занятый бит строки (row_busy) или столбца
+ * (col_busy) после камня, а если его нет — до камня (перенос через край тора).
+ * Сам камень занят, поэтому поиск всегда что-то находит: если больше
+ * на линии ничего нет, это сам камень через полный оборот.
+ * Возвращает количество свободных клеток перед найденной,
+ * координаты самой найденной клетки пишутся в *stop_x, *stop_y.
+ */
+static int find_slide_stop(Field* f, int sx, int sy, int dx, int dy, int* stop_x, int* stop_y) {
+    if (f->shared_cells) return scan_slide_stop(f, sx, sy, dx, dy, stop_x, stop_y);
+
+    bool row = dy == 0;
+    const uint64_t* bits = row ? f->row_busy[sy] : f->col_busy[sx];
+    int size = row ? f->width : f->height;
+    int p = row ? sx : sy;
+    int d = row ? dx : dy;
+
+    int q = d > 0 ? find_busy(bits, p + 1, size, true) : find_busy(bits, 0, p, false);
+    if (q < 0) q = d > 0 ? find_busy(bits, 0, p + 1, true) : find_busy(bits, p, size, false);
+    if (q < 0) q = p;
+
+    // Расстояние от камня до найденной клетки по направлению движения
+    int dist = ((q - p) * d + size) % size;
+    if (dist == 0) dist = size;
+    *stop_x = row ? q : sx;
+    *stop_y = row ? sy : q;
+    return dist - 1;
+}
+
+/**
+ * Толкает камень со скольжением.
+ * Логика:
+ * 1. Проверяем, есть ли камень рядом.
+ * 2. Одним поиском находим первую несвободную клетку на линии.
+ * 3. Если это яма (%) → камень засыпает её.
+ * 4. Иначе камень встаёт на последнюю свободную клетку перед ней
+ *    (если такой нет — камень остаётся на месте).
+ * Промежуточные клетки не меняются, поэтому длина пути не важна.
+ */
+bool push_stone_slide(Field* f, const char* dir) {
+    int dx = 0, dy = 0;
+    get_delta(dir, &dx, &dy);
+
+    // Позиция камня (соседняя клетка)
+    int sx = field_step_x(f, f->dino_x, dx);
+    int sy = field_step_y(f, f->dino_y, dy);
+
+    if (cell_object(f->grid[sy][sx]) != CELL_STONE) {
+        return false; // Нечего толкать
+    }
+
+    int stop_x, stop_y;
+    int steps = find_slide_stop(f, sx, sy, dx, dy, &stop_x, &stop_y);
+
+    if (cell_object(f->grid[stop_y][stop_x]) == CELL_PIT) {
+        // Камень засыпает яму, цвет сохраняется
+        journal_touch(f, stop_x, stop_y);
+        field_vacate(f, stop_x, stop_y);
+        heat_add(HEAT_FILLED, stop_x, stop_y, 1);
+    } else if (steps > 0) {
+        // Камень встаёт перед препятствием: шаг назад от найденной клетки
+        int tx = field_step_x(f, stop_x, -dx);
+        int ty = field_step_y(f, stop_y, -dy);
+        journal_touch(f, tx, ty);
+        field_set_object(f, tx, ty, CELL_STONE);
+    } else {
+        return true; // Препятствие сразу за камнем — ничего не происходит
+    }
+
+    // Убираем камень со старого места
+    journal_touch(f, sx, sy);
+    field_vacate(f, sx, sy);
+    return true;
+}
+
+/*
+ * =============== Прямоугольные области ===============
+ * PAINTRECT, FILL и условие COUNT обходят прямоугольник по строкам.
+ * Строка прямоугольника на торе — один или два непрерывных отрезка
+ * (второй — после переноса через правый край), и каждый отрезок
+ * обрабатывается ядром, которое работает сразу с 8 клетками в 64-битном
+ * слове (остаток отрезка — по одной клетке).
+ */
+#define BYTES8(b) (0x0101010101010101ULL * (uint8_t)(b))
+
+// 0x80 в каждом байте v, равном байту pattern, остальные байты — 0
+static inline uint64_t bytes_equal(uint64_t v, uint64_t pattern) {
+    uint64_t x = v ^ pattern;
+    return ~(((x & BYTES8(0x7F)) + BYTES8(0x7F)) | x) & BYTES8(0x80);
+}
+
+static inline uint64_t load8(const Cell* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline void store8(Cell* p, uint64_t v) {
+    memcpy(p, &v, 8);
+}
+
+/**
+ * Окрашивает n клеток строки y начиная со столбца x: цвет idx, объект не меняется.
+ * Счётчики поля обновляются по словам; занятость клеток окраска не меняет.
+ */
+static void paint_span(Field* f, int x, int y, int n, Cell idx) {
+    Cell* p = f->grid[y] + x;
+    const uint64_t color = BYTES8(idx);
+    const uint64_t keep = BYTES8(~CELL_COLOR_MASK);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v = load8(p + i);
+        uint64_t painted = (v & keep) | color;
+        if (painted == v) continue;
+        field_stats_add_word(f, v, x + i, y, -1);
+        field_stats_add_word(f, painted, x + i, y, 1);
+        store8(p + i, painted);
+    }
+    for (; i < n; i++) field_set_cell(f, x + i, y, (Cell)((p[i] & ~CELL_COLOR_MASK) | idx));
+}
+
+/**
+ * Ставит объект obj в n клеток строки y начиная со столбца x, цвет сохраняется.
+ * CELL_EMPTY освобождает клетку, как cell_vacate. Клетки с динозавром не меняются.
+ * Счётчики поля обновляются по словам, карты занятости — отрезками:
+ * после объекта заняты все клетки, после '_' — слово из одинаковых клеток
+ * отмечается целиком, остальные слова — по клеткам.
+ */
+static void fill_span(Field* f, int x, int y, int n, int obj) {
+    Cell* p = f->grid[y] + x;
+    const uint64_t dino = BYTES8(CELL_DINO << CELL_OBJECT_SHIFT);
+    const uint64_t object = BYTES8(obj << CELL_OBJECT_SHIFT);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v = load8(p + i);
+        uint64_t colors = v & BYTES8(CELL_COLOR_MASK);
+        // Цвет 1..26 плюс 0x1F даёт бит 0x20 (CELL_PAINTED), цвет 0 — нет
+        uint64_t objects = obj == CELL_EMPTY ? (colors + BYTES8(CELL_COLOR_MASK)) & BYTES8(CELL_PAINTED << CELL_OBJECT_SHIFT)
+                                             : object;
+        uint64_t keep = (bytes_equal(v & BYTES8(~CELL_COLOR_MASK), dino) >> 7) * 0xFF;
+        uint64_t filled = ((colors | objects) & ~keep) | (v & keep);
+        if (filled == v) continue;
+        field_stats_add_word(f, v, x + i, y, -1);
+        field_stats_add_word(f, filled, x + i, y, 1);
+        store8(p + i, filled);
+        if (obj != CELL_EMPTY) continue;
+        Cell c = (Cell)filled;
+        if (filled == BYTES8(c)) {
+            field_set_busy_span(f, x + i, y, 8, cell_object(c) != CELL_EMPTY);
+        } else {
+            for (int k = i; k < i + 8; k++) field_set_busy(f, x + k, y, cell_object(p[k]) != CELL_EMPTY);
+        }
+    }
+    if (obj != CELL_EMPTY) field_set_busy_span(f, x, y, i, true);
+    for (; i < n; i++) {
+        if (cell_object(p[i]) == CELL_DINO) continue;
+        if (obj == CELL_EMPTY) field_vacate(f, x + i, y);
+        else field_set_object(f, x + i, y, obj);
+    }
+}
+
+/**
+ * Клетка выводится символом sym, если (клетка & mask) == value:
+ * буква — пустая или окрашенная клетка этого цвета, '_' — пустая без цвета,
+ * символ объекта — код объекта. Для других символов совпадений нет.
+ */
+static void symbol_pattern(char sym, Cell* mask, Cell* value) {
+    int obj = cell_object_from_symbol(sym);
+    if (sym >= 'a' && sym <= 'z') {
+        *mask = (Cell)~(CELL_PAINTED << CELL_OBJECT_SHIFT);
+        *value = (Cell)(sym - 'a' + 1);
+    } else if (sym == '_') {
+        *mask = 0xFF;
+        *value = 0;
+    } else if (obj > CELL_PAINTED) {
+        *mask = (Cell)~CELL_COLOR_MASK;
+        *value = (Cell)(obj << CELL_OBJECT_SHIFT);
+    } else {
+        *mask = 0;
+        *value = 1;
+    }
+}
+
+// Число клеток отрезка, для которых (клетка & mask) == value
+static int count_span(const Cell* p, int n, Cell mask, Cell value) {
+    const uint64_t m = BYTES8(mask);
+    const uint64_t v = BYTES8(value);
+    int count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        // Единица в каждом совпавшем байте, умножение складывает их в старший байт
+        count += (int)((((bytes_equal(load8(p + i) & m, v) >> 7) * BYTES8(1)) >> 56));
+    }
+    for (; i < n; i++) count += (p[i] & mask) == value;
+    return count;
+}
+
+/**
+ * Прямоугольник на торе: левый верхний угол (x, y) приводится к полю,
+ * ширина и высота — не больше размеров поля (каждая клетка один раз).
+ * Строка y0 + j состоит из отрезков [x0, x0 + first) и [0, w - first).
+ */
+typedef struct {
+    int x0, y0, w, h, first;
+} Rect;
+
+static Rect make_rect(const Field* f, int x, int y, int w, int h) {
+    Rect r;
+    r.x0 = field_wrap_x(f, x);
+    r.y0 = field_wrap_y(f, y);
+    r.w = w < f->width ? w : f->width;
+    r.h = h < f->height ? h : f->height;
+    r.first = r.x0 + r.w <= f->width ? r.w : f->width - r.x0;
+    return r;
+}
 
+/**
+ * Отмечает в тепловой карте ямы, которые выкопает или засыплет FILL
+ * (до заполнения: отдельный проход только при включённой карте).
+ */
+static void heat_fill(const Field* f, Rect r, int obj) {
+    int y = r.y0;
+    for (int j = 0; j < r.h; j++) {
+        for (int i = 0; i < r.w; i++) {
+            int x = i < r.first ? r.x0 + i : i - r.first;
+            int old = cell_object(f->grid[y][x]);
+            if (old == CELL_DINO) continue;
+            heat_add(HEAT_DUG, x, y, old != CELL_PIT && obj == CELL_PIT);
+            heat_add(HEAT_FILLED, x, y, old == CELL_PIT && obj != CELL_PIT);
+        }
+        y = field_step_y(f, y, 1);
+    }
+}
+
+/**
+ * PAINTRECT: окрашивает прямоугольник w x h с углом (x, y) буквой c.
+ * Объекты в клетках не меняются (как при PAINT).
+ */
+bool paint_rect(Field* f, int x, int y, int w, int h, char c) {
+    if (c < 'a' || c > 'z' || w <= 0 || h <= 0) return false;
+    Rect r = make_rect(f, x, y, w, h);
+    Cell idx = (Cell)(c - 'a' + 1);
+    int row = r.y0;
+    for (int j = 0; j < r.h; j++) {
+        journal_touch_span(f, r.x0, row, r.first);
+        journal_touch_span(f, 0, row, r.w - r.first);
+        paint_span(f, r.x0, row, r.first, idx);
+        paint_span(f, 0, row, r.w - r.first, idx);
+        row = field_step_y(f, row, 1);
+    }
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * FILL: ставит объект sym во все клетки прямоугольника, кроме клеток с динозавром.
+ * Цвет клеток сохраняется; '_' убирает объекты.
+ */
+bool fill_rect(Field* f, int x, int y, int w, int h, char sym) {
+    int obj = cell_object_from_symbol(sym);
+    if (w <= 0 || h <= 0 || (obj != CELL_EMPTY && obj < CELL_PIT)) return false;
+    Rect r = make_rect(f, x, y, w, h);
+    if (heatmap_enabled()) heat_fill(f, r, obj);
+    int row = r.y0;
+    for (int j = 0; j < r.h; j++) {
+        journal_touch_span(f, r.x0, row, r.first);
+        journal_touch_span(f, 0, row, r.w - r.first);
+        fill_span(f, r.x0, row, r.first, obj);
+        fill_span(f, 0, row, r.w - r.first, obj);
+        row = field_step_y(f, row, 1);
+    }
+    return true;
+}
+
+/**
+ * COUNT: число клеток прямоугольника, которые выводятся символом sym
+ * (как в условии CELL ... IS sym).
+ * Прямоугольник во всю высоту поля считается по счётчикам столбцов,
+ * шире половины поля — по счётчикам строк за вычетом клеток вне него,
+ * остальные — проходом по клеткам. Общие клетки --world всегда обходятся.
+ */
+int count_rect(const Field* f, int x, int y, int w, int h, char sym) {
+    if (w <= 0 || h <= 0) return 0;
+    Rect r = make_rect(f, x, y, w, h);
+    int s = f->shared_cells ? -1 : field_symbol_index(sym);
+    int count = 0;
+    if (s >= 0 && r.h == f->height) {
+        int col = r.x0;
+        for (int i = 0; i < r.w; i++) {
+            count += f->stats.cols[col][s];
+            col = field_step_x(f, col, 1);
+        }
+        return count;
+    }
+
+    Cell mask, value;
+    symbol_pattern(sym, &mask, &value);
+    bool by_rows = s >= 0 && 2 * r.w > f->width;
+    // Клетки строки вне прямоугольника: отрезки [rest_x, rest_x + rest_first) и [0, rest - rest_first)
+    int rest = f->width - r.w;
+    int rest_x = r.x0 + r.w < f->width ? r.x0 + r.w : r.x0 + r.w - f->width;
+    int rest_first = rest_x + rest <= f->width ? rest : f->width - rest_x;
+    int row = r.y0;
+    for (int j = 0; j < r.h; j++) {
+        if (by_rows) {
+            count += f->stats.rows[row][s];
+            count -= count_span(f->grid[row] + rest_x, rest_first, mask, value);
+            count -= count_span(f->grid[row], rest - rest_first, mask, value);
+        } else {
+            count += count_span(f->grid[row] + r.x0, r.first, mask, value);
+            count += count_span(f->grid[row], r.w - r.first, mask, value);
+        }
+        row = field_step_y(f, row, 1);
+    }
+    return count;
+}
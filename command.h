@@ -3,6 +3,12 @@
 
 #include "field.h"    
 #include "history.h"
+#include "profiler.h"
+#include "shmexport.h"
+#include "world.h"
+#include "viewport.h"
+#include "heatmap.h"
+#include "trace.h"
 #include <stdbool.h>
 
 /**
@@ -11,9 +17,41 @@
 typedef struct {
     int interval;    // Задержка между обновлениями (в секундах)
     bool display;    // true — выводить поле в консоль; false — нет
+    Viewport viewport; // Окно вывода вокруг динозавра (--viewport, --minimap)
     bool save;       // true — сохранять результат в файл; false — нет
+    bool quiet;      // true — не выводить предупреждения (--quiet)
+    long max_warnings; // Максимум выводимых предупреждений (--max-warnings), -1 — без ограничения
+    const char* profile_out; // Префикс файлов отчёта профилировщика (--profile-out)
+    Profiler* profiler;      // Профилировщик строк (--profile); NULL — выключен
+    ShmExport* shm;          // Публикация состояния в разделяемой памяти (--shm); NULL — выключена
+    bool prefetch;           // Фоновая загрузка файлов EXEC и LOAD (--prefetch)
+    int threads;             // Потоки для GENERATE (--threads), 0 — по числу процессоров
+    long snapshot_every;     // Снимок поля каждые N строк (--snapshot-every), 0 — выключено
+    const char* snapshot_path; // Файл снимков (выходной файл); NULL — снимки не пишутся
+    const char* checkpoint_path; // Файл контрольных точек (--checkpoint); NULL — выключены
+    long checkpoint_every;   // Контрольная точка каждые N строк (--every)
+    const char* resume_path; // Продолжить с контрольной точки (--resume); NULL — с начала
+    bool status;             // Строка состояния после каждой команды из stdin (--status)
+    bool undo_analysis;      // Снимки UNDO только там, где UNDO до них дойдёт (выключается --no-undo-analysis)
+    bool peephole;           // Сокращение блоков MOVE/PAINT (выключается --no-peephole)
+    bool peephole_report;    // Вывести в конце, сколько команд сократил оптимизатор (--peephole-report)
+    bool atomic_exec;        // EXEC целиком отменяется одной UNDO (--atomic-exec)
+    bool field_stats;        // Вывести в конце счётчики клеток поля (--field-stats)
+    FieldFormat field_format; // Формат выходного файла, SAVE и снимков (--field-format)
+    const char* heatmap_out; // Префикс файлов тепловой карты (--heatmap); NULL — выключена
+    HeatmapFormat heatmap_format; // Формат тепловой карты (--heatmap-format)
+    const char* record_path; // Файл записи выполнения (--record); NULL — не записывать
+    long record_every;       // Полный кадр записи каждые N строк (--keyframe-every)
+    Trace* trace;            // Открытая запись выполнения; NULL — выключена
+    WorldAgent* agent;       // Агент совместного выполнения (--world); NULL — обычный запуск
 } Options;
 
+/**
+ * Разбирает опции командной строки (аргументы после имён файлов) в opts.
+ * Неизвестные опции игнорируются.
+ */
+void parse_options(int argc, char* argv[], Options* opts);
+
 /**
  * Перемещает динозавра на одну клетку в заданном направлении.
  * Возвращает false, если динозавр упал в яму (критическая ошибка).
@@ -50,10 +88,39 @@ bool cut_tree(Field* f, const char* dir);
 
 /**
  * Толкает камень в соседней клетке по направлению.
- * Камень движется дальше в том же направлении, пока не упрётся или не упадёт в яму.
+ * Камень сдвигается на одну клетку (или засыпает яму в этой клетке).
  */
 bool push_stone(Field* f, const char* dir);
 
+/**
+ * Толкает камень со скольжением (PUSH DIR SLIDE).
+ * Камень движется дальше в том же направлении, пока не упрётся в препятствие
+ * или не засыплет первую встреченную яму.
+ * Возвращает false, если рядом нет камня.
+ */
+bool push_stone_slide(Field* f, const char* dir);
+
+/**
+ * Окрашивает прямоугольник w x h с левым верхним углом (x, y) буквой c
+ * (PAINTRECT). Прямоугольник переносится по тору, ширина и высота
+ * ограничиваются размерами поля. Объекты в клетках не меняются.
+ * Возвращает false при неверной букве или размере.
+ */
+bool paint_rect(Field* f, int x, int y, int w, int h, char c);
+
+/**
+ * Ставит объект sym ('_', '%', '^', '&', '@') во все клетки прямоугольника,
+ * кроме клеток с динозавром (FILL). Цвет сохраняется, '_' убирает объекты.
+ * Возвращает false при неверном символе или размере.
+ */
+bool fill_rect(Field* f, int x, int y, int w, int h, char sym);
+
+/**
+ * Считает клетки прямоугольника, которые выводятся символом sym
+ * (условие COUNT x y w h sym IS n).
+ */
+int count_rect(const Field* f, int x, int y, int w, int h, char sym);
+
 /**
  * Проверяет, можно ли переместиться в клетку (x, y).
  * Возвращает false, если там яма, гора, дерево или камень.
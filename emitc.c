@@ -0,0 +1,498 @@
+#include "emitc.h"
+#include "parser.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Состояние транслятора.
+ * - out: функции файлов (пишутся во временный файл,
+ *   потому что список файлов известен только в конце)
+ * - files: имена транслируемых файлов, номер файла = индекс в script_files[]
+ */
+typedef struct {
+    FILE* out;
+    char** files;
+    int file_count;
+    int file_cap;
+} Emitter;
+
+/**
+ * Записывает строку s как строковый литерал C (с экранированием).
+ */
+static void emit_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p == '\n') {
+            fputs("\\n", out);
+        } else if (*p < 0x20 || *p == 0x7f || *p == '?') {
+            fprintf(out, "\\%03o", *p); // '?' — чтобы не получились триграфы
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Записывает текст строки скрипта как комментарий (до конца строки).
+ * Символы, которые могут сломать комментарий ('\\' в конце, триграфы), заменяются.
+ */
+static void emit_comment_text(FILE* out, const char* text) {
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        fputc((*p < 0x20 || *p == '\\' || *p == '?') ? '.' : *p, out);
+    }
+    fputc('\n', out);
+}
+
+static void emit_comment(FILE* out, const char* filename, int line_num, const char* text) {
+    fputs("// ", out);
+    fputs(filename, out);
+    fprintf(out, ":%d: ", line_num);
+    emit_comment_text(out, text);
+}
+
+static void emit_indent(Emitter* e, int indent) {
+    for (int i = 0; i < indent; i++) fputs("    ", e->out);
+}
+
+/**
+ * Возвращает номер файла в script_files[] (добавляет новый при первом вызове).
+ */
+static int emitter_file(Emitter* e, const char* filename) {
+    for (int i = 0; i < e->file_count; i++) {
+        if (strcmp(e->files[i], filename) == 0) return i;
+    }
+    if (e->file_count == e->file_cap) {
+        int cap = e->file_cap ? e->file_cap * 2 : 8;
+        char** files = realloc(e->files, cap * sizeof(char*));
+        if (!files) return 0;
+        e->files = files;
+        e->file_cap = cap;
+    }
+    char* name = malloc(strlen(filename) + 1);
+    if (!name) return 0;
+    strcpy(name, filename);
+    e->files[e->file_count] = name;
+    return e->file_count++;
+}
+
+/**
+ * Строка, которую нельзя разобрать заранее: передаём её интерпретатору.
+ * Так ошибки формата выводятся точно так же и в тот же момент.
+ */
+static void emit_fallback(Emitter* e, const char* text, int line_num, int indent) {
+    emit_indent(e, indent);
+    fputs("{ static char text[] = ", e->out);
+    emit_string(e->out, text);
+    fprintf(e->out, "; if (!execute_command(f, hist, text, %d, opts)) return false; }\n", line_num);
+}
+
+/**
+ * Шаги до и после обычной команды: проверки + сохранение для UNDO и визуализация.
+ */
+static void emit_begin(Emitter* e, const char* cmd, int line_num, int indent) {
+    emit_indent(e, indent);
+    fprintf(e->out, "if (!command_begin(f, hist, \"%s\", %d)) return false;\n", cmd, line_num);
+}
+
+static void emit_show(Emitter* e, int indent) {
+    emit_indent(e, indent);
+    fputs("command_show(f, opts);\n", e->out);
+}
+
+/**
+ * Транслирует одну команду. Разбор аргументов повторяет execute_command,
+ * всё, что не прошло разбор, уходит в emit_fallback.
+ */
+static void emit_command(Emitter* e, const char* line, int line_num, int indent) {
+    char cmd[32];
+    if (sscanf(line, "%31s", cmd) != 1) {
+        emit_fallback(e, line, line_num, indent);
+        return;
+    }
+
+    // Команды с одним направлением и вызов, который им соответствует
+    static const struct { const char* name; const char* fmt; const char* call; } dir_cmds[] = {
+        { "MOVE",  "MOVE %15s",  "if (!move_dino(f, \"%s\")) return false;\n" },
+        { "DIG",   "DIG %15s",   "modify_adjacent(f, \"%s\", '%%', true);\n" },
+        { "MOUND", "MOUND %15s", "modify_adjacent(f, \"%s\", '^', true);\n" },
+        { "GROW",  "GROW %15s",  "modify_adjacent(f, \"%s\", '&', true);\n" },
+        { "CUT",   "CUT %15s",   "cut_tree(f, \"%s\");\n" },
+        { "MAKE",  "MAKE %15s",  "modify_adjacent(f, \"%s\", '@', true);\n" },
+    };
+
+    for (size_t i = 0; i < sizeof(dir_cmds) / sizeof(dir_cmds[0]); i++) {
+        if (strcmp(cmd, dir_cmds[i].name) != 0) continue;
+        char dir[16];
+        if (sscanf(line, dir_cmds[i].fmt, dir) != 1 || !is_direction(dir)) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fprintf(e->out, dir_cmds[i].call, dir);
+        emit_show(e, indent);
+        return;
+    }
+
+    if (strcmp(cmd, "SIZE") == 0) {
+        int w, h;
+        if (sscanf(line, "SIZE %d %d", &w, &h) != 2) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_indent(e, indent);
+        fprintf(e->out, "if (!command_size(f, %d, %d, %d)) return false;\n", w, h, line_num);
+    }
+    else if (strcmp(cmd, "LOAD") == 0) {
+        char fname[256];
+        if (sscanf(line, "LOAD %255s", fname) != 1) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_indent(e, indent);
+        fputs("if (!command_load(f, ", e->out);
+        emit_string(e->out, fname);
+        fprintf(e->out, ", %d)) return false;\n", line_num);
+    }
+    else if (strcmp(cmd, "GENERATE") == 0) {
+        GenParams p;
+        if (!generate_parse(line + strlen(cmd), &p)) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_indent(e, indent);
+        fprintf(e->out, "if (!command_generate(f, &(const GenParams){ %lluULL, %d, %d, %d, %d, %d }, opts->threads, %d)) return false;\n",
+                (unsigned long long)p.seed, p.pit, p.mound, p.tree, p.stone, p.color, line_num);
+    }
+    else if (strcmp(cmd, "START") == 0) {
+        int x, y;
+        if (sscanf(line, "START %d %d", &x, &y) != 2) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fprintf(e->out, "if (!command_start(f, %d, %d, %d)) return false;\n", x, y, line_num);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "JUMP") == 0) {
+        char dir[16];
+        int n;
+        if (sscanf(line, "JUMP %15s %d", dir, &n) != 2 || !is_direction(dir) || n <= 0) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fprintf(e->out, "if (!jump_dino(f, \"%s\", %d)) return false;\n", dir, n);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "PAINT") == 0) {
+        char c;
+        if (sscanf(line, "PAINT %c", &c) != 1 || c < 'a' || c > 'z') {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fprintf(e->out, "paint_cell(f, '%c');\n", c);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "PAINTRECT") == 0 || strcmp(cmd, "FILL") == 0) {
+        int x, y, w, h;
+        char c;
+        bool paint = strcmp(cmd, "PAINTRECT") == 0;
+        int parsed = sscanf(line + strlen(cmd), " %d %d %d %d %c", &x, &y, &w, &h, &c);
+        int obj = cell_object_from_symbol(c);
+        bool valid = parsed == 5 && w > 0 && h > 0 &&
+                     (paint ? c >= 'a' && c <= 'z' : obj == CELL_EMPTY || obj >= CELL_PIT);
+        if (!valid) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fprintf(e->out, "%s(f, %d, %d, %d, %d, '%c');\n", paint ? "paint_rect" : "fill_rect", x, y, w, h, c);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "PUSH") == 0) {
+        char dir[16];
+        char mode[16];
+        int parsed = sscanf(line, "PUSH %15s %15s", dir, mode);
+        if (parsed < 1 || !is_direction(dir) || (parsed == 2 && strcmp(mode, "SLIDE") != 0)) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fprintf(e->out, "%s(f, \"%s\");\n", parsed == 2 ? "push_stone_slide" : "push_stone", dir);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "SAVE") == 0) {
+        char fname[256];
+        if (sscanf(line, "SAVE %255s", fname) != 1) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fputs("snapshot_save(f, ", e->out);
+        emit_string(e->out, fname);
+        fputs(", opts->field_format);\n", e->out);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "UNDO") == 0) {
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fputs("command_undo(f, hist);\n", e->out);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "EXEC") == 0) {
+        char fname[256];
+        if (sscanf(line, "EXEC %255s", fname) != 1) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        FILE* fp = fopen(fname, "r");
+        if (!fp) {
+            // Файла нет сейчас — пусть интерпретатор попробует открыть его при запуске
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        fclose(fp);
+
+        // Каждый файл транслируется в свою функцию один раз, EXEC — это её вызов
+        int id = emitter_file(e, fname);
+        emit_begin(e, cmd, line_num, indent);
+        emit_indent(e, indent);
+        fprintf(e->out, "{ ExecUnit unit; if (!exec_unit_begin(f, hist, opts, %d, &unit)) return false; "
+                        "bool done = script_file_%d(f, hist, opts, fid); exec_unit_end(f, hist, &unit, done); "
+                        "if (!done) return false; }\n", line_num, id);
+        emit_show(e, indent);
+    }
+    else if (strcmp(cmd, "IF") == 0) {
+        const char* rest = strchr(line, ' ');
+        Predicate pred;
+        int then_offset;
+        if (!rest || !parse_if(rest + 1, &pred, &then_offset)) {
+            emit_fallback(e, line, line_num, indent);
+            return;
+        }
+        emit_begin(e, cmd, line_num, indent);
+        // Условие с символом длиннее одного знака никогда не выполняется
+        if (pred.expected) {
+            emit_indent(e, indent);
+            fprintf(e->out, "if (predicate_holds(f, &(const Predicate){ %s, %d, %d, %d, %d, %d, %d, %d })) {\n",
+                    pred.relative ? "true" : "false", pred.x, pred.y, pred.expected, pred.w, pred.h, pred.count,
+                    pred.total);
+            emit_command(e, rest + 1 + then_offset, line_num, indent + 1);
+            emit_indent(e, indent);
+            fputs("}\n", e->out);
+        }
+        emit_show(e, indent);
+    }
+    else {
+        // Незнакомая команда (в том числе IF... без пробела) — ошибку выведет интерпретатор
+        emit_fallback(e, line, line_num, indent);
+    }
+}
+
+/**
+ * Начинает очередную функцию-часть файла id.
+ */
+static void emit_part_open(Emitter* e, int id, int part) {
+    fprintf(e->out, "static bool script_file_%d_part_%d(Field* f, History* hist, const Options* opts, const int* fid) {\n"
+                    "    (void)hist; (void)opts; (void)fid;\n", id, part);
+}
+
+/**
+ * Транслирует файл номер id в функцию script_file_<id>.
+ * Длинные файлы делятся на части по EMIT_LINES_PER_FUNCTION строк:
+ * компилятору намного проще с несколькими небольшими функциями, чем с одной огромной.
+ */
+/**
+ * true, если строка — переход (WHILE, END, LABEL, GOTO или IF ... THEN GOTO).
+ */
+static bool line_has_jump(const char* line) {
+    char cmd[32];
+    if (sscanf(line, "%31s", cmd) != 1) return false;
+    if (strcmp(cmd, "WHILE") == 0 || strcmp(cmd, "END") == 0 ||
+        strcmp(cmd, "LABEL") == 0 || strcmp(cmd, "GOTO") == 0) {
+        return true;
+    }
+    const char* rest = strchr(line, ' ');
+    Predicate pred;
+    int then_offset;
+    return strncmp(cmd, "IF", 2) == 0 && rest && parse_if(rest + 1, &pred, &then_offset) &&
+           strncmp(rest + 1 + then_offset, "GOTO", 4) == 0;
+}
+
+/**
+ * true, если в файле есть переходы. Такой файл целиком выполняет интерпретатор:
+ * переходы могут пересекать границы функций-частей.
+ */
+static bool file_has_jumps(const char* filename) {
+    FILE* fp = fopen(filename, "r");
+    if (!fp) return false;
+    char buffer[4096];
+    int line_num = 0;
+    bool found = false;
+    while (!found && read_script_line(fp, buffer, sizeof(buffer), &line_num) > 0) {
+        found = line_has_jump(buffer);
+    }
+    fclose(fp);
+    return found;
+}
+
+static void emit_file(Emitter* e, int id) {
+    const char* filename = e->files[id];
+
+    if (file_has_jumps(filename)) {
+        fprintf(e->out, "static bool script_file_%d(Field* f, History* hist, const Options* opts, const int* fid) {\n"
+                        "    (void)fid;\n"
+                        "    return parse_and_execute_file(", id);
+        emit_string(e->out, filename);
+        fputs(", f, hist, opts);\n}\n\n", e->out);
+        return;
+    }
+
+    FILE* fp = fopen(filename, "r");
+
+    char buffer[4096]; // Тот же размер буфера, что и в parse_and_execute_file
+    int line_num = 0;
+    int status = fp ? 1 : 0;
+    int parts = 1;
+    int lines_in_part = 0;
+
+    emit_part_open(e, id, 0);
+    while (fp && (status = read_script_line(fp, buffer, sizeof(buffer), &line_num)) > 0) {
+        if (lines_in_part == EMIT_LINES_PER_FUNCTION) {
+            fputs("    return true;\n}\n\n", e->out);
+            emit_part_open(e, id, parts++);
+            lines_in_part = 0;
+        }
+        lines_in_part++;
+
+        emit_indent(e, 1);
+        emit_comment(e->out, filename, line_num, buffer);
+        emit_indent(e, 1);
+        fprintf(e->out, "event_log_set_location(fid[%d], %d);\n", id, line_num);
+        emit_command(e, buffer, line_num, 1);
+    }
+    if (fp) fclose(fp);
+
+    if (status < 0) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "ОШИБКА (строка %d): Пробелы в начале строки запрещены\n", line_num);
+        fputs("    event_log_message(\"%s\", ", e->out);
+        emit_string(e->out, msg);
+        fputs(");\n    return false;\n}\n\n", e->out);
+    } else {
+        fputs("    return true;\n}\n\n", e->out);
+    }
+
+    // Сама функция файла вызывает части по порядку
+    fprintf(e->out, "static bool script_file_%d(Field* f, History* hist, const Options* opts, const int* fid) {\n"
+                    "    return ", id);
+    for (int k = 0; k < parts; k++) {
+        fprintf(e->out, "%sscript_file_%d_part_%d(f, hist, opts, fid)", k ? "\n        && " : "", id, k);
+    }
+    fputs(";\n}\n\n", e->out);
+}
+
+bool emit_c_program(const char* script, const char* out_path) {
+    FILE* fp = fopen(script, "r");
+    if (!fp) {
+        fprintf(stderr, "ОШИБКА: Невозможно открыть файл '%s'\n", script);
+        return false;
+    }
+    fclose(fp);
+
+    Emitter e = {0};
+    e.out = tmpfile();
+    if (!e.out) return false;
+
+    // Главный файл — номер 0, файлы из EXEC добавляются по ходу трансляции
+    emitter_file(&e, script);
+    for (int i = 0; i < e.file_count; i++) {
+        emit_file(&e, i);
+    }
+
+    FILE* out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "ОШИБКА: Невозможно записать файл '%s'\n", out_path);
+        fclose(e.out);
+        return false;
+    }
+
+    // Заголовок и список встроенных файлов
+    fputs("// Сгенерировано командой: dino --emit-c ", out);
+    emit_comment_text(out, script);
+    fputs("// Сборка: gcc -O2 -I<каталог dino> этот_файл.c <все .c файлы dino, кроме main.c>\n"
+          "// Запуск: ./программа output.txt [--interval N] [--no-display] [--no-save] ...\n"
+          "#include \"parser.h\"\n"
+          "#include \"eventlog.h\"\n"
+          "#include \"snapshot.h\"\n"
+          "#include <stdio.h>\n"
+          "#include <stdlib.h>\n\n", out);
+    fputs("static const char* const script_files[] = {\n", out);
+    for (int i = 0; i < e.file_count; i++) {
+        fputs("    ", out);
+        emit_string(out, e.files[i]);
+        fputs(",\n", out);
+    }
+    fprintf(out, "};\n#define SCRIPT_FILE_COUNT %d\n\n", e.file_count);
+    for (int i = 0; i < e.file_count; i++) {
+        fprintf(out, "static bool script_file_%d(Field* f, History* hist, const Options* opts, const int* fid);\n", i);
+    }
+    fputc('\n', out);
+
+    // Функции файлов
+    rewind(e.out);
+    char chunk[8192];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), e.out)) > 0) {
+        fwrite(chunk, 1, n, out);
+    }
+    fclose(e.out);
+
+    // main повторяет main.c, но вместо parse_and_execute_file вызывает script_file_0
+    fputs("int main(int argc, char* argv[]) {\n"
+          "    if (argc < 2) {\n"
+          "        fprintf(stderr, \"Usage: %s output.txt [--interval N] [--no-display] [--no-save] [--quiet] [--max-warnings N]\\n\", argv[0]);\n"
+          "        return 1;\n"
+          "    }\n"
+          "    Options opts;\n"
+          "    parse_options(argc - 2, argv + 2, &opts);\n"
+          "    opts.checkpoint_path = NULL; // Стек файлов есть только у интерпретатора\n"
+          "    // После файлов, выполненных интерпретатором, UNDO может идти из этого кода\n"
+          "    opts.undo_analysis = false;\n"
+          "    event_log_init(opts.quiet, opts.max_warnings);\n\n"
+          "    int fid[SCRIPT_FILE_COUNT];\n"
+          "    for (int i = 0; i < SCRIPT_FILE_COUNT; i++) fid[i] = event_log_file(script_files[i]);\n\n"
+          "    Field base_field = {0};\n"
+          "    History* history = create_history();\n"
+          "    bool ok = script_file_0(&base_field, history, &opts, fid);\n"
+          "    snapshot_finish();\n"
+          "    if (ok && opts.save) {\n"
+          "        save_field_as(&base_field, argv[1], opts.field_format);\n"
+          "    }\n\n"
+          "    free_field_cells(&base_field);\n"
+          "    free_history(history);\n"
+          "    event_log_finish();\n"
+          "    profiler_free(opts.profiler);\n"
+          "    shm_export_close(opts.shm);\n"
+          "    return ok ? 0 : 1;\n"
+          "}\n", out);
+
+    for (int i = 0; i < e.file_count; i++) free(e.files[i]);
+    free(e.files);
+
+    if (out != stdout) fclose(out);
+    return true;
+}
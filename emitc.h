@@ -0,0 +1,31 @@
+#ifndef EMITC_H
+#define EMITC_H
+
+#include <stdbool.h>
+
+/**
+ * Транслятор скрипта в программу на C (режим --emit-c).
+ *
+ * Каждая строка скрипта превращается в прямые вызовы функций из command.h
+ * и шагов выполнения из parser.h (command_begin, command_show и т.д.).
+ * Каждый файл (главный и все файлы из EXEC) транслируется один раз в свою
+ * функцию, EXEC становится прямым вызовом этой функции. Строки, которые нельзя
+ * разобрать заранее (ошибки формата, отсутствующие файлы), передаются
+ * в execute_command как есть, поэтому сообщения об ошибках и номера строк
+ * совпадают с интерпретатором.
+ *
+ * Полученный файл собирается вместе со всеми исходниками проекта, кроме main.c:
+ *   gcc -O2 -I. out.c $(ls *.c | grep -v '^main.c$') -o script
+ * и запускается как ./script output.txt [опции].
+ */
+
+// Сколько строк скрипта попадает в одну сгенерированную функцию
+#define EMIT_LINES_PER_FUNCTION 256
+
+/**
+ * Транслирует script в C и записывает результат в out_path (NULL — в stdout).
+ * Возвращает false, если скрипт или выходной файл не удалось открыть.
+ */
+bool emit_c_program(const char* script, const char* out_path);
+
+#endif
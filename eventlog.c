@@ -0,0 +1,217 @@
+#include "eventlog.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Одно событие в буфере — 12 байт вместо строки текста.
+ */
+typedef struct {
+    unsigned char code;
+    unsigned short file_id;
+    int line;
+    short x, y;
+} Event;
+
+/**
+ * Тексты событий. Совпадают с сообщениями, которые раньше печатались сразу.
+ */
+static const char* const event_text[EV_COUNT] = {
+    [EV_MOVE_BLOCKED]  = "ВНИМАНИЕ: Движение блокируется препятствием.\n",
+    [EV_JUMP_BLOCKED]  = "ВНИМАНИЕ: Прыжок блокируется немедленно.\n",
+    [EV_JUMP_STOPPED]  = "ВНИМАНИЕ: Прыжок остановлен перед препятствием.\n",
+    [EV_UNDO_EMPTY]    = "ВНИМАНИЕ (строка %d): Нечего отменять\n",
+    [EV_NO_TRANSACTION] = "ВНИМАНИЕ (строка %d): Нет открытой транзакции (BEGIN)\n",
+    [EV_REDO_EMPTY]    = "ВНИМАНИЕ (строка %d): Нечего повторять\n",
+    [EV_FELL_INTO_PIT] = "ОШИБКА: Динозавр свалился в яму!\n",
+    [EV_LANDED_IN_PIT] = "ОШИБКА: Динозавр приземлился в яму во время прыжка!\n",
+};
+
+// Краткие названия кодов для сводки
+static const char* const event_name[EV_COUNT] = {
+    [EV_MOVE_BLOCKED]  = "Движение блокируется препятствием",
+    [EV_JUMP_BLOCKED]  = "Прыжок блокируется немедленно",
+    [EV_JUMP_STOPPED]  = "Прыжок остановлен перед препятствием",
+    [EV_UNDO_EMPTY]    = "Нечего отменять",
+    [EV_NO_TRANSACTION] = "Нет открытой транзакции",
+    [EV_REDO_EMPTY]    = "Нечего повторять",
+    [EV_FELL_INTO_PIT] = "Динозавр свалился в яму",
+    [EV_LANDED_IN_PIT] = "Динозавр приземлился в яму",
+};
+
+// Ошибки идут после всех предупреждений в EventCode
+static bool is_warning(EventCode code) {
+    return code < EV_FELL_INTO_PIT;
+}
+
+/**
+ * Состояние журнала. Буфер выделен статически, поэтому запись события
+ * никогда не обращается к malloc.
+ */
+static struct {
+    Event events[EVENT_LOG_CAPACITY];
+    int count;                 // Сколько событий ждут вывода
+
+    bool quiet;
+    long max_warnings;         // < 0 — без ограничения
+    long warnings_shown;       // Сколько предупреждений попало в буфер для вывода
+
+    unsigned long long total[EV_COUNT];  // Все события по кодам (включая скрытые)
+    Event first[EV_COUNT];               // Первое место, где встретился код
+
+    char** files;              // Имена зарегистрированных файлов
+    int file_count;
+    int file_cap;
+    bool threaded;             // Журнал пишут несколько потоков (--world)
+} elog = { .max_warnings = -1 };
+
+// Текущее место выполнения: у каждого потока своё
+static _Thread_local int cur_file_id;
+static _Thread_local int cur_line;
+
+// Блокировка журнала; берётся только в многопоточном режиме
+static atomic_flag elog_busy = ATOMIC_FLAG_INIT;
+
+static void log_lock(void) {
+    if (!elog.threaded) return;
+    while (atomic_flag_test_and_set_explicit(&elog_busy, memory_order_acquire)) {
+    }
+}
+
+static void log_unlock(void) {
+    if (!elog.threaded) return;
+    atomic_flag_clear_explicit(&elog_busy, memory_order_release);
+}
+
+static void flush_locked(void);
+
+void event_log_init(bool quiet, long max_warnings) {
+    elog.quiet = quiet;
+    elog.max_warnings = max_warnings;
+}
+
+void event_log_set_threaded(bool threaded) {
+    elog.threaded = threaded;
+}
+
+static int register_file(const char* filename) {
+    for (int i = 0; i < elog.file_count; i++) {
+        if (strcmp(elog.files[i], filename) == 0) return i;
+    }
+    if (elog.file_count == elog.file_cap) {
+        int cap = elog.file_cap ? elog.file_cap * 2 : 8;
+        char** files = realloc(elog.files, cap * sizeof(char*));
+        if (!files) return 0;
+        elog.files = files;
+        elog.file_cap = cap;
+    }
+    char* name = malloc(strlen(filename) + 1);
+    if (!name) return 0;
+    strcpy(name, filename);
+    elog.files[elog.file_count] = name;
+    return elog.file_count++;
+}
+
+int event_log_file(const char* filename) {
+    log_lock();
+    int id = register_file(filename);
+    log_unlock();
+    return id;
+}
+
+void event_log_set_location(int file_id, int line) {
+    cur_file_id = file_id;
+    cur_line = line;
+}
+
+void event_log_emit(EventCode code, int x, int y) {
+    Event ev;
+    ev.code = (unsigned char)code;
+    ev.file_id = (unsigned short)cur_file_id;
+    ev.line = cur_line;
+    ev.x = (short)x;
+    ev.y = (short)y;
+
+    log_lock();
+    if (elog.total[code]++ == 0) elog.first[code] = ev;
+
+    // Скрытые предупреждения только считаются
+    if (is_warning(code)) {
+        if (elog.quiet || (elog.max_warnings >= 0 && elog.warnings_shown >= elog.max_warnings)) {
+            log_unlock();
+            return;
+        }
+        elog.warnings_shown++;
+    }
+
+    if (elog.count == EVENT_LOG_CAPACITY) flush_locked();
+    elog.events[elog.count++] = ev;
+    log_unlock();
+}
+
+void event_log_flush(void) {
+    log_lock();
+    flush_locked();
+    log_unlock();
+}
+
+static void flush_locked(void) {
+    if (elog.count == 0) return;
+
+    // Форматируем события в общий буфер и пишем его блоками через fwrite
+    char out[16384];
+    size_t used = 0;
+    for (int i = 0; i < elog.count; i++) {
+        const Event* ev = &elog.events[i];
+        if (sizeof(out) - used < 256) {
+            fwrite(out, 1, used, stderr);
+            used = 0;
+        }
+        int n = snprintf(out + used, sizeof(out) - used, event_text[ev->code], ev->line);
+        if (n > 0) used += (size_t)n;
+    }
+    fwrite(out, 1, used, stderr);
+    fflush(stderr);
+    elog.count = 0;
+}
+
+void event_log_message(const char* fmt, ...) {
+    log_lock();
+    flush_locked();
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    log_unlock();
+}
+
+void event_log_finish(void) {
+    event_log_flush();
+
+    // Сводка выводится только если пользователь ограничивал предупреждения
+    if (elog.quiet || elog.max_warnings >= 0) {
+        bool any = false;
+        for (int c = 0; c < EV_COUNT; c++) {
+            if (elog.total[c]) any = true;
+        }
+        if (any) {
+            fprintf(stderr, "Сводка событий:\n");
+            for (int c = 0; c < EV_COUNT; c++) {
+                if (!elog.total[c]) continue;
+                const Event* first = &elog.first[c];
+                fprintf(stderr, "  %s: %llu (впервые: %s:%d, клетка %d %d)\n",
+                        event_name[c], elog.total[c],
+                        first->file_id < elog.file_count ? elog.files[first->file_id] : "?",
+                        first->line, first->x, first->y);
+            }
+        }
+    }
+
+    for (int i = 0; i < elog.file_count; i++) free(elog.files[i]);
+    free(elog.files);
+    elog.files = NULL;
+    elog.file_count = elog.file_cap = 0;
+}
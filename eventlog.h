@@ -0,0 +1,72 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <stdbool.h>
+
+// Ёмкость кольцевого буфера событий (при заполнении буфер сбрасывается в stderr)
+#define EVENT_LOG_CAPACITY 65536
+
+/**
+ * Коды событий (предупреждений и ошибок команд).
+ * Текст сообщения для каждого кода формируется только при выводе.
+ */
+typedef enum {
+    EV_MOVE_BLOCKED,    // ВНИМАНИЕ: движение блокируется препятствием
+    EV_JUMP_BLOCKED,    // ВНИМАНИЕ: прыжок блокируется немедленно
+    EV_JUMP_STOPPED,    // ВНИМАНИЕ: прыжок остановлен перед препятствием
+    EV_UNDO_EMPTY,      // ВНИМАНИЕ: нечего отменять
+    EV_NO_TRANSACTION,  // ВНИМАНИЕ: COMMIT или ROLLBACK без BEGIN
+    EV_REDO_EMPTY,      // ВНИМАНИЕ: нечего повторять
+    EV_FELL_INTO_PIT,   // ОШИБКА: динозавр свалился в яму
+    EV_LANDED_IN_PIT,   // ОШИБКА: динозавр приземлился в яму
+    EV_COUNT
+} EventCode;
+
+/**
+ * Настраивает журнал событий.
+ * - quiet: не выводить предупреждения (ошибки выводятся всегда)
+ * - max_warnings: выводить не больше стольких предупреждений (< 0 — без ограничения)
+ * Если предупреждения ограничены, при завершении выводится сводка по кодам.
+ */
+void event_log_init(bool quiet, long max_warnings);
+
+/**
+ * Включает блокировку журнала, когда события пишут несколько потоков
+ * (совместное выполнение --world). Место выполнения у каждого потока своё.
+ */
+void event_log_set_threaded(bool threaded);
+
+/**
+ * Возвращает номер файла для имени filename (регистрирует его при первом вызове).
+ */
+int event_log_file(const char* filename);
+
+/**
+ * Запоминает текущее место выполнения (файл и строку) для следующих событий.
+ */
+void event_log_set_location(int file_id, int line);
+
+/**
+ * Записывает событие code с координатами (x, y) в кольцевой буфер.
+ * Не выполняет ввода-вывода, пока буфер не заполнится.
+ */
+void event_log_emit(EventCode code, int x, int y);
+
+/**
+ * Выводит в stderr произвольное сообщение (printf-формат),
+ * предварительно сбросив накопленные события, чтобы сохранить порядок вывода.
+ */
+void event_log_message(const char* fmt, ...);
+
+/**
+ * Форматирует накопленные события и записывает их в stderr одним блоком.
+ */
+void event_log_flush(void);
+
+/**
+ * Сбрасывает события и, если предупреждения ограничивались, выводит сводку.
+ * Вызывается один раз при завершении программы.
+ */
+void event_log_finish(void);
+
+#endif
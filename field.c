@@ -1,4 +1,5 @@
 #include "field.h"
+#include "journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +15,127 @@ int wrap(int coord, int size) {
     return coord;
 }
 
+/**
+ * Хеш FNV-1a по клеткам поля, затем по позиции динозавра.
+ */
+uint64_t field_hash(const Field* f) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    if (f->field_created) {
+        for (int y = 0; y < f->height; y++) {
+            for (int x = 0; x < f->width; x++) {
+                h = (h ^ f->grid[y][x]) * 0x100000001B3ULL;
+            }
+        }
+    }
+    int pos[2] = { f->dino_x, f->dino_y };
+    for (int i = 0; i < 2; i++) h = (h ^ (uint32_t)pos[i]) * 0x100000001B3ULL;
+    return h;
+}
+
+int field_count_symbol(const Field* f, char sym) {
+    if ((unsigned char)sym >= 128 || !f->grid) return 0;
+    if (!f->shared_cells) return f->stats.symbols[(unsigned char)sym];
+
+    // Общие клетки --world меняют и другие агенты — обход поля
+    int count = 0;
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) count += cell_display(f->grid[y][x]) == sym;
+    }
+    return count;
+}
+
+int field_count_color(const Field* f, char col) {
+    if (col < 'a' || col > 'z' || !f->grid) return 0;
+    int idx = col - 'a' + 1;
+    if (!f->shared_cells) return f->stats.colors[idx];
+
+    int count = 0;
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) count += (f->grid[y][x] & CELL_COLOR_MASK) == idx;
+    }
+    return count;
+}
+
+// Добавляет к счётчикам n клеток строки y со столбца x (sign = 1)
+// или убирает их (sign = -1), по 8 за раз
+static void stats_add_span(Field* f, int x, int y, int n, int sign) {
+    const Cell* p = f->grid[y] + x;
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        field_stats_add_word(f, v, x + i, y, sign);
+    }
+    for (; i < n; i++) field_stats_add(f, p[i], x + i, y, sign);
+}
+
+void field_forget_span(Field* f, int x, int y, int n) {
+    stats_add_span(f, x, y, n, -1);
+}
+
+void field_note_span(Field* f, int x, int y, int n) {
+    stats_add_span(f, x, y, n, 1);
+    for (int i = 0; i < n; i++) field_set_busy(f, x + i, y, cell_object(f->grid[y][x + i]) != CELL_EMPTY);
+}
+
+void field_set_busy_span(Field* f, int x, int y, int n, bool busy) {
+    for (int i = x; i < x + n;) {
+        int b = i & 63;
+        int k = x + n - i < 64 - b ? x + n - i : 64 - b;
+        uint64_t m = (k == 64 ? ~(uint64_t)0 : ((uint64_t)1 << k) - 1) << b;
+        if (busy) f->row_busy[y][i >> 6] |= m;
+        else f->row_busy[y][i >> 6] &= ~m;
+        i += k;
+    }
+    uint64_t ybit = (uint64_t)1 << (y & 63);
+    for (int i = x; i < x + n; i++) {
+        if (busy) f->col_busy[i][y >> 6] |= ybit;
+        else f->col_busy[i][y >> 6] &= ~ybit;
+    }
+}
+
+void field_recount(Field* f) {
+    memset(f->row_busy, 0, sizeof(f->row_busy));
+    memset(f->col_busy, 0, sizeof(f->col_busy));
+    memset(&f->stats, 0, sizeof(f->stats));
+    for (int y = 0; y < f->height; y++) field_note_span(f, 0, y, f->width);
+}
+
+int field_symbol_index(char sym) {
+    static const char objects[] = "_#%^&@";
+    if (sym >= 'a' && sym <= 'z') return 6 + (sym - 'a');
+    const char* p = sym ? strchr(objects, sym) : NULL;
+    return p ? (int)(p - objects) : -1;
+}
+
+/**
+ * Переводит символ объекта из файла/команды в код объекта клетки.
+ */
+int cell_object_from_symbol(char sym) {
+    switch (sym) {
+        case '_': return CELL_EMPTY;
+        case '#': return CELL_DINO;
+        case '%': return CELL_PIT;
+        case '^': return CELL_MOUND;
+        case '&': return CELL_TREE;
+        case '@': return CELL_STONE;
+        default:  return -1;
+    }
+}
+
+/**
+ * Заполняет таблицы соседей одного измерения: prev, same, next.
+ * Возвращает маску size - 1 для размера-степени двойки, иначе 0.
+ */
+static int init_steps(unsigned char* prev, unsigned char* same, unsigned char* next, int size) {
+    for (int i = 0; i < size; i++) {
+        prev[i] = (unsigned char)(i == 0 ? size - 1 : i - 1);
+        same[i] = (unsigned char)i;
+        next[i] = (unsigned char)(i == size - 1 ? 0 : i + 1);
+    }
+    return (size & (size - 1)) == 0 ? size - 1 : 0;
+}
+
 /**
  * Создаёт новое поле размером w × h.
  * Инициализирует все клетки как пустые ('_') без цвета.
@@ -28,6 +150,8 @@ Field* create_field(int w, int h) {
 
     f->width = w;
     f->height = h;
+    f->x_mask = init_steps(f->col_step[0], f->col_step[1], f->col_step[2], w);
+    f->y_mask = init_steps(f->row_step[0], f->row_step[1], f->row_step[2], h);
 
     // Выделяем память под массив строк (указателей на Cell)
     f->grid = calloc(h, sizeof(Cell*));
@@ -46,12 +170,12 @@ Field* create_field(int w, int h) {
             free(f);
             return NULL;
         }
-        // Инициализация клеток: пусто и без цвета
-        for (int j = 0; j < w; j++) {
-            f->grid[i][j].symbol = '_';
-            f->grid[i][j].color = 0;
-        }
+        // calloc обнуляет клетки: 0 — это CELL_EMPTY без цвета
     }
+    f->stats.symbols['_'] = w * h;
+    f->stats.colors[0] = w * h;
+    for (int y = 0; y < h; y++) f->stats.rows[y][0] = (uint8_t)w;
+    for (int x = 0; x < w; x++) f->stats.cols[x][0] = (uint8_t)h;
 
     f->field_created = true;
     return f;
@@ -62,13 +186,35 @@ Field* create_field(int w, int h) {
  */
 void free_field(Field* f) {
     if (!f) return;
-    if (f->grid) {
+    free_field_cells(f);
+    free(f);
+}
+
+/**
+ * Освобождает клетки поля. Строки во внешнем буфере не освобождаются.
+ */
+void free_field_cells(Field* f) {
+    if (!f->grid) return;
+    if (!f->shared_cells) {
         for (int i = 0; i < f->height; i++) {
             free(f->grid[i]);
         }
-        free(f->grid);
     }
-    free(f);
+    free(f->grid);
+    f->grid = NULL;
+}
+
+/**
+ * Копирует клетки во внешний буфер и направляет строки поля в него.
+ */
+void field_attach_cells(Field* f, Cell* cells) {
+    for (int y = 0; y < f->height; y++) {
+        Cell* row = cells + (size_t)y * f->width;
+        memcpy(row, f->grid[y], f->width * sizeof(Cell));
+        if (!f->shared_cells) free(f->grid[y]);
+        f->grid[y] = row;
+    }
+    f->shared_cells = true;
 }
 
 /**
@@ -78,12 +224,13 @@ Field* copy_field(const Field* src) {
     Field* dst = create_field(src->width, src->height);
     if (!dst) return NULL;
 
-    // Копируем содержимое каждой клетки
+    // Копируем содержимое каждой строки (клетка занимает один байт)
     for (int y = 0; y < src->height; y++) {
-        for (int x = 0; x < src->width; x++) {
-            dst->grid[y][x] = src->grid[y][x];
-        }
+        memcpy(dst->grid[y], src->grid[y], src->width * sizeof(Cell));
     }
+    memcpy(dst->row_busy, src->row_busy, sizeof(dst->row_busy));
+    memcpy(dst->col_busy, src->col_busy, sizeof(dst->col_busy));
+    dst->stats = src->stats;
 
     // Копируем позицию динозавра и флаги
     dst->dino_x = src->dino_x;
@@ -102,15 +249,12 @@ void place_dinosaur(Field* f, int x, int y) {
     if (!f || !f->field_created) return;
 
     // Приводим координаты к корректному диапазону
-    x = wrap(x, f->width);
-    y = wrap(y, f->height);
-
-    // Сохраняем цвет клетки
-    char old_color = f->grid[y][x].color;
+    x = field_wrap_x(f, x);
+    y = field_wrap_y(f, y);
 
-    // Ставим динозавра
-    f->grid[y][x].symbol = '#';
-    f->grid[y][x].color = old_color; 
+    // Ставим динозавра, цвет клетки сохраняется
+    journal_touch(f, x, y);
+    field_set_object(f, x, y, CELL_DINO);
 
     // Обновляем позицию
     f->dino_x = x;
@@ -128,20 +272,40 @@ void print_field(Field* f) {
 
     for (int y = 0; y < f->height; y++) {
         for (int x = 0; x < f->width; x++) {
-            char sym = f->grid[y][x].symbol;
-            if (sym == '_' && f->grid[y][x].color != 0) {
-                // Пустая клетка с цветом -> выводим цвет
-                putchar(f->grid[y][x].color);
-            } else {
-                // Иначе — выводим символ объекта
-                putchar(sym);
-            }
+            // Пустая клетка с цветом -> цвет, иначе — символ объекта
+            putchar(cell_display(f->grid[y][x]));
         }
         putchar('\n');
     }
     fflush(stdout); // Гарантируем немедленный вывод
 }
 
+bool field_parse_format(const char* name, FieldFormat* format) {
+    if (strcmp(name, "plain") == 0) *format = FIELD_FORMAT_PLAIN;
+    else if (strcmp(name, "rle") == 0) *format = FIELD_FORMAT_RLE;
+    else return false;
+    return true;
+}
+
+/**
+ * Кодирует строку поля сериями одинаковых символов в out и возвращает
+ * длину вместе с '\n'. Серия из n >= 2 клеток занимает не больше n символов,
+ * поэтому результат не длиннее обычной строки.
+ */
+static int encode_rle_row(const Cell* cells, int w, char* out) {
+    int len = 0;
+    for (int x = 0; x < w;) {
+        char c = cell_display(cells[x]);
+        int n = 1;
+        while (x + n < w && cell_display(cells[x + n]) == c) n++;
+        if (n > 1) len += sprintf(out + len, "%d", n);
+        out[len++] = c;
+        x += n;
+    }
+    out[len++] = '\n';
+    return len;
+}
+
 /**
  * Сохраняет поле в файл в формате:
  * width height
@@ -149,25 +313,28 @@ void print_field(Field* f) {
  * ...
  * строка_поля_height
  * DINO x y
+ * В формате RLE к первой строке добавляется "RLE", а строки поля
+ * кодируются сериями (encode_rle_row).
  */
-bool save_field_to_file(Field* f, const char* filename) {
+bool save_field_as(Field* f, const char* filename, FieldFormat format) {
     FILE* fp = fopen(filename, "w");
     if (!fp) return false;
 
     // Записываем размеры
-    fprintf(fp, "%d %d\n", f->width, f->height);
+    fprintf(fp, format == FIELD_FORMAT_RLE ? "%d %d RLE\n" : "%d %d\n", f->width, f->height);
 
-    // Записываем каждую строку поля
+    // Каждая строка поля собирается в буфере и записывается одним fwrite
+    char row[MAX_WIDTH + 1];
     for (int y = 0; y < f->height; y++) {
+        if (format == FIELD_FORMAT_RLE) {
+            fwrite(row, 1, encode_rle_row(f->grid[y], f->width, row), fp);
+            continue;
+        }
         for (int x = 0; x < f->width; x++) {
-            char sym = f->grid[y][x].symbol;
-            if (sym == '_' && f->grid[y][x].color != 0) {
-                fputc(f->grid[y][x].color, fp); // Цвет
-            } else {
-                fputc(sym, fp); // Символ объекта
-            }
+            row[x] = cell_display(f->grid[y][x]); // Цвет или символ объекта
         }
-        fputc('\n', fp);
+        row[f->width] = '\n';
+        fwrite(row, 1, f->width + 1, fp);
     }
 
     // Записываем позицию динозавра
@@ -175,4 +342,8 @@ bool save_field_to_file(Field* f, const char* filename) {
 
     fclose(fp);
     return true;
+}
+
+bool save_field_to_file(Field* f, const char* filename) {
+    return save_field_as(f, filename, FIELD_FORMAT_PLAIN);
 }
\ No newline at end of file
@@ -2,22 +2,134 @@
 #define FIELD_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 #define MAX_WIDTH 100
 #define MAX_HEIGHT 100
 #define MIN_WIDTH 10
 #define MIN_HEIGHT 10
 
+// Плитки 8 x 8 клеток: на них делится поле в версиях стека UNDO (history.c).
+// Номер плитки — (y / 8) * TILES_X + x / 8 для любого размера поля
+#define TILE_SHIFT 3
+#define TILE_SIZE  (1 << TILE_SHIFT)
+#define TILES_X    ((MAX_WIDTH + TILE_SIZE - 1) / TILE_SIZE)
+#define TILES_Y    ((MAX_HEIGHT + TILE_SIZE - 1) / TILE_SIZE)
+#define MAX_TILES  (TILES_X * TILES_Y)
+
+// Слов по 64 бита на строку или столбец в картах занятости поля
+#define LINE_WORDS (((MAX_WIDTH > MAX_HEIGHT ? MAX_WIDTH : MAX_HEIGHT) + 63) / 64)
+
+/**
+ * Клетка игрового поля упакована в один байт:
+ * - старшие 3 бита — код объекта (CELL_EMPTY ... CELL_STONE);
+ * - младшие 5 бит — цвет: 0 — клетка не окрашена, 1..26 — буквы 'a'..'z'.
+ * У ямы, горы, дерева и камня старший бит равен 1, поэтому проверка
+ * «клетка непроходима» — это одна проверка маски CELL_BLOCKED_MASK.
+ * Работать с клеткой нужно только через функции cell_* ниже.
+ */
+typedef unsigned char Cell;
+
+// Коды объектов в клетке
+#define CELL_EMPTY   0  // '_' — пусто (цвет, если есть, всё равно выводится)
+#define CELL_PAINTED 1  // Клетка, с которой ушёл динозавр: символ равен букве цвета
+#define CELL_DINO    2  // '#'
+#define CELL_PIT     4  // '%'
+#define CELL_MOUND   5  // '^'
+#define CELL_TREE    6  // '&'
+#define CELL_STONE   7  // '@'
+
+#define CELL_OBJECT_SHIFT 5
+#define CELL_COLOR_MASK   0x1F
+#define CELL_BLOCKED_MASK 0x80                               // Яма, гора, дерево, камень
+#define CELL_SOLID_MIN    (CELL_MOUND << CELL_OBJECT_SHIFT) // Гора, дерево, камень
+
+// Возвращает код объекта в клетке
+static inline int cell_object(Cell c) {
+    return c >> CELL_OBJECT_SHIFT;
+}
+
+// Возвращает букву цвета клетки или 0, если клетка не окрашена
+static inline char cell_color(Cell c) {
+    int idx = c & CELL_COLOR_MASK;
+    return idx ? (char)('a' + idx - 1) : 0;
+}
+
+// Возвращает символ объекта ('_', '#', '%', '^', '&', '@' или букву цвета)
+static inline char cell_symbol(Cell c) {
+    static const char symbols[8] = { '_', 0, '#', 0, '%', '^', '&', '@' };
+    int obj = cell_object(c);
+    return obj == CELL_PAINTED ? cell_color(c) : symbols[obj];
+}
+
+// Возвращает символ, который выводится на экран и в файл
+static inline char cell_display(Cell c) {
+    int obj = cell_object(c);
+    if (obj == CELL_EMPTY && (c & CELL_COLOR_MASK)) return cell_color(c);
+    return cell_symbol(c);
+}
+
+// Ставит в клетку объект, цвет не меняется
+static inline void cell_set_object(Cell* c, int obj) {
+    *c = (Cell)((obj << CELL_OBJECT_SHIFT) | (*c & CELL_COLOR_MASK));
+}
+
+// Окрашивает клетку буквой col ('a'-'z') или снимает цвет (col == 0)
+static inline void cell_set_color(Cell* c, char col) {
+    int idx = col ? col - 'a' + 1 : 0;
+    *c = (Cell)((*c & ~CELL_COLOR_MASK) | idx);
+}
+
+// Освобождает клетку от объекта: остаётся цвет (если был), иначе '_'
+static inline void cell_vacate(Cell* c) {
+    cell_set_object(c, (*c & CELL_COLOR_MASK) ? CELL_PAINTED : CELL_EMPTY);
+}
+
+// true, если в клетке яма, гора, дерево или камень
+static inline bool cell_is_blocked(Cell c) {
+    return (c & CELL_BLOCKED_MASK) != 0;
+}
+
+// true, если в клетке гора, дерево или камень (яма сюда не входит)
+static inline bool cell_is_solid(Cell c) {
+    return c >= CELL_SOLID_MIN;
+}
+
+// Переводит символ объекта в код. Возвращает -1 для неизвестного символа
+int cell_object_from_symbol(char sym);
+
+// Символов, которыми выводятся клетки: '_', '#', '%', '^', '&', '@' и 'a'-'z'
+#define FIELD_SYMBOLS 32
+
+// Номер символа, которым выводится клетка c (0..FIELD_SYMBOLS-1, как cell_display)
+static inline int cell_symbol_index(Cell c) {
+    static const unsigned char objects[8] = { 0, 0, 1, 0, 2, 3, 4, 5 };
+    int obj = cell_object(c);
+    int col = c & CELL_COLOR_MASK;
+    return obj <= CELL_PAINTED && col ? 5 + col : objects[obj];
+}
+
+// Номер символа sym для счётчиков строк и столбцов; -1 — клетки так не выводятся
+int field_symbol_index(char sym);
+
 /**
- * Структура Cell описывает одну клетку игрового поля.
- * - symbol: текущий символ в клетке ('_', '#', '%', '^', '&', '@' или буква цвета)
- * - color: если клетка была окрашена командой PAINT, здесь хранится буква 'a'-'z';
- *          иначе — 0 (нулевой символ).
+ * Счётчики клеток поля для условий COUNT.
+ * - symbols[c]: сколько клеток выводится символом c (как в CELL ... IS c)
+ * - colors[i]: сколько клеток цвета i (1..26 — 'a'..'z'), в том числе под объектами
+ * - rows[y][s], cols[x][s]: сколько клеток строки y (столбца x) выводится
+ *   символом с номером s (cell_symbol_index); по ним COUNT по прямоугольнику
+ *   во всю ширину или высоту поля не обходит клетки
+ * Ведутся при каждой записи клеток вместе с картами занятости
+ * (field_set_cell, field_forget_span и field_note_span), поэтому запрос
+ * по всему полю — O(1), по строке или столбцу — O(1) на строку или столбец.
  */
 typedef struct {
-    char symbol; 
-    char color;   
-} Cell;
+    int symbols[128];
+    int colors[CELL_COLOR_MASK + 1];
+    uint8_t rows[MAX_HEIGHT][FIELD_SYMBOLS];
+    uint8_t cols[MAX_WIDTH][FIELD_SYMBOLS];
+} FieldStats;
 
 /**
  * Структура Field описывает всё игровое поле.
@@ -26,6 +138,19 @@ typedef struct {
  * - dino_x, dino_y: текущие координаты динозавра
  * - field_created: флаг, создано ли поле командой SIZE
  * - dino_placed: флаг, поставлен ли динозавр командой START
+ * - shared_cells: строки лежат во внешнем буфере (field_attach_cells),
+ *   free_field их не освобождает
+ * - col_step, row_step: соседи на торе, заполняются в create_field.
+ *   col_step[dx + 1][x] — столбец x + dx для dx = -1, 0, 1 (row_step — для строк),
+ *   поэтому шаг к соседней клетке обходится без деления
+ * - x_mask, y_mask: размер - 1, если размер — степень двойки, иначе 0
+ * - dirty_tiles: плитки, изменённые после последнего снимка UNDO
+ *   (отмечаются field_mark_tile перед изменением клетки)
+ * - stats: счётчики клеток (field_count_symbol); для общих клеток --world
+ *   не годятся — те меняют и другие агенты
+ * - row_busy, col_busy: карты занятых клеток (объект не CELL_EMPTY):
+ *   бит x слова row_busy[y] и бит y слова col_busy[x]. Ведутся, как и stats,
+ *   по ним PUSH SLIDE находит препятствие без обхода клеток
  */
 typedef struct {
     int width;
@@ -34,14 +159,127 @@ typedef struct {
     int dino_x, dino_y;    
     bool field_created;    
     bool dino_placed;      
+    bool shared_cells;
+    int x_mask, y_mask;
+    unsigned char col_step[3][MAX_WIDTH];
+    unsigned char row_step[3][MAX_HEIGHT];
+    uint64_t dirty_tiles[(MAX_TILES + 63) / 64];
+    FieldStats stats;
+    uint64_t row_busy[MAX_HEIGHT][LINE_WORDS];
+    uint64_t col_busy[MAX_WIDTH][LINE_WORDS];
 } Field;
 
+// Отмечает в картах занятости, занята ли клетка (x, y)
+static inline void field_set_busy(Field* f, int x, int y, bool busy) {
+    uint64_t xbit = (uint64_t)1 << (x & 63);
+    uint64_t ybit = (uint64_t)1 << (y & 63);
+    if (busy) {
+        f->row_busy[y][x >> 6] |= xbit;
+        f->col_busy[x][y >> 6] |= ybit;
+    } else {
+        f->row_busy[y][x >> 6] &= ~xbit;
+        f->col_busy[x][y >> 6] &= ~ybit;
+    }
+}
+
+// Добавляет клетку c в (x, y) к счётчикам поля (sign = 1) или убирает её (sign = -1)
+static inline void field_stats_add(Field* f, Cell c, int x, int y, int sign) {
+    int s = cell_symbol_index(c);
+    f->stats.symbols[(unsigned char)cell_display(c)] += sign;
+    f->stats.colors[c & CELL_COLOR_MASK] += sign;
+    f->stats.rows[y][s] += sign;
+    f->stats.cols[x][s] += sign;
+}
+
+// Добавляет к счётчикам 8 клеток слова v с клетки (x, y) (sign = 1) или убирает
+// их (sign = -1). Слово из одинаковых клеток (обычное для областей) учитывается
+// сложением на всё слово, кроме счётчиков столбцов
+static inline void field_stats_add_word(Field* f, uint64_t v, int x, int y, int sign) {
+    Cell c = (Cell)v;
+    if (v == 0x0101010101010101ULL * c) {
+        int s = cell_symbol_index(c);
+        f->stats.symbols[(unsigned char)cell_display(c)] += 8 * sign;
+        f->stats.colors[c & CELL_COLOR_MASK] += 8 * sign;
+        f->stats.rows[y][s] += 8 * sign;
+        for (int i = 0; i < 8; i++) f->stats.cols[x + i][s] += sign;
+        return;
+    }
+    Cell cells[8];
+    memcpy(cells, &v, 8); // Порядок клеток как в памяти, при любом порядке байтов
+    for (int i = 0; i < 8; i++) field_stats_add(f, cells[i], x + i, y, sign);
+}
+
+// Отмечает в картах занятости n клеток строки y начиная со столбца x
+// (строка — масками слов, без обхода по клетке)
+void field_set_busy_span(Field* f, int x, int y, int n, bool busy);
+
+/**
+ * Записывает c в клетку (x, y). Команды меняют клетки только через
+ * field_set_cell и обёртки ниже (отрезки — между field_forget_span
+ * и field_note_span или сами, как PAINTRECT и FILL), иначе карты
+ * занятости и счётчики разойдутся с клетками.
+ * journal_touch вызывается перед этим, как и раньше.
+ */
+static inline void field_set_cell(Field* f, int x, int y, Cell c) {
+    field_stats_add(f, f->grid[y][x], x, y, -1);
+    field_stats_add(f, c, x, y, 1);
+    f->grid[y][x] = c;
+    field_set_busy(f, x, y, cell_object(c) != CELL_EMPTY);
+}
+
+// Ставит в клетку (x, y) объект obj, цвет не меняется (cell_set_object)
+static inline void field_set_object(Field* f, int x, int y, int obj) {
+    Cell c = f->grid[y][x];
+    cell_set_object(&c, obj);
+    field_set_cell(f, x, y, c);
+}
+
+// Окрашивает клетку (x, y) буквой col (cell_set_color)
+static inline void field_set_color(Field* f, int x, int y, char col) {
+    Cell c = f->grid[y][x];
+    cell_set_color(&c, col);
+    field_set_cell(f, x, y, c);
+}
+
+// Освобождает клетку (x, y) от объекта (cell_vacate)
+static inline void field_vacate(Field* f, int x, int y) {
+    Cell c = f->grid[y][x];
+    cell_vacate(&c);
+    field_set_cell(f, x, y, c);
+}
+
+// Убирает из счётчиков n клеток строки y начиная со столбца x
+// перед тем, как записать их напрямую (плитки UNDO)
+void field_forget_span(Field* f, int x, int y, int n);
+
+// Добавляет к счётчикам и картам занятости n клеток строки y
+// начиная со столбца x, записанных напрямую (после field_forget_span)
+void field_note_span(Field* f, int x, int y, int n);
+
+// Пересчитывает карты занятости и счётчики по всем клеткам поля
+// (после LOAD, GENERATE, чтения контрольной точки или записи)
+void field_recount(Field* f);
+
+// Отмечает плитку клетки (x, y) изменённой
+static inline void field_mark_tile(Field* f, int x, int y) {
+    int t = (y >> TILE_SHIFT) * TILES_X + (x >> TILE_SHIFT);
+    uint64_t bit = (uint64_t)1 << (t & 63);
+    f->dirty_tiles[t >> 6] |= bit;
+}
+
 // Создаёт новое поле заданного размера. Возвращает NULL при ошибке
 Field* create_field(int w, int h);
 
 // Освобождает всю память, выделенную под поле
 void free_field(Field* f);
 
+// Освобождает строки и массив строк поля (саму структуру — нет)
+void free_field_cells(Field* f);
+
+// Переносит клетки поля в буфер cells (width * height байт, по строкам).
+// После этого изменения поля сразу видны в буфере
+void field_attach_cells(Field* f, Cell* cells);
+
 // Создаёт полную копию поля
 Field* copy_field(const Field* src);
 
@@ -51,10 +289,61 @@ void place_dinosaur(Field* f, int x, int y);
 // Выводит текущее состояние поля в консоль
 void print_field(Field* f);
 
-// Сохраняет поле в файл
+/**
+ * Формат файла поля. В обоих за размерами идут строки поля
+ * и строка "DINO x y"; LOAD определяет формат по заголовку,
+ * а записывается RLE только по опции --field-format rle.
+ */
+typedef enum {
+    FIELD_FORMAT_PLAIN,  // "W H", затем по строке из W символов на строку поля
+    FIELD_FORMAT_RLE     // "W H RLE", строка поля — серии "<число><символ>",
+                         // число 1 опускается: "37_@62_"
+} FieldFormat;
+
+// Разбирает имя формата ("plain" или "rle"). Возвращает false для неизвестного
+bool field_parse_format(const char* name, FieldFormat* format);
+
+// Сохраняет поле в файл в формате format
+bool save_field_as(Field* f, const char* filename, FieldFormat format);
+
+// Сохраняет поле в файл в обычном формате
 bool save_field_to_file(Field* f, const char* filename);
 
+// Число клеток поля, которые выводятся символом sym (условие COUNT sym IS n)
+int field_count_symbol(const Field* f, char sym);
+
+// Число клеток поля цвета col ('a'-'z'), в том числе под объектами
+// (условие COUNT COLOR col IS n)
+int field_count_color(const Field* f, char col);
+
+// Хеш клеток и позиции динозавра (FNV-1a): одинаковые поля дают одинаковый хеш
+uint64_t field_hash(const Field* f);
+
 // Приводит координату к корректному диапазону [0, size) с учётом тора
 int wrap(int coord, int size);
 
+// Столбец x + dx на торе, dx — -1, 0 или 1
+static inline int field_step_x(const Field* f, int x, int dx) {
+    return f->col_step[dx + 1][x];
+}
+
+// Строка y + dy на торе, dy — -1, 0 или 1
+static inline int field_step_y(const Field* f, int y, int dy) {
+    return f->row_step[dy + 1][y];
+}
+
+// wrap(x, width) без деления для координат внутри поля и для ширины-степени двойки
+static inline int field_wrap_x(const Field* f, int x) {
+    if ((unsigned)x < (unsigned)f->width) return x;
+    if (f->x_mask) return x & f->x_mask;
+    return wrap(x, f->width);
+}
+
+// wrap(y, height) без деления для координат внутри поля и для высоты-степени двойки
+static inline int field_wrap_y(const Field* f, int y) {
+    if ((unsigned)y < (unsigned)f->height) return y;
+    if (f->y_mask) return y & f->y_mask;
+    return wrap(y, f->height);
+}
+
 #endif
\ No newline at end of file
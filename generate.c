@@ -0,0 +1,208 @@
+#include "generate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define GEN_MAX_THREADS 64
+
+bool generate_parse(const char* text, GenParams* p) {
+    unsigned long long seed;
+    int d[5];
+    int n = sscanf(text, "%llu %d %d %d %d %d", &seed, &d[0], &d[1], &d[2], &d[3], &d[4]);
+    if (n != 2 && n != 5 && n != 6) return false;
+
+    p->seed = seed;
+    if (n == 2) {
+        // Общая доля делится поровну, остаток достаётся ямам
+        if (d[0] < 0 || d[0] > 100) return false;
+        p->pit = d[0] - 3 * (d[0] / 4);
+        p->mound = p->tree = p->stone = d[0] / 4;
+        p->color = 0;
+        return true;
+    }
+
+    p->pit = d[0];
+    p->mound = d[1];
+    p->tree = d[2];
+    p->stone = d[3];
+    p->color = n == 6 ? d[4] : 0;
+    for (int i = 0; i < n - 1; i++) {
+        if (d[i] < 0 || d[i] > 100) return false;
+    }
+    return p->pit + p->mound + p->tree + p->stone <= 100;
+}
+
+// Хеш-функция splitmix64: случайное число клетки с номером index
+static inline uint64_t gen_hash(uint64_t seed, uint64_t index) {
+    uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Перевод процентов в порог для 32-битного случайного числа
+static uint64_t gen_threshold(int percent) {
+    return ((uint64_t)percent << 32) / 100;
+}
+
+/**
+ * Пороги генерации: старшие 32 бита хеша выбирают объект (ступенчатые пороги
+ * накопленных долей), младшие — цвет пустой клетки.
+ */
+typedef struct {
+    uint64_t seed;
+    uint64_t limits[4];  // Накопленные пороги: яма, гора, дерево, камень
+    uint64_t color;      // Порог окраски
+} GenTable;
+
+static void gen_table(const GenParams* p, GenTable* t) {
+    t->seed = p->seed;
+    t->limits[0] = gen_threshold(p->pit);
+    t->limits[1] = gen_threshold(p->pit + p->mound);
+    t->limits[2] = gen_threshold(p->pit + p->mound + p->tree);
+    t->limits[3] = gen_threshold(p->pit + p->mound + p->tree + p->stone);
+    t->color = gen_threshold(p->color);
+}
+
+// Заполняет строки [y0, y1) поля. Номер клетки — y * width + x, от потока не зависит
+static void gen_rows(Field* f, const GenTable* t, int y0, int y1) {
+    // Число порогов, которые не превышает r, → объект клетки
+    static const Cell objects[5] = {
+        CELL_PIT << CELL_OBJECT_SHIFT, CELL_MOUND << CELL_OBJECT_SHIFT,
+        CELL_TREE << CELL_OBJECT_SHIFT, CELL_STONE << CELL_OBJECT_SHIFT,
+        CELL_EMPTY << CELL_OBJECT_SHIFT
+    };
+
+    for (int y = y0; y < y1; y++) {
+        Cell* row = f->grid[y];
+        uint64_t base = (uint64_t)y * f->width;
+        for (int x = 0; x < f->width; x++) {
+            uint64_t h = gen_hash(t->seed, base + x);
+            uint64_t r = h >> 32;
+            uint64_t c = h & 0xFFFFFFFFu;
+            int k = (r >= t->limits[0]) + (r >= t->limits[1]) + (r >= t->limits[2]) + (r >= t->limits[3]);
+            Cell cell = objects[k];
+            // Цвет 1..26 равномерно внутри порога; окрашиваются только пустые клетки
+            if (k == 4 && c < t->color) cell |= (Cell)(1 + c * 26 / t->color);
+            row[x] = cell;
+        }
+    }
+}
+
+#ifdef _WIN32
+
+// Без потоков POSIX поле заполняется в одном потоке
+void generate_field(Field* f, const GenParams* p, int threads) {
+    (void)threads;
+    GenTable t;
+    gen_table(p, &t);
+    gen_rows(f, &t, 0, f->height);
+}
+
+#else
+
+typedef struct {
+    Field* f;
+    const GenTable* t;
+    int y0, y1;
+} GenJob;
+
+static void* gen_thread(void* arg) {
+    GenJob* job = arg;
+    gen_rows(job->f, job->t, job->y0, job->y1);
+    return NULL;
+}
+
+void generate_field(Field* f, const GenParams* p, int threads) {
+    GenTable t;
+    gen_table(p, &t);
+
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > GEN_MAX_THREADS) threads = GEN_MAX_THREADS;
+    if (threads > f->height) threads = f->height;
+    if (threads <= 1) {
+        gen_rows(f, &t, 0, f->height);
+        return;
+    }
+
+    // Полосы строк поровну; первая полоса заполняется в текущем потоке
+    GenJob jobs[GEN_MAX_THREADS];
+    pthread_t ids[GEN_MAX_THREADS];
+    bool started[GEN_MAX_THREADS] = { false };
+    for (int i = 0; i < threads; i++) {
+        jobs[i] = (GenJob){ f, &t, f->height * i / threads, f->height * (i + 1) / threads };
+    }
+    for (int i = 1; i < threads; i++) {
+        started[i] = pthread_create(&ids[i], NULL, gen_thread, &jobs[i]) == 0;
+        // Поток не создан — его полоса заполняется здесь же
+        if (!started[i]) gen_thread(&jobs[i]);
+    }
+    gen_thread(&jobs[0]);
+    for (int i = 1; i < threads; i++) {
+        if (started[i]) pthread_join(ids[i], NULL);
+    }
+}
+
+#endif
+
+int generate_run(int argc, char* argv[]) {
+    // Параметры генератора — все аргументы до первой опции
+    int threads = 0;
+    int params_end = argc;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) continue;
+        if (params_end == argc) params_end = i;
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+    }
+
+    int w, h;
+    if (params_end < 4 || sscanf(argv[1], "%d", &w) != 1 || sscanf(argv[2], "%d", &h) != 1) {
+        fprintf(stderr, "Usage: --generate output.txt W H seed D|P M T S [C] [--threads N]\n");
+        return 1;
+    }
+
+    char text[256] = "";
+    for (int i = 3; i < params_end; i++) {
+        size_t len = strlen(text);
+        snprintf(text + len, sizeof(text) - len, "%s ", argv[i]);
+    }
+    GenParams p;
+    if (!generate_parse(text, &p)) {
+        fprintf(stderr, "ОШИБКА: Неверные параметры генерации '%s'\n", text);
+        return 1;
+    }
+
+    Field* f = create_field(w, h);
+    if (!f) {
+        fprintf(stderr, "ОШИБКА: Неправильный размер поля (должен быть от %dx%d до %dx%d)\n",
+                MIN_WIDTH, MIN_HEIGHT, MAX_WIDTH, MAX_HEIGHT);
+        return 1;
+    }
+    generate_field(f, &p, threads);
+
+    // Динозавр — в первую клетку без препятствия
+    int dx = 0, dy = 0;
+    bool found = false;
+    for (int y = 0; y < h && !found; y++) {
+        for (int x = 0; x < w && !found; x++) {
+            if (!cell_is_blocked(f->grid[y][x])) {
+                dx = x;
+                dy = y;
+                found = true;
+            }
+        }
+    }
+    place_dinosaur(f, dx, dy);
+
+    bool ok = save_field_to_file(f, argv[0]);
+    if (!ok) fprintf(stderr, "ОШИБКА: Невозможно записать файл '%s'\n", argv[0]);
+    free_field(f);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include "field.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Процедурное заполнение поля (команда GENERATE и режим --generate).
+ * Каждая клетка получает своё случайное число как хеш пары (seed, номер клетки)
+ * — генератор со счётчиком, без общего состояния. Поэтому строки можно
+ * заполнять в любом числе потоков и в любом порядке: одно и то же seed
+ * всегда даёт одно и то же поле.
+ * - seed: зерно генератора
+ * - pit, mound, tree, stone: доли ям, гор, деревьев и камней в процентах
+ *   (в сумме не больше 100)
+ * - color: доля окрашенных клеток среди пустых, в процентах
+ */
+typedef struct {
+    uint64_t seed;
+    int pit;
+    int mound;
+    int tree;
+    int stone;
+    int color;
+} GenParams;
+
+/**
+ * Разбирает параметры после слова GENERATE: "seed D" или "seed P M T S [C]".
+ * Одно число D — общая доля препятствий, поровну на ямы, горы, деревья и камни.
+ * Возвращает false при неверном формате или долях вне диапазона.
+ */
+bool generate_parse(const char* text, GenParams* p);
+
+/**
+ * Заполняет клетки созданного поля по параметрам p в threads потоках
+ * (0 — по числу процессоров). Прежнее содержимое клеток затирается.
+ */
+void generate_field(Field* f, const GenParams* p, int threads);
+
+/**
+ * Режим --generate: создаёт поле и записывает его в файл формата LOAD.
+ * Аргументы: output.txt W H seed D|P M T S [C] [--threads N].
+ * Динозавр ставится в первую свободную клетку (если её нет — в (0, 0)).
+ */
+int generate_run(int argc, char* argv[]);
+
+#endif
@@ -0,0 +1,145 @@
+#include "heatmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEATMAP_MAGIC   "DINOHEAT"
+#define HEATMAP_VERSION 1
+
+// Ячейка, в которую попадают прибавления выключенной карты
+static uint32_t heat_sink[1];
+
+HeatState heat_state = { heat_sink, 0 };
+
+// Имена счётчиков в именах файлов PGM и заголовке CSV
+static const char* const heat_names[HEAT_KINDS] = { "visits", "blocked", "dug", "filled" };
+
+bool heatmap_start(void) {
+    if (heatmap_enabled()) {
+        memset(heat_state.counts, 0, sizeof(uint32_t) * HEAT_KINDS * HEAT_CELLS);
+        return true;
+    }
+    uint32_t* counts = calloc((size_t)HEAT_KINDS * HEAT_CELLS, sizeof(uint32_t));
+    if (!counts) return false;
+    heat_state.counts = counts;
+    heat_state.mask = 0xFFFFFFFFu;
+    return true;
+}
+
+bool heatmap_enabled(void) {
+    return heat_state.mask != 0;
+}
+
+void heatmap_stop(void) {
+    if (!heatmap_enabled()) return;
+    free(heat_state.counts);
+    heat_state.counts = heat_sink;
+    heat_state.mask = 0;
+}
+
+bool heatmap_parse_format(const char* s, HeatmapFormat* format) {
+    if (strcmp(s, "pgm") == 0) *format = HEATMAP_PGM;
+    else if (strcmp(s, "csv") == 0) *format = HEATMAP_CSV;
+    else if (strcmp(s, "bin") == 0) *format = HEATMAP_BIN;
+    else return false;
+    return true;
+}
+
+static uint32_t heat_get(int kind, int x, int y) {
+    return heat_state.counts[kind * HEAT_CELLS + y * MAX_WIDTH + x];
+}
+
+/**
+ * Картинка P5 с 8-битной яркостью: 0 — событий не было,
+ * 255 — самая «горячая» клетка (линейная шкала).
+ * Настоящий максимум записан в комментарии заголовка.
+ */
+static bool write_pgm(const Field* f, const char* prefix, int kind) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s.%s.pgm", prefix, heat_names[kind]);
+    FILE* out = fopen(path, "wb");
+    if (!out) return false;
+
+    uint32_t max = 0;
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) {
+            if (heat_get(kind, x, y) > max) max = heat_get(kind, x, y);
+        }
+    }
+
+    fprintf(out, "P5\n# %s max %lu\n%d %d\n255\n", heat_names[kind], (unsigned long)max, f->width, f->height);
+    unsigned char row[MAX_WIDTH];
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) {
+            uint64_t v = heat_get(kind, x, y);
+            row[x] = (unsigned char)(max ? (v * 255 + max - 1) / max : 0);
+        }
+        fwrite(row, 1, (size_t)f->width, out);
+    }
+    return fclose(out) == 0;
+}
+
+static bool write_csv(const Field* f, const char* prefix) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s.csv", prefix);
+    FILE* out = fopen(path, "w");
+    if (!out) return false;
+
+    fprintf(out, "x,y");
+    for (int k = 0; k < HEAT_KINDS; k++) fprintf(out, ",%s", heat_names[k]);
+    fputc('\n', out);
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) {
+            fprintf(out, "%d,%d", x, y);
+            for (int k = 0; k < HEAT_KINDS; k++) fprintf(out, ",%lu", (unsigned long)heat_get(k, x, y));
+            fputc('\n', out);
+        }
+    }
+    return fclose(out) == 0;
+}
+
+static void write_u32(FILE* out, uint32_t v) {
+    unsigned char c[4];
+    for (int i = 0; i < 4; i++) c[i] = (unsigned char)(v >> (8 * i));
+    fwrite(c, 1, 4, out);
+}
+
+/**
+ * Формат .bin: "DINOHEAT", версия, ширина, высота, число счётчиков (u32),
+ * затем для каждого счётчика width * height значений u32 по строкам.
+ */
+static bool write_bin(const Field* f, const char* prefix) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s.bin", prefix);
+    FILE* out = fopen(path, "wb");
+    if (!out) return false;
+
+    fwrite(HEATMAP_MAGIC, 1, 8, out);
+    write_u32(out, HEATMAP_VERSION);
+    write_u32(out, (uint32_t)f->width);
+    write_u32(out, (uint32_t)f->height);
+    write_u32(out, HEAT_KINDS);
+    for (int k = 0; k < HEAT_KINDS; k++) {
+        for (int y = 0; y < f->height; y++) {
+            for (int x = 0; x < f->width; x++) write_u32(out, heat_get(k, x, y));
+        }
+    }
+    return fclose(out) == 0;
+}
+
+bool heatmap_write(const Field* f, const char* prefix, HeatmapFormat format) {
+    if (!heatmap_enabled() || !f->field_created) return true;
+
+    switch (format) {
+        case HEATMAP_CSV:
+            return write_csv(f, prefix);
+        case HEATMAP_BIN:
+            return write_bin(f, prefix);
+        case HEATMAP_PGM:
+        default:
+            for (int k = 0; k < HEAT_KINDS; k++) {
+                if (!write_pgm(f, prefix, k)) return false;
+            }
+            return true;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "field.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Тепловая карта поля (режим --heatmap): счётчики событий по клеткам.
+ * - HEAT_VISIT: динозавр пришёл в клетку (MOVE, приземление JUMP);
+ * - HEAT_BLOCKED: клетка остановила MOVE или JUMP;
+ * - HEAT_DUG: в клетке выкопана яма;
+ * - HEAT_FILLED: яма в клетке засыпана горой или камнем.
+ * Счётчики лежат в одном плоском массиве с шагом строки MAX_WIDTH,
+ * поэтому смена размера поля командой SIZE или LOAD их не портит.
+ * Команды обновляют счётчики без проверки «включено ли»: выключенная карта —
+ * это нулевая маска индекса, и все прибавления попадают в одну
+ * ячейку-заглушку (её значение никогда не читается). Карта одна
+ * на процесс и включается только для обычного запуска, не для --world.
+ */
+typedef enum {
+    HEAT_VISIT,
+    HEAT_BLOCKED,
+    HEAT_DUG,
+    HEAT_FILLED,
+    HEAT_KINDS
+} HeatKind;
+
+#define HEAT_CELLS (MAX_WIDTH * MAX_HEIGHT)
+
+// Формат файлов тепловой карты (--heatmap-format)
+typedef enum {
+    HEATMAP_PGM,  // <префикс>.<счётчик>.pgm — по картинке на каждый счётчик
+    HEATMAP_CSV,  // <префикс>.csv — строка "x,y,visits,blocked,dug,filled" на клетку
+    HEATMAP_BIN   // <префикс>.bin — заголовок и счётчики uint32 little-endian
+} HeatmapFormat;
+
+typedef struct {
+    uint32_t* counts; // HEAT_KINDS * HEAT_CELLS счётчиков или заглушка
+    uint32_t mask;    // 0xFFFFFFFF — карта включена, 0 — выключена
+} HeatState;
+
+extern HeatState heat_state;
+
+// Прибавляет n (0 или 1) к счётчику kind клетки (x, y)
+static inline void heat_add(HeatKind kind, int x, int y, unsigned n) {
+    heat_state.counts[((uint32_t)kind * HEAT_CELLS + (uint32_t)(y * MAX_WIDTH + x)) & heat_state.mask] += n;
+}
+
+/**
+ * Включает тепловую карту (счётчики обнуляются).
+ * Возвращает false при нехватке памяти — тогда карта остаётся выключенной.
+ */
+bool heatmap_start(void);
+
+// true, если тепловая карта включена
+bool heatmap_enabled(void);
+
+/**
+ * Записывает счётчики клеток поля f в файлы с префиксом prefix.
+ * Возвращает false, если файл не удалось открыть.
+ */
+bool heatmap_write(const Field* f, const char* prefix, HeatmapFormat format);
+
+// Разбирает имя формата ("pgm", "csv", "bin"). Возвращает false для неизвестного
+bool heatmap_parse_format(const char* s, HeatmapFormat* format);
+
+// Выключает карту и освобождает счётчики
+void heatmap_stop(void);
+
+#endif
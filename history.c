@@ -1,34 +1,232 @@
 #include "history.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/*
+ * Версии поля хранятся деревом плиток: корень → до 16 внутренних узлов →
+ * по 16 листьев, лист — клетки плитки 8 x 8 (плитка t лежит
+ * в root->kids[t / 16]->kids[t % 16]). Сохранение копирует только изменённые
+ * листья и путь к ним (копирование пути), остальные узлы общие с прежней
+ * версией. Изменённые плитки отмечаются в поле перед изменением клетки
+ * (journal_touch), поэтому снимок не сравнивает всё поле.
+ */
+#define TREE_FANOUT 16
+#define TILE_CELLS  (TILE_SIZE * TILE_SIZE)
+#define TREE_GROUPS ((MAX_TILES + TREE_FANOUT - 1) / TREE_FANOUT)
+
+// Уровни узлов для node_release
+#define LEVEL_ROOT 0
+#define LEVEL_MID  1
+#define LEVEL_LEAF 2
+
+struct TileNode {
+    int refs;
+    union {
+        TileNode* kids[TREE_FANOUT];
+        Cell cells[TILE_CELLS];
+    } u;
+};
+
+static TileNode* node_new(void) {
+    TileNode* n = calloc(1, sizeof(TileNode));
+    if (n) n->refs = 1;
+    return n;
+}
+
+static TileNode* node_retain(TileNode* n) {
+    if (n) n->refs++;
+    return n;
+}
+
+// Освобождает ссылку на узел уровня level; последний освобождает и детей
+static void node_release(TileNode* n, int level) {
+    if (!n || --n->refs > 0) return;
+    if (level != LEVEL_LEAF) {
+        for (int i = 0; i < TREE_FANOUT; i++) node_release(n->u.kids[i], level + 1);
+    }
+    free(n);
+}
+
+// Новый внутренний узел с теми же детьми, что у n (n == NULL — без детей)
+static TileNode* node_clone(const TileNode* n) {
+    TileNode* c = node_new();
+    if (c && n) {
+        for (int i = 0; i < TREE_FANOUT; i++) c->u.kids[i] = node_retain(n->u.kids[i]);
+    }
+    return c;
+}
+
+static TileNode* tree_leaf(const TileNode* root, int t) {
+    if (!root) return NULL;
+    const TileNode* mid = root->u.kids[t / TREE_FANOUT];
+    return mid ? mid->u.kids[t % TREE_FANOUT] : NULL;
+}
+
+// Плитка t лежит в поле f (у поля меньше максимума часть плиток не используется)
+static bool tile_in_field(const Field* f, int t) {
+    return ((t % TILES_X) << TILE_SHIFT) < f->width && ((t / TILES_X) << TILE_SHIFT) < f->height;
+}
+
+// Клетки плитки t поля f; клетки за краем поля — нули
+static void tile_load(const Field* f, int t, Cell* cells) {
+    int x0 = (t % TILES_X) << TILE_SHIFT;
+    int y0 = (t / TILES_X) << TILE_SHIFT;
+    int w = f->width - x0 < TILE_SIZE ? f->width - x0 : TILE_SIZE;
+    int h = f->height - y0 < TILE_SIZE ? f->height - y0 : TILE_SIZE;
+    memset(cells, 0, TILE_CELLS);
+    for (int y = 0; y < h; y++) memcpy(cells + y * TILE_SIZE, f->grid[y0 + y] + x0, w);
+}
+
+static void tile_store(Field* f, int t, const Cell* cells) {
+    int x0 = (t % TILES_X) << TILE_SHIFT;
+    int y0 = (t / TILES_X) << TILE_SHIFT;
+    int w = f->width - x0 < TILE_SIZE ? f->width - x0 : TILE_SIZE;
+    int h = f->height - y0 < TILE_SIZE ? f->height - y0 : TILE_SIZE;
+    for (int y = 0; y < h; y++) {
+        field_forget_span(f, x0, y0 + y, w);
+        memcpy(f->grid[y0 + y] + x0, cells + y * TILE_SIZE, w);
+        field_note_span(f, x0, y0 + y, w);
+    }
+}
+
+/**
+ * Версия клеток f на основе base. Перестраиваются плитки, отмеченные в dirty
+ * (dirty == NULL — все), и только если клетки действительно отличаются,
+ * остальные узлы общие с base. Возвращает корень (своя ссылка)
+ * или NULL при нехватке памяти.
+ */
+static TileNode* tree_update(TileNode* base, const Field* f, const uint64_t* dirty) {
+    if (!base) dirty = NULL; // Первая версия строится целиком
+    TileNode* root = NULL;   // Копия корня: создаётся при первом изменении
+    bool copied[TREE_GROUPS] = { false };
+    Cell cells[TILE_CELLS];
+
+    for (int t = 0; t < MAX_TILES; t++) {
+        if (dirty && !((dirty[t >> 6] >> (t & 63)) & 1)) continue;
+        if (!tile_in_field(f, t)) continue;
+
+        TileNode* old = tree_leaf(base, t);
+        tile_load(f, t, cells);
+        if (old && memcmp(old->u.cells, cells, TILE_CELLS) == 0) continue;
+
+        int g = t / TREE_FANOUT;
+        if (!root && !(root = node_clone(base))) return NULL;
+        if (!copied[g]) {
+            TileNode* mid = node_clone(root->u.kids[g]);
+            if (!mid) goto fail;
+            node_release(root->u.kids[g], LEVEL_MID);
+            root->u.kids[g] = mid;
+            copied[g] = true;
+        }
+        TileNode* leaf = node_new();
+        if (!leaf) goto fail;
+        memcpy(leaf->u.cells, cells, TILE_CELLS);
+        node_release(root->u.kids[g]->u.kids[t % TREE_FANOUT], LEVEL_LEAF);
+        root->u.kids[g]->u.kids[t % TREE_FANOUT] = leaf;
+    }
+    return root ? root : node_retain(base);
+
+fail:
+    node_release(root, LEVEL_ROOT);
+    return NULL;
+}
+
+/**
+ * Переводит клетки f из версии from в версию to: копируются только листья,
+ * которые у версий разные (общие поддеревья пропускаются целиком).
+ * from == NULL — копируются все плитки.
+ */
+static void tree_restore(Field* f, const TileNode* from, const TileNode* to) {
+    if (!to) return;
+    for (int g = 0; g < TREE_GROUPS; g++) {
+        if (from && from->u.kids[g] == to->u.kids[g]) continue;
+        for (int i = 0; i < TREE_FANOUT; i++) {
+            int t = g * TREE_FANOUT + i;
+            if (t >= MAX_TILES || !tile_in_field(f, t)) continue;
+            const TileNode* leaf = tree_leaf(to, t);
+            if (leaf && leaf != tree_leaf(from, t)) tile_store(f, t, leaf->u.cells);
+        }
+    }
+}
+
+/**
+ * Приводит версию base к полю f (после этого у f нет отмеченных плиток).
+ * Возвращает false при нехватке памяти — тогда base не меняется.
+ */
+static bool sync_field(History* h, Field* f) {
+    TileNode* root = tree_update(h->base, f, h->synced == f ? f->dirty_tiles : NULL);
+    if (!root) return false;
+    node_release(h->base, LEVEL_ROOT);
+    h->base = root;
+    h->synced = f;
+    memset(f->dirty_tiles, 0, sizeof(f->dirty_tiles));
+    return true;
+}
+
+// Версия поля f, с которым только что выполнен sync_field
+static Version current_version(const History* h, const Field* f) {
+    return (Version){ node_retain(h->base), f->dino_x, f->dino_y, f->dino_placed };
+}
+
+/**
+ * Переводит поле f в версию v. synced — поле только что приведено к base,
+ * тогда копируются только отличающиеся плитки, иначе все.
+ */
+static void restore_version(History* h, Field* f, const Version* v, bool synced) {
+    tree_restore(f, synced ? h->base : NULL, v->root);
+    TileNode* root = node_retain(v->root);
+    node_release(h->base, LEVEL_ROOT);
+    h->base = root;
+    h->synced = f;
+    memset(f->dirty_tiles, 0, sizeof(f->dirty_tiles));
+    f->dino_x = v->dino_x;
+    f->dino_y = v->dino_y;
+    f->dino_placed = v->dino_placed;
+}
+
+static void free_states(State* s) {
+    while (s) {
+        State* tmp = s;
+        s = tmp->next;
+        node_release(tmp->version.root, LEVEL_ROOT);
+        free(tmp);
+    }
+}
+
+// Новая команда: состояния, снятые UNDO, больше не повторить
+static void clear_redo(History* h) {
+    free_states(h->redo);
+    h->redo = NULL;
+}
 
 /**
  * Создаёт новую структуру History и инициализирует её как пустой стек.
  */
 History* create_history(void) {
-    History* h = malloc(sizeof(History));
-    if (!h) return NULL;
-    h->top = NULL;   // Стек пуст
-    h->count = 0;    // Нет сохранённых состояний
+    History* h = calloc(1, sizeof(History)); // Стек, REDO и ветки пусты
     return h;
 }
 
 /**
- * Добавляет копию текущего поля в стек истории.
+ * Добавляет версию текущего поля в стек истории.
  */
 void push_state(History* h, Field* f) {
-    // Защита от некорректных указателей и переполнения
-    if (!h || !f || h->count >= MAX_UNDO_DEPTH) return;
+    if (!h || !f) return;
+    clear_redo(h);
+    // Защита от переполнения
+    if (h->count >= MAX_UNDO_DEPTH) return;
 
     // Создаём новый узел стека
     State* s = malloc(sizeof(State));
     if (!s) return;
 
-    // Делаем копию поля (все клетки, позиция динозавра)
-    s->field = copy_field(f);
-    if (!s->field) {
+    // Версия поля: новые только изменённые плитки
+    if (!sync_field(h, f)) {
         free(s);
         return;
     }
+    s->version = current_version(h, f);
 
     // Добавляем новый узел на вершину стека
     s->next = h->top;
@@ -36,9 +234,61 @@ void push_state(History* h, Field* f) {
     h->count++;
 }
 
+/**
+ * Версия постороннего поля: плитки сравниваются с последней сохранённой версией.
+ */
+void push_field_copy(History* h, const Field* f) {
+    if (!h || !f) return;
+    clear_redo(h);
+    if (h->count >= MAX_UNDO_DEPTH) return;
+
+    State* s = malloc(sizeof(State));
+    if (!s) return;
+    TileNode* root = tree_update(h->top ? h->top->version.root : h->base, f, NULL);
+    if (!root) {
+        free(s);
+        return;
+    }
+    s->version = (Version){ root, f->dino_x, f->dino_y, f->dino_placed };
+    s->next = h->top;
+    h->top = s;
+    h->count++;
+}
+
+/**
+ * Версия постороннего поля на вершину стека REDO: плитки сравниваются
+ * с предыдущей вершиной REDO (или UNDO).
+ */
+bool push_redo_copy(History* h, const Field* f) {
+    if (!h || !f) return false;
+    State* r = malloc(sizeof(State));
+    if (!r) return false;
+    TileNode* near = h->redo ? h->redo->version.root : h->top ? h->top->version.root : h->base;
+    TileNode* root = tree_update(near, f, NULL);
+    if (!root) {
+        free(r);
+        return false;
+    }
+    r->version = (Version){ root, f->dino_x, f->dino_y, f->dino_placed };
+    r->next = h->redo;
+    h->redo = r;
+    return true;
+}
+
+/**
+ * Учитывает состояние без копии поля: счётчик растёт как при push_state.
+ */
+void skip_state(History* h) {
+    if (!h) return;
+    clear_redo(h);
+    if (h->count >= MAX_UNDO_DEPTH) return;
+    h->count++;
+    h->skipped++;
+}
+
 /**
  * Восстанавливает предыдущее состояние поля
- * Удаляет верхний элемент стека и копирует его данные в current.
+ * Удаляет верхний элемент стека и переводит current в его версию.
  */
 bool pop_state(History* h, Field* current) {
     // Проверка: стек не пуст и аргументы корректны
@@ -48,41 +298,156 @@ bool pop_state(History* h, Field* current) {
     State* old = h->top;
     h->top = old->next; // Сдвигаем вершину вниз
 
-    // Получаем сохранённое поле
-    Field* saved = old->field;
-
-    // Освобождаем память текущего поля (кроме самой структуры current)
-    for (int i = 0; i < current->height; i++) {
-        free(current->grid[i]);
+    // Текущее состояние — в стек REDO (без памяти REDO просто не будет)
+    bool synced = sync_field(h, current);
+    State* r = synced ? malloc(sizeof(State)) : NULL;
+    if (r) {
+        r->version = current_version(h, current);
+        r->next = h->redo;
+        h->redo = r;
     }
-    free(current->grid);
 
-    // Копируем все данные из сохранённого поля в current
-    *current = *saved; // Копирование структуры (включая width, height, флаги)
-
-    // Освобождаем саму структуру saved
-    free(saved);
+    // Клетки переписываются в строках текущего поля, а не подменяются строки:
+    // размеры поля после SIZE/LOAD не меняются, а строки могут лежать
+    // во внешнем буфере (field_attach_cells)
+    restore_version(h, current, &old->version, synced);
 
     // Уменьшаем счётчик и освобождаем узел стека
+    node_release(old->version.root, LEVEL_ROOT);
     h->count--;
     free(old);
     return true;
 }
 
 /**
- * Освобождает всю память, выделенную под стек истории.
- * Проходит по всем узлам и удаляет их вместе с полями.
+ * Возвращает состояние из стека REDO, текущее уходит в стек UNDO.
  */
-void free_history(History* h) {
-    if (!h) return;
+bool redo_state(History* h, Field* current) {
+    if (!h || !h->redo || !current) return false;
+
+    State* r = h->redo;
+    h->redo = r->next;
+
+    bool synced = sync_field(h, current);
+    State* s = synced && h->count < MAX_UNDO_DEPTH ? malloc(sizeof(State)) : NULL;
+    if (s) {
+        s->version = current_version(h, current);
+        s->next = h->top;
+        h->top = s;
+        h->count++;
+    }
+    restore_version(h, current, &r->version, synced);
+
+    node_release(r->version.root, LEVEL_ROOT);
+    free(r);
+    return true;
+}
+
+static Branch* find_branch(const History* h, const char* name) {
+    for (Branch* b = h->branches; b; b = b->next) {
+        if (strcmp(b->name, name) == 0) return b;
+    }
+    return NULL;
+}
+
+// Ветка name для новой версии: прежняя версия освобождается, новой ветки — выделяется
+static Branch* branch_slot(History* h, const char* name) {
+    Branch* b = find_branch(h, name);
+    if (b) {
+        node_release(b->version.root, LEVEL_ROOT);
+        b->version.root = NULL;
+        return b;
+    }
+    b = malloc(sizeof(Branch));
+    if (!b) return NULL;
+    snprintf(b->name, sizeof(b->name), "%s", name);
+    b->version.root = NULL;
+    b->next = h->branches;
+    h->branches = b;
+    return b;
+}
 
-    // Удаляем все узлы стека по одному
-    while (h->top) {
+/**
+ * Запоминает версию текущего поля под именем name.
+ */
+bool branch_state(History* h, Field* current, const char* name) {
+    if (!h || !current || !sync_field(h, current)) return false;
+
+    Branch* b = branch_slot(h, name);
+    if (!b) return false;
+    b->version = current_version(h, current);
+    return true;
+}
+
+/**
+ * Версия постороннего поля под именем name: плитки сравниваются
+ * с последней сохранённой версией.
+ */
+bool branch_field_copy(History* h, const Field* f, const char* name) {
+    if (!h || !f) return false;
+    TileNode* root = tree_update(h->top ? h->top->version.root : h->base, f, NULL);
+    if (!root) return false;
+    Branch* b = branch_slot(h, name);
+    if (!b) {
+        node_release(root, LEVEL_ROOT);
+        return false;
+    }
+    b->version = (Version){ root, f->dino_x, f->dino_y, f->dino_placed };
+    return true;
+}
+
+/**
+ * Переводит поле в версию ветки name; сама ветка не меняется.
+ */
+bool checkout_state(History* h, Field* current, const char* name) {
+    if (!h || !current) return false;
+    Branch* b = find_branch(h, name);
+    if (!b) return false;
+    restore_version(h, current, &b->version, sync_field(h, current));
+    return true;
+}
+
+/**
+ * Снимает со стека сохранённые версии сверх прежних, пропущенные состояния
+ * просто вычитаются из счётчиков.
+ */
+void drop_states(History* h, int count, int skipped) {
+    if (!h || h->count < count) return;
+
+    clear_redo(h);
+    int extra = (h->count - h->skipped) - (count - skipped);
+    while (extra-- > 0 && h->top) {
         State* tmp = h->top;
         h->top = tmp->next;
-        free_field(tmp->field); 
-        free(tmp);              
+        node_release(tmp->version.root, LEVEL_ROOT);
+        free(tmp);
     }
+    h->count = count;
+    h->skipped = skipped;
+}
+
+void version_to_field(const Version* v, Field* out) {
+    tree_restore(out, NULL, v->root);
+    out->dino_x = v->dino_x;
+    out->dino_y = v->dino_y;
+    out->dino_placed = v->dino_placed;
+}
 
+/**
+ * Освобождает всю память, выделенную под стек истории.
+ * Общие плитки освобождаются, когда уходит последняя версия с ними.
+ */
+void free_history(History* h) {
+    if (!h) return;
+
+    free_states(h->top);
+    free_states(h->redo);
+    while (h->branches) {
+        Branch* b = h->branches;
+        h->branches = b->next;
+        node_release(b->version.root, LEVEL_ROOT);
+        free(b);
+    }
+    node_release(h->base, LEVEL_ROOT);
     free(h);
-}
\ No newline at end of file
+}
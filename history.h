@@ -1,30 +1,71 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 
-#include "field.h"  
+#include "field.h"
 #include <stdbool.h>
 
 // Максимальное количество сохранённых состояний (защита от переполнения памяти)
 #define MAX_UNDO_DEPTH 1000
 
+// Максимальная длина имени ветки (BRANCH, CHECKOUT)
+#define BRANCH_NAME_MAX 64
+
+/**
+ * Узел дерева плиток: внутренний узел (ссылки на 16 узлов уровнем ниже)
+ * или лист — клетки одной плитки. Узлы не меняются после создания
+ * и делятся между версиями, refs — сколько ссылок на узел.
+ */
+typedef struct TileNode TileNode;
+
+/**
+ * Версия поля: дерево плиток и динозавр.
+ * Версии, сохранённые подряд, делят все плитки, кроме изменённых между ними,
+ * поэтому новая версия стоит изменённых плиток и пути к ним от корня.
+ */
+typedef struct {
+    TileNode* root;
+    int dino_x, dino_y;
+    bool dino_placed;
+} Version;
+
 /**
  * Структура State представляет одно сохранённое состояние поля.
- * - field: указатель на копию поля в тот момент
+ * - version: версия поля в тот момент
  * - next: указатель на предыдущее состояние (нижний элемент стека)
  */
 typedef struct State {
-    Field* field;          // Копия поля
+    Version version;       // Версия поля
     struct State* next;    // Следующий (более старый) элемент стека
 } State;
 
+// Именованная версия поля (BRANCH имя)
+typedef struct Branch {
+    char name[BRANCH_NAME_MAX];
+    Version version;
+    struct Branch* next;
+} Branch;
+
 /**
  * Структура History управляет стеком состояний.
  * - top: указатель на самое свежее сохранённое состояние (вершина стека)
- * - count: текущее количество сохранённых состояний
+ * - count: текущее количество состояний в стеке, включая пропущенные
+ * - skipped: сколько из них пропущено (skip_state): UNDO до них никогда
+ *   не доходит, поэтому копия поля не хранится, но место в стеке занято
+ *   так же, как при push_state
+ * - redo: состояния, снятые UNDO, для REDO (вершина — последнее снятое);
+ *   новое сохранение очищает этот стек
+ * - branches: ветки BRANCH
+ * - base, synced: поле synced совпадает с версией base везде,
+ *   кроме плиток, отмеченных в synced->dirty_tiles
  */
 typedef struct {
     State* top;    // Вершина стека (последнее сохранённое состояние)
     int count;     // Сколько состояний в стеке
+    int skipped;   // Сколько из них без копии поля
+    State* redo;
+    Branch* branches;
+    TileNode* base;
+    const Field* synced;
 } History;
 
 /**
@@ -34,21 +75,81 @@ typedef struct {
 History* create_history(void);
 
 /**
- * Сохраняет копию текущего состояния поля в стек.
+ * Сохраняет версию текущего поля f в стек.
  * Если стек полон, новое состояние не добавляется.
  */
 void push_state(History* h, Field* f);
 
+/**
+ * Сохраняет в стек версию поля f, которое не выполняет команды
+ * (поле до EXEC при --atomic-exec, состояния контрольной точки).
+ * Плитки, совпадающие с последней версией, общие с ней.
+ */
+void push_field_copy(History* h, const Field* f);
+
+/**
+ * Занимает место в стеке под состояние, которое никогда не будет
+ * восстановлено (см. анализ снимков в parser.c). Поле не копируется.
+ * Если стек полон, ничего не происходит — как и в push_state.
+ */
+void skip_state(History* h);
+
 /**
  * Восстанавливает предыдущее состояние поля из стека.
- * Удаляет верхний элемент стека и копирует его данные в current.
+ * Удаляет верхний элемент стека и копирует его данные в current,
+ * текущее состояние уходит в стек REDO.
  * Возвращает true при успехе, false если стек пуст.
  */
 bool pop_state(History* h, Field* current);
 
+/**
+ * REDO: возвращает состояние, снятое последней UNDO.
+ * Текущее состояние сохраняется в стек, как перед обычной командой.
+ * Возвращает false, если повторять нечего.
+ */
+bool redo_state(History* h, Field* current);
+
+/**
+ * BRANCH: запоминает текущее поле под именем name (прежняя ветка
+ * с тем же именем заменяется). Возвращает false при нехватке памяти.
+ */
+bool branch_state(History* h, Field* current, const char* name);
+
+/**
+ * CHECKOUT: переводит поле в версию ветки name.
+ * Возвращает false, если такой ветки нет.
+ */
+bool checkout_state(History* h, Field* current, const char* name);
+
+/**
+ * Убирает из стека состояния, сохранённые после того, как в нём было
+ * count состояний, из них skipped пропущенных (ROLLBACK, EXEC при --atomic-exec).
+ * Поле не восстанавливается, стек REDO очищается.
+ */
+void drop_states(History* h, int count, int skipped);
+
+/**
+ * Кладёт в стек REDO версию поля f, которое не выполняет команды
+ * (контрольные точки собирают стек REDO со дна). Стек UNDO не меняется.
+ * Возвращает false при нехватке памяти.
+ */
+bool push_redo_copy(History* h, const Field* f);
+
+/**
+ * BRANCH для поля f, которое не выполняет команды (ветки контрольной точки).
+ * Возвращает false при нехватке памяти.
+ */
+bool branch_field_copy(History* h, const Field* f, const char* name);
+
+/**
+ * Записывает клетки и динозавра версии v (состояния UNDO, REDO или ветки)
+ * в поле out того же размера (контрольные точки).
+ */
+void version_to_field(const Version* v, Field* out);
+
 /**
  * Полностью освобождает память, выделенную под стек истории.
  */
 void free_history(History* h);
 
-#endif
\ No newline at end of file
+#endif
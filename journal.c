@@ -0,0 +1,185 @@
+#include "journal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JOURNAL_CELLS (MAX_WIDTH * MAX_HEIGHT)
+
+/**
+ * Запись журнала: клетка y * MAX_WIDTH + x, её значение до изменения
+ * и метка клетки до записи (при ROLLBACK метка возвращается,
+ * при COMMIT по ней видно, была ли клетка уже в журнале внешней точки).
+ */
+typedef struct {
+    uint16_t idx;
+    Cell old;
+    uint32_t prev_stamp;
+} JournalEntry;
+
+/**
+ * Точка сохранения: начало её записей в журнале, номер (метка клеток),
+ * глубина стека UNDO и динозавр на момент BEGIN.
+ */
+typedef struct {
+    int mark;
+    uint32_t epoch;
+    int history_count, history_skipped;
+    int dino_x, dino_y;
+    bool dino_placed;
+    bool implicit;
+} Savepoint;
+
+_Thread_local int journal_depth = 0;
+
+static _Thread_local Savepoint* points = NULL;
+static _Thread_local int points_cap = 0;
+
+static _Thread_local JournalEntry* entries = NULL;
+static _Thread_local int entries_len = 0;
+static _Thread_local int entries_cap = 0;
+
+// stamp[idx] — номер точки сохранения, которая последней записала клетку
+static _Thread_local uint32_t* stamp = NULL;
+static _Thread_local uint32_t next_epoch = 1;
+
+void journal_record(const Field* f, int x, int y) {
+    int idx = y * MAX_WIDTH + x;
+    uint32_t epoch = points[journal_depth - 1].epoch;
+    if (stamp[idx] == epoch) return; // Клетка уже записана в этой точке
+
+    // Место зарезервировано в journal_begin, поэтому запись не теряется
+    entries[entries_len++] = (JournalEntry){ (uint16_t)idx, f->grid[y][x], stamp[idx] };
+    stamp[idx] = epoch;
+}
+
+void journal_touch_span(Field* f, int x, int y, int n) {
+    if (n <= 0) return;
+    for (int tx = x >> TILE_SHIFT; tx <= (x + n - 1) >> TILE_SHIFT; tx++) field_mark_tile(f, tx << TILE_SHIFT, y);
+    if (!journal_depth) return;
+    for (int i = 0; i < n; i++) journal_record(f, x + i, y);
+}
+
+void journal_touch_all(const Field* f) {
+    if (!journal_depth) return;
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) journal_record(f, x, y);
+    }
+}
+
+bool journal_begin(const Field* f, const History* h, bool implicit) {
+    if (!stamp) {
+        stamp = calloc(JOURNAL_CELLS, sizeof(uint32_t));
+        if (!stamp) return false;
+    }
+    if (journal_depth == points_cap) {
+        int cap = points_cap ? points_cap * 2 : 8;
+        Savepoint* grown = realloc(points, (size_t)cap * sizeof(Savepoint));
+        if (!grown) return false;
+        points = grown;
+        points_cap = cap;
+    }
+    // Точка записывает каждую клетку не больше одного раза (и после слияния
+    // вложенных точек тоже), поэтому JOURNAL_CELLS записей на точку хватает:
+    // journal_record память не выделяет и не может потерять запись
+    if (entries_cap < entries_len + JOURNAL_CELLS) {
+        int cap = entries_cap ? entries_cap : 1024;
+        while (cap < entries_len + JOURNAL_CELLS) cap *= 2;
+        JournalEntry* grown = realloc(entries, (size_t)cap * sizeof(JournalEntry));
+        if (!grown) return false;
+        entries = grown;
+        entries_cap = cap;
+    }
+    // Номера точек не повторяются; при переполнении счётчика (вне транзакций)
+    // старые метки стираются
+    if (next_epoch == UINT32_MAX && journal_depth == 0) {
+        memset(stamp, 0, JOURNAL_CELLS * sizeof(uint32_t));
+        next_epoch = 1;
+    }
+
+    points[journal_depth++] = (Savepoint){
+        entries_len, next_epoch++, h ? h->count : 0, h ? h->skipped : 0,
+        f->dino_x, f->dino_y, f->dino_placed, implicit
+    };
+    return true;
+}
+
+/**
+ * Закрывает последнюю точку, её записи переходят к внешней точке.
+ * Клетки, которые внешняя точка уже записала, выбрасываются:
+ * у внешней точки значение старше.
+ */
+static void merge_top(void) {
+    Savepoint* top = &points[--journal_depth];
+    if (journal_depth == 0) {
+        entries_len = 0;
+        return;
+    }
+
+    uint32_t outer = points[journal_depth - 1].epoch;
+    int kept = top->mark;
+    for (int i = top->mark; i < entries_len; i++) {
+        JournalEntry e = entries[i];
+        stamp[e.idx] = outer;
+        if (e.prev_stamp != outer) entries[kept++] = e;
+    }
+    entries_len = kept;
+}
+
+bool journal_commit(void) {
+    if (journal_depth == 0 || points[journal_depth - 1].implicit) return false;
+    merge_top();
+    return true;
+}
+
+// Возвращает записи точки sp в поле f в обратном порядке
+static void undo_entries(const Savepoint* sp, Field* f, bool restore_stamps) {
+    for (int i = entries_len - 1; i >= sp->mark; i--) {
+        const JournalEntry* e = &entries[i];
+        int x = e->idx % MAX_WIDTH, y = e->idx / MAX_WIDTH;
+        field_mark_tile(f, x, y);
+        field_set_cell(f, x, y, e->old);
+        if (restore_stamps) stamp[e->idx] = e->prev_stamp;
+    }
+    f->dino_x = sp->dino_x;
+    f->dino_y = sp->dino_y;
+    f->dino_placed = sp->dino_placed;
+}
+
+bool journal_rollback(Field* f, History* h) {
+    if (journal_depth == 0 || points[journal_depth - 1].implicit) return false;
+
+    const Savepoint* top = &points[--journal_depth];
+    undo_entries(top, f, true);
+    entries_len = top->mark;
+    drop_states(h, top->history_count, top->history_skipped);
+    return true;
+}
+
+bool journal_undo_allowed(const History* h) {
+    if (!h || journal_depth == 0) return true;
+    const Savepoint* top = &points[journal_depth - 1];
+    return h->count - h->skipped > top->history_count - top->history_skipped;
+}
+
+int journal_level(void) {
+    return journal_depth - 1;
+}
+
+void journal_close_to(int level, Field* copy) {
+    if (level < 0 || level >= journal_depth) return;
+    // Записи более поздних точек лежат в журнале после записей level,
+    // поэтому обратный проход от конца журнала возвращает состояние на BEGIN level
+    if (copy) undo_entries(&points[level], copy, false);
+    while (journal_depth > level) merge_top();
+}
+
+void journal_free(void) {
+    free(points);
+    free(entries);
+    free(stamp);
+    points = NULL;
+    entries = NULL;
+    stamp = NULL;
+    points_cap = entries_cap = entries_len = 0;
+    journal_depth = 0;
+    next_epoch = 1;
+}
@@ -0,0 +1,84 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "field.h"
+#include "history.h"
+#include <stdbool.h>
+
+/**
+ * Журнал изменений клеток: точки сохранения BEGIN / COMMIT / ROLLBACK
+ * и EXEC как одно действие для UNDO (--atomic-exec).
+ * Пока открыта хотя бы одна точка сохранения, команды перед изменением
+ * клетки вызывают journal_touch, и прежнее значение клетки попадает
+ * в журнал — один раз на точку сохранения, сколько бы команд её ни меняли.
+ * ROLLBACK возвращает записанные клетки в обратном порядке, поэтому
+ * стоит столько, сколько клеток изменено, а не сколько выполнено команд.
+ * Позиция динозавра запоминается в самой точке сохранения.
+ * Журнал свой у каждого потока.
+ * Те же вызовы отмечают изменённые плитки поля для снимков UNDO (history.c).
+ */
+
+// Открытых точек сохранения в текущем потоке
+extern _Thread_local int journal_depth;
+
+// Записывает прежнее значение клетки (x, y), если в этой точке сохранения её ещё нет.
+// Память под запись выделена заранее в journal_begin
+void journal_record(const Field* f, int x, int y);
+
+// Вызывается перед изменением клетки (x, y)
+static inline void journal_touch(Field* f, int x, int y) {
+    field_mark_tile(f, x, y);
+    if (journal_depth) journal_record(f, x, y);
+}
+
+// Вызывается перед изменением n клеток строки y, начиная со столбца x (без переноса)
+void journal_touch_span(Field* f, int x, int y, int n);
+
+// Вызывается перед тем, как стек UNDO заменит всё поле (UNDO, REDO, CHECKOUT
+// внутри транзакции); плитки отмечает сам стек
+void journal_touch_all(const Field* f);
+
+/**
+ * Открывает точку сохранения поля f. Запоминает глубину стека UNDO h,
+ * к которой вернёт ROLLBACK. implicit — точка EXEC (--atomic-exec):
+ * COMMIT и ROLLBACK из скрипта её не закрывают.
+ * Заранее выделяет место под записи всех клеток поля в этой точке.
+ * Возвращает false при нехватке памяти.
+ */
+bool journal_begin(const Field* f, const History* h, bool implicit);
+
+/**
+ * COMMIT: закрывает последнюю точку сохранения, изменения остаются.
+ * Возвращает false, если открытой BEGIN нет.
+ */
+bool journal_commit(void);
+
+/**
+ * ROLLBACK: возвращает поле f к последней точке сохранения и закрывает её.
+ * Состояния, сохранённые в h после BEGIN, убираются из стека.
+ * Возвращает false, если открытой BEGIN нет.
+ */
+bool journal_rollback(Field* f, History* h);
+
+/**
+ * Может ли UNDO снять состояние со стека h: внутри точки сохранения
+ * UNDO не уходит дальше её BEGIN.
+ */
+bool journal_undo_allowed(const History* h);
+
+/**
+ * Возвращает номер последней открытой точки сохранения (для journal_close_to).
+ */
+int journal_level(void);
+
+/**
+ * Закрывает точку сохранения level вместе со всеми более поздними,
+ * изменения поля остаются (EXEC при --atomic-exec). Если copy не NULL,
+ * копия текущего поля приводится к состоянию на BEGIN точки level.
+ */
+void journal_close_to(int level, Field* copy);
+
+// Закрывает все точки сохранения и освобождает память журнала
+void journal_free(void);
+
+#endif
@@ -2,53 +2,131 @@
 #include "history.h"
 #include "parser.h"
 #include "utils.h"
+#include "eventlog.h"
+#include "emitc.h"
+#include "shmexport.h"
+#include "world.h"
+#include "prefetch.h"
+#include "generate.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "heatmap.h"
+#include "trace.h"
+#include "journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /**
- * Разбирает аргументы командной строки после имён файлов.
- * Поддерживаемые опции:
- * --interval N   : задержка между кадрами (по умолчанию 1)
- * --no-display   : отключить визуализацию
- * --no-save      : не сохранять результат в файл
+ * Выводит счётчики клеток поля (--field-stats): символы, которые встречаются
+ * на поле, и цвета клеток, в том числе под объектами.
  */
-void parse_options(int argc, char* argv[], Options* opts) {
-    // Устанавливаем значения по умолчанию
-    opts->interval = 1;
-    opts->display = true;
-    opts->save = true;
-
-    // Проходим по аргументам
-    for (int i = 0; i < argc; i++) {
-        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
-            opts->interval = atoi(argv[++i]); // Берём следующий аргумент как число
-            if (opts->interval < 0) opts->interval = 0;
-        } else if (strcmp(argv[i], "--no-display") == 0) {
-            opts->display = false;
-        } else if (strcmp(argv[i], "--no-save") == 0) {
-            opts->save = false;
-        }
+static void print_field_stats(const Field* f) {
+    static const char symbols[] = "_#%^&@abcdefghijklmnopqrstuvwxyz";
+    fprintf(stderr, "Клетки поля:");
+    for (const char* c = symbols; *c; c++) {
+        int n = field_count_symbol(f, *c);
+        if (n) fprintf(stderr, " %c %d", *c, n);
+    }
+    fprintf(stderr, "\nЦвета клеток:");
+    for (char c = 'a'; c <= 'z'; c++) {
+        int n = field_count_color(f, c);
+        if (n) fprintf(stderr, " %c %d", c, n);
     }
+    fputc('\n', stderr);
 }
 
 /**
  * Точка входа в программу.
  * Формат запуска: ./movdino input.txt output.txt [опции]
+ * (input.txt — "-" или --stdin: команды читаются из stdin по мере поступления)
+ * или ./movdino --emit-c input.txt [output.c] — трансляция скрипта в C,
+ * или ./movdino --shm-watch NAME [--samples N] [--every-ms M] [--no-field] —
+ * просмотр состояния, которое публикует запуск с --shm NAME,
+ * или ./movdino --world output.txt setup.txt agent1.txt ... [--tile N] [--deterministic] —
+ * несколько динозавров на одном поле,
+ * или ./movdino --generate output.txt W H seed D|P M T S [C] [--threads N] —
+ * случайное поле в формате LOAD,
+ * или ./movdino --replay trace.bin [--seek K] [--play N] [--fps F] [--out field.txt] —
+ * просмотр записи, сделанной с --record.
  */
 int main(int argc, char* argv[]) {
+    // Режим трансляции: скрипт не выполняется, выводится программа на C
+    if (argc >= 3 && strcmp(argv[1], "--emit-c") == 0) {
+        return emit_c_program(argv[2], argc >= 4 ? argv[3] : NULL) ? 0 : 1;
+    }
+
+    // Совместное выполнение нескольких скриптов на одном поле
+    if (argc >= 3 && strcmp(argv[1], "--world") == 0) {
+        return world_run(argc - 2, argv + 2);
+    }
+
+    // Генерация поля в файл без выполнения скрипта
+    if (argc >= 3 && strcmp(argv[1], "--generate") == 0) {
+        return generate_run(argc - 2, argv + 2);
+    }
+
+    // Просмотр записи выполнения (--record)
+    if (argc >= 3 && strcmp(argv[1], "--replay") == 0) {
+        return trace_replay(argc - 2, argv + 2);
+    }
+
+    // Режим читателя разделяемой памяти
+    if (argc >= 3 && strcmp(argv[1], "--shm-watch") == 0) {
+        long samples = 0;
+        int every_ms = 500;
+        bool show_field = true;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+                samples = atol(argv[++i]);
+            } else if (strcmp(argv[i], "--every-ms") == 0 && i + 1 < argc) {
+                every_ms = atoi(argv[++i]);
+                if (every_ms < 0) every_ms = 0;
+            } else if (strcmp(argv[i], "--no-field") == 0) {
+                show_field = false;
+            }
+        }
+        return shm_watch(argv[2], samples, every_ms, show_field);
+    }
+
     // Проверка минимального количества аргументов
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s input.txt output.txt [--interval N] [--no-display] [--no-save]\n", argv[0]);
+        fprintf(stderr, "Usage: %s input.txt|- output.txt [--interval N] [--no-display] [--viewport WxH|auto] [--minimap] [--no-save] [--quiet] [--max-warnings N] [--prefetch] [--threads N] [--snapshot-every N] [--checkpoint FILE] [--every N] [--resume FILE] [--status] [--no-undo-analysis] [--no-peephole] [--peephole-report] [--atomic-exec] [--field-stats] [--field-format plain|rle] [--heatmap PREFIX] [--heatmap-format pgm|csv|bin] [--record FILE] [--keyframe-every N] [--profile] [--profile-out PREFIX] [--shm NAME]\n", argv[0]);
+        fprintf(stderr, "       %s --emit-c input.txt [output.c]\n", argv[0]);
+        fprintf(stderr, "       %s --world output.txt setup.txt agent.txt... [--tile N] [--deterministic] [опции]\n", argv[0]);
+        fprintf(stderr, "       %s --generate output.txt W H seed D|P M T S [C] [--threads N]\n", argv[0]);
+        fprintf(stderr, "       %s --replay trace.bin [--seek K] [--play N] [--fps F] [--no-display] [--viewport WxH|auto] [--out field.txt] [--info]\n", argv[0]);
+        fprintf(stderr, "       %s --shm-watch NAME [--samples N] [--every-ms M] [--no-field]\n", argv[0]);
         return 1;
     }
 
     const char* input_file = argv[1];
     const char* output_file = argv[2];
+    bool from_stdin = strcmp(input_file, "-") == 0 || strcmp(input_file, "--stdin") == 0;
 
     // Разбор опций
     Options opts;
     parse_options(argc - 3, argv + 3, &opts);
+    event_log_init(opts.quiet, opts.max_warnings);
+    // Промежуточные снимки пишутся в выходной файл: при сбое в нём остаётся последний.
+    // С --no-save выходной файл не трогается
+    if (opts.save) opts.snapshot_path = output_file;
+
+    // Строки stdin нельзя прочитать заново, поэтому продолжать с точки нельзя
+    if (from_stdin && (opts.checkpoint_path || opts.resume_path)) {
+        fprintf(stderr, "ВНИМАНИЕ: --checkpoint и --resume не поддерживаются при вводе из stdin\n");
+        opts.checkpoint_path = NULL;
+        opts.resume_path = NULL;
+    }
+
+    // Счётчики тепловой карты обновляются командами с первой строки
+    if (opts.heatmap_out && !heatmap_start()) {
+        fprintf(stderr, "ВНИМАНИЕ: Недостаточно памяти для тепловой карты\n");
+        opts.heatmap_out = NULL;
+    }
+
+    // Файлы EXEC и LOAD читаются в фоне, пока выполняется скрипт
+    if (opts.prefetch && !from_stdin) prefetch_start(input_file);
 
     // Создаём базовое поле (изначально не инициализировано)
     Field base_field = {0}; // Все поля = 0 / false
@@ -56,24 +134,89 @@ int main(int argc, char* argv[]) {
     // Создаём стек истории для UNDO
     History* history = create_history();
 
+    // Продолжение с контрольной точки: поле, история и стек файлов из файла
+    CheckpointFrame* resume_frames = NULL;
+    int resume_depth = 0;
+    if (opts.resume_path) {
+        long lines = 0;
+        if (!checkpoint_load(opts.resume_path, &base_field, history, &resume_frames, &resume_depth, &lines)) {
+            fprintf(stderr, "ОШИБКА: Невозможно прочитать контрольную точку '%s'\n", opts.resume_path);
+            checkpoint_free_frames(resume_frames, resume_depth);
+            free_field_cells(&base_field);
+            free_history(history);
+            return 1;
+        }
+        set_resume_point(resume_frames, resume_depth, lines);
+    }
+
+    // Запись выполнения: строка 0 — поле до первой строки (или из контрольной точки)
+    if (opts.record_path) {
+        opts.trace = trace_open(opts.record_path, opts.record_every, &base_field);
+        if (!opts.trace) fprintf(stderr, "ОШИБКА: Невозможно создать запись '%s'\n", opts.record_path);
+    }
+
     // Запускаем выполнение программы из файла
-    bool ok = parse_and_execute_file(input_file, &base_field, history, &opts);
+    bool ok = from_stdin ? parse_and_execute_stream(stdin, "stdin", &base_field, history, &opts)
+                         : parse_and_execute_file(input_file, &base_field, history, &opts);
+    // События выполнения выводятся раньше сообщений о записи результатов и --field-stats
+    event_log_flush();
+
+    // Дожидаемся фоновых снимков, чтобы они не перезаписали результат
+    snapshot_finish();
+    checkpoint_finish();
+    checkpoint_free_frames(resume_frames, resume_depth);
+    if (opts.trace && !trace_close(opts.trace)) {
+        fprintf(stderr, "ОШИБКА: Ошибка записи в файл '%s'\n", opts.record_path);
+    }
 
     // Сохраняем результат, если не запрещено
     if (ok && opts.save) {
-        save_field_to_file(&base_field, output_file);
+        save_field_as(&base_field, output_file, opts.field_format);
     }
 
-    // Освобождаем память, выделенную под поле
-    if (base_field.grid) {
-        for (int i = 0; i < base_field.height; i++) {
-            free(base_field.grid[i]);
+    // Тепловая карта пишется и после ошибки: она показывает, как до неё дошло
+    if (opts.heatmap_out) {
+        if (!heatmap_write(&base_field, opts.heatmap_out, opts.heatmap_format)) {
+            fprintf(stderr, "ОШИБКА: Невозможно записать тепловую карту '%s'\n", opts.heatmap_out);
         }
-        free(base_field.grid);
+        heatmap_stop();
     }
 
-    // Освобождаем историю
+    if (opts.field_stats) print_field_stats(&base_field);
+
+    // Освобождаем память, выделенную под поле
+    free_field_cells(&base_field);
+
+    // Освобождаем историю (BEGIN без COMMIT в конце скрипта — изменения остаются)
     free_history(history);
+    journal_free();
+    prefetch_finish();
+
+    // Выводим накопленные предупреждения и сводку
+    event_log_finish();
+
+    if (opts.peephole_report) {
+        PeepholeStats st = peephole_stats();
+        fprintf(stderr, "Оптимизатор: удалено команд: %ld (строк выполнено блоками: %ld, проверок клеток не прошло: %ld)\n",
+                st.removed, st.lines, st.fallbacks);
+    }
+
+    // Записываем отчёты профилировщика: <префикс>.txt и <префикс>.folded
+    if (opts.profiler) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s.txt", opts.profile_out);
+        if (!profiler_write_report(opts.profiler, path)) {
+            fprintf(stderr, "ОШИБКА: Невозможно записать отчёт профилировщика '%s'\n", path);
+        }
+        snprintf(path, sizeof(path), "%s.folded", opts.profile_out);
+        if (!profiler_write_folded(opts.profiler, path)) {
+            fprintf(stderr, "ОШИБКА: Невозможно записать отчёт профилировщика '%s'\n", path);
+        }
+        profiler_free(opts.profiler);
+    }
+
+    // Отмечаем завершение для читателей разделяемой памяти
+    shm_export_close(opts.shm);
 
     // Возвращаем код завершения: 0 — успех, 1 — ошибка
     return ok ? 0 : 1;
@@ -0,0 +1,148 @@
+#include "command.h"
+#include "profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Разбирает аргументы командной строки после имён файлов.
+ * Поддерживаемые опции:
+ * --interval N   : задержка между кадрами (по умолчанию 1)
+ * --no-display   : отключить визуализацию
+ * --viewport WxH : выводить только окно WxH вокруг динозавра ("auto" — по размеру терминала)
+ * --minimap      : выводить под окном уменьшенную карту поля
+ * --no-save      : не сохранять результат в файл
+ * --quiet        : не выводить предупреждения (в конце — сводка по кодам)
+ * --max-warnings N: выводить не больше N предупреждений (в конце — сводка)
+ * --profile      : профилировать строки скриптов (включая EXEC и IF)
+ * --profile-out P: префикс файлов отчёта профилировщика (по умолчанию "profile")
+ * --prefetch     : заранее читать файлы EXEC и LOAD в фоновом потоке
+ * --threads N    : число потоков для GENERATE (по умолчанию — по числу процессоров)
+ * --snapshot-every N: каждые N строк записывать поле в выходной файл (в фоне)
+ * --checkpoint F : сохранять состояние интерпретатора в файл F (каждые --every строк)
+ * --every N      : интервал контрольных точек в строках (по умолчанию 10000)
+ * --resume F     : продолжить выполнение с контрольной точки F
+ * --status       : при вводе из stdin выводить после каждой команды строку
+ *                  "STATUS строка OK|ERROR x y хеш"
+ * --no-undo-analysis: сохранять состояние для UNDO перед каждой командой,
+ *                  даже если UNDO до него никогда не дойдёт
+ * --no-peephole  : выполнять каждую строку MOVE и PAINT отдельно
+ * --peephole-report: вывести в конце, сколько команд сократил оптимизатор
+ * --atomic-exec  : EXEC целиком — одно действие для UNDO
+ * --field-stats  : вывести в конце, сколько на поле клеток каждого символа и цвета
+ * --field-format plain|rle: формат выходного файла, SAVE и снимков (по умолчанию plain)
+ * --heatmap P    : считать по клеткам посещения, остановки, выкопанные и засыпанные ямы
+ *                  и записать их в конце в файлы с префиксом P
+ * --heatmap-format pgm|csv|bin: формат тепловой карты (по умолчанию pgm)
+ * --record F     : записывать изменения поля после каждой строки в файл F (см. --replay)
+ * --keyframe-every N: полный кадр записи каждые N строк (по умолчанию 1000)
+ * --shm NAME     : публиковать состояние в разделяемой памяти NAME (см. --shm-watch)
+ */
+void parse_options(int argc, char* argv[], Options* opts) {
+    // Устанавливаем значения по умолчанию
+    opts->interval = 1;
+    opts->display = true;
+    opts->viewport = (Viewport){ .enabled = false, .width = MAX_WIDTH, .height = MAX_HEIGHT };
+    opts->save = true;
+    opts->quiet = false;
+    opts->max_warnings = -1;
+    opts->profile_out = "profile";
+    opts->profiler = NULL;
+    opts->shm = NULL;
+    opts->agent = NULL;
+    opts->prefetch = false;
+    opts->threads = 0;
+    opts->snapshot_every = 0;
+    opts->snapshot_path = NULL;
+    opts->checkpoint_path = NULL;
+    opts->checkpoint_every = 10000;
+    opts->resume_path = NULL;
+    opts->status = false;
+    opts->undo_analysis = true;
+    opts->peephole = true;
+    opts->peephole_report = false;
+    opts->atomic_exec = false;
+    opts->field_stats = false;
+    opts->field_format = FIELD_FORMAT_PLAIN;
+    opts->heatmap_out = NULL;
+    opts->heatmap_format = HEATMAP_PGM;
+    opts->record_path = NULL;
+    opts->record_every = 1000;
+    opts->trace = NULL;
+
+    // Проходим по аргументам
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            opts->interval = atoi(argv[++i]); // Берём следующий аргумент как число
+            if (opts->interval < 0) opts->interval = 0;
+        } else if (strcmp(argv[i], "--no-display") == 0) {
+            opts->display = false;
+        } else if (strcmp(argv[i], "--viewport") == 0 && i + 1 < argc) {
+            bool minimap = opts->viewport.minimap;
+            if (!viewport_parse(argv[++i], &opts->viewport)) {
+                fprintf(stderr, "ВНИМАНИЕ: Неверный формат --viewport '%s' (ожидается WxH или auto)\n", argv[i]);
+            }
+            opts->viewport.minimap = minimap;
+        } else if (strcmp(argv[i], "--minimap") == 0) {
+            // Без --viewport окно равно всему полю
+            opts->viewport.enabled = true;
+            opts->viewport.minimap = true;
+        } else if (strcmp(argv[i], "--no-save") == 0) {
+            opts->save = false;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            opts->quiet = true;
+        } else if (strcmp(argv[i], "--max-warnings") == 0 && i + 1 < argc) {
+            opts->max_warnings = atol(argv[++i]);
+            if (opts->max_warnings < 0) opts->max_warnings = 0;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            if (!opts->profiler) opts->profiler = profiler_create();
+        } else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc) {
+            opts->profile_out = argv[++i];
+        } else if (strcmp(argv[i], "--prefetch") == 0) {
+            opts->prefetch = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opts->threads = atoi(argv[++i]);
+            if (opts->threads < 0) opts->threads = 0;
+        } else if (strcmp(argv[i], "--snapshot-every") == 0 && i + 1 < argc) {
+            opts->snapshot_every = atol(argv[++i]);
+            if (opts->snapshot_every < 0) opts->snapshot_every = 0;
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            opts->checkpoint_path = argv[++i];
+        } else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc) {
+            opts->checkpoint_every = atol(argv[++i]);
+            if (opts->checkpoint_every < 1) opts->checkpoint_every = 1;
+        } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+            opts->resume_path = argv[++i];
+        } else if (strcmp(argv[i], "--status") == 0) {
+            opts->status = true;
+        } else if (strcmp(argv[i], "--no-undo-analysis") == 0) {
+            opts->undo_analysis = false;
+        } else if (strcmp(argv[i], "--no-peephole") == 0) {
+            opts->peephole = false;
+        } else if (strcmp(argv[i], "--peephole-report") == 0) {
+            opts->peephole_report = true;
+        } else if (strcmp(argv[i], "--atomic-exec") == 0) {
+            opts->atomic_exec = true;
+        } else if (strcmp(argv[i], "--field-stats") == 0) {
+            opts->field_stats = true;
+        } else if (strcmp(argv[i], "--field-format") == 0 && i + 1 < argc) {
+            if (!field_parse_format(argv[++i], &opts->field_format)) {
+                fprintf(stderr, "ВНИМАНИЕ: Неизвестный формат --field-format '%s' (ожидается plain или rle)\n", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            opts->heatmap_out = argv[++i];
+        } else if (strcmp(argv[i], "--heatmap-format") == 0 && i + 1 < argc) {
+            if (!heatmap_parse_format(argv[++i], &opts->heatmap_format)) {
+                fprintf(stderr, "ВНИМАНИЕ: Неизвестный формат --heatmap-format '%s' (ожидается pgm, csv или bin)\n", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            opts->record_path = argv[++i];
+        } else if (strcmp(argv[i], "--keyframe-every") == 0 && i + 1 < argc) {
+            opts->record_every = atol(argv[++i]);
+            if (opts->record_every < 1) opts->record_every = 1;
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            if (opts->shm) shm_export_close(opts->shm);
+            opts->shm = shm_export_create(argv[++i]);
+        }
+    }
+}
@@ -1,52 +1,453 @@
 #include "parser.h"
-#include "utils.h" 
+#include "utils.h"
+#include "eventlog.h"
+#include "prefetch.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
+/**
+ * Команда SIZE: создаёт поле w × h.
+ */
+bool command_size(Field* f, int w, int h, int line_num) {
+    // Нельзя вызывать SIZE дважды
+    if (f->field_created) {
+        event_log_message("ОШИБКА (строка %d): SIZE уже вызван\n", line_num);
+        return false;
+    }
+
+    // Создаём новое поле
+    Field* newf = create_field(w, h);
+    if (!newf) {
+        event_log_message("ОШИБКА (строка %d): Неправильный размер поля (должен быть от %dx%d до %dx%d)\n",
+                line_num, MIN_WIDTH, MIN_HEIGHT, MAX_WIDTH, MAX_HEIGHT);
+        return false;
+    }
+
+    // Копируем данные нового поля в существующую структуру
+    *f = *newf;
+    free(newf); // Указатель скопирован, саму структуру можно удалить
+    return true;
+}
+
+/**
+ * Таблица перевода символа файла поля в клетку, увеличенную на 1:
+ * 0 — символ недопустим. Строчная буква — цвет пустой клетки,
+ * остальные допустимые символы — объекты без цвета.
+ */
+static const unsigned char load_cell_table[256] = {
+    ['_'] = (CELL_EMPTY << CELL_OBJECT_SHIFT) + 1,
+    ['#'] = (CELL_DINO << CELL_OBJECT_SHIFT) + 1,
+    ['%'] = (CELL_PIT << CELL_OBJECT_SHIFT) + 1,
+    ['^'] = (CELL_MOUND << CELL_OBJECT_SHIFT) + 1,
+    ['&'] = (CELL_TREE << CELL_OBJECT_SHIFT) + 1,
+    ['@'] = (CELL_STONE << CELL_OBJECT_SHIFT) + 1,
+    ['a'] = 2,  ['b'] = 3,  ['c'] = 4,  ['d'] = 5,  ['e'] = 6,  ['f'] = 7,  ['g'] = 8,
+    ['h'] = 9,  ['i'] = 10, ['j'] = 11, ['k'] = 12, ['l'] = 13, ['m'] = 14, ['n'] = 15,
+    ['o'] = 16, ['p'] = 17, ['q'] = 18, ['r'] = 19, ['s'] = 20, ['t'] = 21, ['u'] = 22,
+    ['v'] = 23, ['w'] = 24, ['x'] = 25, ['y'] = 26, ['z'] = 27
+};
+
+/**
+ * Переводит строку файла поля в клетки. Цикл без ветвлений (таблица и
+ * накопление признака ошибки), поэтому компилятор может его векторизовать;
+ * недопустимый символ проверяется один раз на строку.
+ */
+static bool load_row(Cell* cells, const char* text, int w) {
+    unsigned char bad = 0;
+    for (int x = 0; x < w; x++) {
+        unsigned char t = load_cell_table[(unsigned char)text[x]];
+        bad |= (unsigned char)(t == 0);
+        cells[x] = (Cell)(t - 1);
+    }
+    return !bad;
+}
+
+/**
+ * Переводит строку файла поля в формате RLE (серии "<число><символ>",
+ * строка заканчивается '\n') сразу в клетки: серия — один memset,
+ * обычная строка поля не собирается. Серии должны покрыть ровно w клеток.
+ */
+static bool load_rle_row(Cell* cells, const char* text, int w) {
+    int x = 0;
+    while (*text != '\n') {
+        unsigned char t = load_cell_table[(unsigned char)*text];
+        if (t) {
+            // Одиночная клетка — без числа
+            if (x == w) return false;
+            cells[x++] = (Cell)(t - 1);
+            text++;
+            continue;
+        }
+        int n = 0;
+        while (*text >= '0' && *text <= '9' && n <= w) n = n * 10 + (*text++ - '0');
+        t = load_cell_table[(unsigned char)*text++];
+        if (t == 0 || n < 1 || n > w - x) return false;
+        memset(cells + x, t - 1, n);
+        x += n;
+    }
+    return x == w;
+}
+
+/**
+ * Команда LOAD: загружает готовое поле из файла fname.
+ */
+bool command_load(Field* f, const char* fname, int line_num) {
+    // LOAD должна быть первой командой
+    if (f->field_created || f->dino_placed) {
+        event_log_message("ОШИБКА (строка %d): LOAD должны быть первой командой\n", line_num);
+        return false;
+    }
+
+    // Открываем файл для загрузки
+    FILE* fp = prefetch_fopen(fname);
+    if (!fp) {
+        event_log_message("ОШИБКА (строка %d): Невозможно открыть LOAD файл '%s'\n", line_num, fname);
+        return false;
+    }
+
+    // Читаем размеры и формат: "W H" или "W H RLE"
+    int w, h;
+    char format[8] = "";
+    if (fscanf(fp, "%d %d%*[ \t]%7[A-Z]", &w, &h, format) < 2 || fscanf(fp, "\n") < 0 ||
+        (format[0] && strcmp(format, "RLE") != 0)) {
+        fclose(fp);
+        return false;
+    }
+    bool rle = format[0] != '\0';
+
+    // Создаём поле нужного размера
+    Field* loaded = create_field(w, h);
+    if (!loaded) {
+        fclose(fp);
+        return false;
+    }
+
+    // Читаем поле построчно: строка из w символов и '\n' — одним fread,
+    // строка RLE — до '\n' (обычно она намного короче w)
+    char row[4 * MAX_WIDTH + 2];
+    for (int y = 0; y < h; y++) {
+        bool ok = rle ? fgets(row, sizeof(row), fp) && strchr(row, '\n') && load_rle_row(loaded->grid[y], row, w)
+                      : fread(row, 1, w + 1, fp) == (size_t)(w + 1) && !memchr(row, '\n', w) && row[w] == '\n' &&
+                            load_row(loaded->grid[y], row, w);
+        if (!ok) {
+            free_field(loaded);
+            fclose(fp);
+            return false;
+        }
+    }
+    field_recount(loaded);
+
+    // Читаем позицию динозавра
+    char dino_cmd[16];
+    int dx, dy;
+    if (fscanf(fp, "%15s %d %d", dino_cmd, &dx, &dy) != 3 || strcmp(dino_cmd, "DINO") != 0) {
+        free_field(loaded);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    // Размещаем динозавра
+    place_dinosaur(loaded, dx, dy);
+
+    // Копируем загруженное поле в основное
+    *f = *loaded;
+    free(loaded);
+    return true;
+}
+
+/**
+ * Команда GENERATE: заполняет поле, созданное SIZE, препятствиями и цветами.
+ */
+bool command_generate(Field* f, const GenParams* p, int threads, int line_num) {
+    // Заполнять можно только новое поле, пока на нём нет динозавра
+    if (!f->field_created || f->dino_placed) {
+        event_log_message("ОШИБКА (строка %d): GENERATE допустима только после SIZE и до START\n", line_num);
+        return false;
+    }
+    generate_field(f, p, threads);
+    field_recount(f);
+    return true;
+}
+
+/**
+ * Нужен ли снимок перед командой текущей строки (см. анализ снимков UNDO ниже):
+ * SNAP_ALWAYS — нужен, SNAP_NEVER — после строки UNDO недостижим,
+ * m >= 0 — снимок не нужен, если в стеке есть место ещё на m + 1 состояний.
+ */
+#define SNAP_ALWAYS (-1)
+#define SNAP_NEVER  (-2)
+static _Thread_local int snapshot_margin = SNAP_ALWAYS;
+
+static bool snapshot_needed(const History* hist) {
+    if (snapshot_margin == SNAP_ALWAYS || !hist) return true;
+    return snapshot_margin != SNAP_NEVER && hist->count + 1 + snapshot_margin >= MAX_UNDO_DEPTH;
+}
+
+/**
+ * Проверки перед командой cmd: поле создано, динозавр поставлен (кроме START).
+ * Затем сохраняет состояние для UNDO.
+ */
+bool command_begin(Field* f, History* hist, const char* cmd, int line_num) {
+    // Все остальные команды требуют, чтобы поле было создано
+    if (!f->field_created) {
+        event_log_message("ОШИБКА (строка %d): Поле не создано (не хватает SIZE или LOAD)\n", line_num);
+        return false;
+    }
+
+    // Все команды, кроме START, требуют, чтобы динозавр был поставлен
+    if (!f->dino_placed && strcmp(cmd, "START") != 0) {
+        event_log_message("ОШИБКА (строка %d): Динозавр не размещён (не хватает START)\n", line_num);
+        return false;
+    }
+
+    // =============== Сохранение состояния для UNDO ===============
+    // Не сохраняем для UNDO, REDO, EXEC, IF, WHILE, SAVE, BRANCH и команд транзакций
+    // (чтобы не засорять стек)
+    if (strcmp(cmd, "UNDO") != 0 && strcmp(cmd, "REDO") != 0 && strcmp(cmd, "EXEC") != 0 &&
+        strncmp(cmd, "IF", 2) != 0 && strcmp(cmd, "WHILE") != 0 && strcmp(cmd, "SAVE") != 0 &&
+        strcmp(cmd, "BRANCH") != 0 && strcmp(cmd, "BEGIN") != 0 &&
+        strcmp(cmd, "COMMIT") != 0 && strcmp(cmd, "ROLLBACK") != 0) {
+        // Снимок, до которого UNDO не дойдёт, только занимает место в стеке
+        if (snapshot_needed(hist)) push_state(hist, f);
+        else skip_state(hist);
+    }
+    return true;
+}
+
+/**
+ * Команда START: ставит динозавра в (x, y).
+ */
+bool command_start(Field* f, int x, int y, int line_num) {
+    // Нельзя вызывать START дважды
+    if (f->dino_placed) {
+        event_log_message("ОШИБКА (строка %d): START уже вызван\n", line_num);
+        return false;
+    }
+
+    // Размещаем динозавра (координаты нормализуются внутри)
+    place_dinosaur(f, x, y);
+    return true;
+}
+
+/**
+ * Команда UNDO: восстанавливает предыдущее состояние.
+ * Если отменять нечего — только предупреждение.
+ * Внутри транзакции UNDO не уходит дальше BEGIN, а всё поле
+ * записывается в журнал (снимок заменяет клетки целиком).
+ */
+void command_undo(Field* f, History* hist) {
+    if (!hist || !hist->top || !journal_undo_allowed(hist)) {
+        event_log_emit(EV_UNDO_EMPTY, f->dino_x, f->dino_y);
+        return;
+    }
+    journal_touch_all(f);
+    pop_state(hist, f);
+}
+
+/**
+ * Команда REDO: возвращает состояние, снятое последней UNDO.
+ * Любая команда, которая сохраняет состояние, очищает стек REDO.
+ * Если повторять нечего — только предупреждение.
+ */
+void command_redo(Field* f, History* hist) {
+    if (!hist || !hist->redo) {
+        event_log_emit(EV_REDO_EMPTY, f->dino_x, f->dino_y);
+        return;
+    }
+    journal_touch_all(f);
+    redo_state(hist, f);
+}
+
+/**
+ * Команда BRANCH имя: запоминает текущее поле как ветку.
+ */
+bool command_branch(Field* f, History* hist, const char* name, int line_num) {
+    if (hist && !branch_state(hist, f, name)) {
+        event_log_message("ОШИБКА (строка %d): Недостаточно памяти для BRANCH\n", line_num);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Команда CHECKOUT имя: переводит поле в версию ветки (отменяется UNDO).
+ */
+bool command_checkout(Field* f, History* hist, const char* name, int line_num) {
+    journal_touch_all(f);
+    if (!checkout_state(hist, f, name)) {
+        event_log_message("ОШИБКА (строка %d): Ветка '%s' не найдена\n", line_num, name);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Команда BEGIN: открывает точку сохранения (транзакции вкладываются).
+ */
+bool command_transaction_begin(Field* f, History* hist, int line_num) {
+    if (!journal_begin(f, hist, false)) {
+        event_log_message("ОШИБКА (строка %d): Недостаточно памяти для BEGIN\n", line_num);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Команда COMMIT: закрывает последнюю BEGIN, изменения остаются.
+ * Без открытой BEGIN — только предупреждение.
+ */
+void command_commit(Field* f) {
+    if (!journal_commit()) event_log_emit(EV_NO_TRANSACTION, f->dino_x, f->dino_y);
+}
+
+/**
+ * Команда ROLLBACK: возвращает поле и стек UNDO к последней BEGIN.
+ * Без открытой BEGIN — только предупреждение.
+ */
+void command_rollback(Field* f, History* hist) {
+    if (!journal_rollback(f, hist)) event_log_emit(EV_NO_TRANSACTION, f->dino_x, f->dino_y);
+}
+
+bool exec_unit_begin(Field* f, History* hist, const Options* opts, int line_num, ExecUnit* u) {
+    u->level = -1;
+    if (!opts->atomic_exec || !hist) return true;
+    if (!journal_begin(f, hist, true)) {
+        event_log_message("ОШИБКА (строка %d): Недостаточно памяти для EXEC\n", line_num);
+        return false;
+    }
+    u->level = journal_level();
+    u->history_count = hist->count;
+    u->history_skipped = hist->skipped;
+    return true;
+}
+
+void exec_unit_end(Field* f, History* hist, const ExecUnit* u, bool ok) {
+    if (u->level < 0) return;
+    // При ошибке выполнение всё равно остановится: стек UNDO не трогаем
+    Field* before = ok ? copy_field(f) : NULL;
+    journal_close_to(u->level, before);
+    if (!before) return;
+    // Снимки строк файла заменяются одним — полем до EXEC
+    drop_states(hist, u->history_count, u->history_skipped);
+    push_field_copy(hist, before);
+    free_field(before);
+}
+
+/**
+ * Разбирает условие "CELL x y IS sym", "AHEAD DIR IS sym",
+ * "COUNT x y w h sym IS n", "COUNT sym IS n" или "COUNT COLOR c IS n" в начале text.
+ */
+bool parse_predicate(const char* text, Predicate* p, int* len) {
+    char sym[8];   // Символ для проверки (макс. 7 символов + '\0')
+    char dir[16];
+    int n = 0;
+
+    p->x = p->y = p->w = p->h = p->count = 0;
+    p->relative = false;
+    p->total = COUNT_NONE;
+    if (sscanf(text, "COUNT %d %d %d %d %7s IS %d%n", &p->x, &p->y, &p->w, &p->h, sym, &p->count, &n) == 6) {
+        // Число совпавших клеток: символ — один знак, размеры положительные
+        if (strlen(sym) != 1 || p->w <= 0 || p->h <= 0 || p->count < 0) return false;
+    } else if (sscanf(text, "COUNT COLOR %7s IS %d%n", sym, &p->count, &n) == 2) {
+        // Клетки цвета по всему полю: буква 'a'-'z'
+        if (strlen(sym) != 1 || sym[0] < 'a' || sym[0] > 'z' || p->count < 0) return false;
+        p->total = COUNT_COLOR;
+    } else if (sscanf(text, "COUNT %7s IS %d%n", sym, &p->count, &n) == 2) {
+        // Клетки символа по всему полю: символ объекта или буква цвета
+        if (strlen(sym) != 1 || (cell_object_from_symbol(sym[0]) < 0 && (sym[0] < 'a' || sym[0] > 'z')) ||
+            p->count < 0) {
+            return false;
+        }
+        p->total = COUNT_SYMBOL;
+    } else if (sscanf(text, "CELL %d %d IS %7s%n", &p->x, &p->y, sym, &n) == 3) {
+        p->relative = false;
+    } else if (sscanf(text, "AHEAD %15s IS %7s%n", dir, sym, &n) == 2 && is_direction(dir)) {
+        p->relative = true;
+        get_delta(dir, &p->x, &p->y);
+    } else {
+        return false;
+    }
+
+    // Символ длиннее одного знака ни с одной клеткой не совпадает
+    p->expected = strlen(sym) == 1 ? sym[0] : 0;
+    *len = n;
+    return true;
+}
+
+/**
+ * Проверка условия: совпадает ли содержимое клетки с ожидаемым символом.
+ * Цветная пустая клетка сравнивается по букве цвета (как при выводе).
+ */
+bool predicate_holds(const Field* f, const Predicate* p) {
+    // Счётчики поля: не зависит от размера поля (см. FieldStats)
+    if (p->total == COUNT_SYMBOL) return field_count_symbol(f, p->expected) == p->count;
+    if (p->total == COUNT_COLOR) return field_count_color(f, p->expected) == p->count;
+    if (p->w > 0) return count_rect(f, p->x, p->y, p->w, p->h, p->expected) == p->count;
+    // AHEAD — соседняя клетка (смещение -1, 0 или 1), CELL — любые координаты на торе
+    int x = p->relative ? field_step_x(f, f->dino_x, p->x) : field_wrap_x(f, p->x);
+    int y = p->relative ? field_step_y(f, f->dino_y, p->y) : field_wrap_y(f, p->y);
+    return p->expected != 0 && cell_display(f->grid[y][x]) == p->expected;
+}
+
+/**
+ * Разбирает "условие THEN команда". В *then_offset — начало команды в rest.
+ */
+bool parse_if(const char* rest, Predicate* p, int* then_offset) {
+    int n, m = -1;
+    if (!parse_predicate(rest, p, &n)) return false;
+    sscanf(rest + n, " THEN %n", &m);
+    if (m < 0 || rest[n + m] == '\0') return false;
+    *then_offset = n + m;
+    return true;
+}
+
+/**
+ * Визуализация после команды: выводит поле (или окно --viewport)
+ * и ждёт opts->interval секунд.
+ */
+void command_show(Field* f, const Options* opts) {
+    if (opts->display) {
+        event_log_flush();   // Предупреждения должны появиться до перерисовки
+        clear_screen();      // Очищаем консоль
+        if (opts->viewport.enabled) {
+            viewport_print(f, &opts->viewport); // Только окно вокруг динозавра
+        } else {
+            print_field(f);  // Выводим поле
+        }
+        delay_seconds(opts->interval); // Ждём заданное время
+    }
+}
+
 /**
  * Вспомогательная функция для обработки условной команды IF.
  * Формат: IF CELL x y IS символ THEN команда
+ *     или IF AHEAD DIR IS символ THEN команда (клетка рядом с динозавром)
+ *     или IF COUNT x y w h символ IS n THEN команда (ровно n таких клеток в прямоугольнике)
+ *     или IF COUNT символ IS n THEN команда (ровно n таких клеток на всём поле)
+ *     или IF COUNT COLOR буква IS n THEN команда (ровно n клеток этого цвета, в том числе под объектами)
  *
- * Проверяет клетку (x, y):
+ * Проверяет клетку:
  * - Если там объект или цвет совпадает с указанным — выполняет команду.
  * - Иначе — игнорирует.
  */
-static bool execute_if_command(Field* f, History* hist, const char* rest, int line_num, const Options* opts) {
-    int x, y;
-    char sym[8];          // Символ для проверки (макс. 7 символов + '\0')
-    char then_cmd[256];   // Команда после THEN (макс. 255 символов)
+static bool execute_if_command(Field* f, History* hist, char* rest, int line_num, const Options* opts) {
+    Predicate pred;
+    int then_offset;
 
-    // Разбираем строку: "CELL x y IS sym THEN команда"
-    if (sscanf(rest, "CELL %d %d IS %7s THEN %[^\n]", &x, &y, sym, then_cmd) != 4) {
-        fprintf(stderr, "ОШИБКА (строка %d): Неверный формат IF\n", line_num);
+    if (!parse_if(rest, &pred, &then_offset)) {
+        event_log_message("ОШИБКА (строка %d): Неверный формат IF\n", line_num);
         return false;
     }
 
-    // Нормализуем координаты (тор)
-    x = wrap(x, f->width);
-    y = wrap(y, f->height);
-
-    // Определяем, что реально находится в клетке:
-    // Если символ — '_', но есть цвет → используем цвет
-    char cell_sym = f->grid[y][x].symbol;
-    if (cell_sym == '_') {
-        cell_sym = f->grid[y][x].color ? f->grid[y][x].color : '_';
-    }
-
-    // Ожидаемый символ — первый символ из строки sym
-    char expected = sym[0];
-
-    // Проверяем совпадение:
-    // - либо точное совпадение символов,
-    // - либо оба — строчные буквы (цвета)
-    if (strlen(sym) == 1 && (
-        expected == cell_sym ||
-        (expected >= 'a' && expected <= 'z' && cell_sym == expected)
-    )) {
+    if (predicate_holds(f, &pred)) {
         // Условие выполнено — выполняем команду рекурсивно
-        return execute_command(f, hist, then_cmd, line_num, opts);
+        return execute_command(f, hist, rest + then_offset, line_num, opts);
     }
 
     // Условие не выполнено — ничего не делаем
@@ -62,7 +463,14 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
 
     // Извлекаем первое "слово" — название команды
     if (sscanf(line, "%31s", cmd) != 1) {
-        fprintf(stderr, "ОШИБКА (строка %d): Неверный формат команды\n", line_num);
+        event_log_message("ОШИБКА (строка %d): Неверный формат команды\n", line_num);
+        return false;
+    }
+
+    // Переходы работают только в строках файла (см. parse_and_execute_file)
+    if (strcmp(cmd, "WHILE") == 0 || strcmp(cmd, "END") == 0 ||
+        strcmp(cmd, "LABEL") == 0 || strcmp(cmd, "GOTO") == 0) {
+        event_log_message("ОШИБКА (строка %d): %s допустима только отдельной строкой скрипта\n", line_num, cmd);
         return false;
     }
 
@@ -72,155 +480,66 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
     if (strcmp(cmd, "SIZE") == 0) {
         // Нельзя вызывать SIZE дважды
         if (f->field_created) {
-            fprintf(stderr, "ОШИБКА (строка %d): SIZE уже вызван\n", line_num);
+            event_log_message("ОШИБКА (строка %d): SIZE уже вызван\n", line_num);
             return false;
         }
 
         int w, h;
         if (sscanf(line, "SIZE %d %d", &w, &h) != 2) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверный формат SIZE\n", line_num);
-            return false;
-        }
-
-        // Создаём новое поле
-        Field* newf = create_field(w, h);
-        if (!newf) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неправильный размер поля (должен быть от %dx%d до %dx%d)\n",
-                    line_num, MIN_WIDTH, MIN_HEIGHT, MAX_WIDTH, MAX_HEIGHT);
+            event_log_message("ОШИБКА (строка %d): Неверный формат SIZE\n", line_num);
             return false;
         }
-
-        // Копируем данные нового поля в существующую структуру
-        *f = *newf;
-        free(newf); // Указатель скопирован, саму структуру можно удалить
-        return true;
+        return command_size(f, w, h, line_num);
     }
 
     // Команда LOAD: загружает готовое поле из файла
     if (strcmp(cmd, "LOAD") == 0) {
         // LOAD должна быть первой командой
         if (f->field_created || f->dino_placed) {
-            fprintf(stderr, "ОШИБКА (строка %d): LOAD должны быть первой командой\n", line_num);
+            event_log_message("ОШИБКА (строка %d): LOAD должны быть первой командой\n", line_num);
             return false;
         }
 
         char fname[256];
         if (sscanf(line, "LOAD %255s", fname) != 1) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверный формат LOAD\n", line_num);
-            return false;
-        }
-
-        // Открываем файл для загрузки
-        FILE* fp = fopen(fname, "r");
-        if (!fp) {
-            fprintf(stderr, "ОШИБКА (строка %d): Невозможно открыть LOAD файл '%s'\n", line_num, fname);
-            return false;
-        }
-
-        // Читаем размеры
-        int w, h;
-        if (fscanf(fp, "%d %d\n", &w, &h) != 2) {
-            fclose(fp);
-            return false;
-        }
-
-        // Создаём поле нужного размера
-        Field* loaded = create_field(w, h);
-        if (!loaded) {
-            fclose(fp);
+            event_log_message("ОШИБКА (строка %d): Неверный формат LOAD\n", line_num);
             return false;
         }
+        return command_load(f, fname, line_num);
+    }
 
-        // Читаем само поле посимвольно
-        for (int y = 0; y < h; y++) {
-            for (int x = 0; x < w; x++) {
-                int c = fgetc(fp);
-                if (c == EOF || c == '\n') {
-                    free_field(loaded);
-                    fclose(fp);
-                    return false;
-                }
-
-                // Если символ — строчная буква, это цвет
-                if (c >= 'a' && c <= 'z') {
-                    loaded->grid[y][x].color = c;
-                    loaded->grid[y][x].symbol = '_';
-                } else {
-                    // Иначе — это объект или пустота
-                    loaded->grid[y][x].symbol = c;
-                    loaded->grid[y][x].color = 0;
-                }
-            }
-            // Проверяем, что строка завершается \n
-            if (fgetc(fp) != '\n') {
-                free_field(loaded);
-                fclose(fp);
-                return false;
-            }
-        }
-
-        // Читаем позицию динозавра
-        char dino_cmd[16];
-        int dx, dy;
-        if (fscanf(fp, "%15s %d %d", dino_cmd, &dx, &dy) != 3 || strcmp(dino_cmd, "DINO") != 0) {
-            free_field(loaded);
-            fclose(fp);
+    // Команда GENERATE: заполняет созданное SIZE поле (до START)
+    if (strcmp(cmd, "GENERATE") == 0) {
+        GenParams p;
+        if (!generate_parse(line + strlen(cmd), &p)) {
+            event_log_message("ОШИБКА (строка %d): Неверный формат GENERATE\n", line_num);
             return false;
         }
-        fclose(fp);
-
-        // Размещаем динозавра
-        place_dinosaur(loaded, dx, dy);
-
-        // Копируем загруженное поле в основное
-        *f = *loaded;
-        free(loaded);
-        return true;
+        return command_generate(f, &p, opts->threads, line_num);
     }
 
     // =============== Проверки: поле и динозавр должны быть созданы ===============
-
-    // Все остальные команды требуют, чтобы поле было создано
-    if (!f->field_created) {
-        fprintf(stderr, "ОШИБКА (строка %d): Поле не создано (не хватает SIZE или LOAD)\n", line_num);
-        return false;
-    }
-
-    // Все команды, кроме START, требуют, чтобы динозавр был поставлен
-    if (!f->dino_placed && strcmp(cmd, "START") != 0) {
-        fprintf(stderr, "ОШИБКА (строка %d): Динозавр не размещён (не хватает START)\n", line_num);
+    // (здесь же сохраняется состояние для UNDO)
+    if (!command_begin(f, hist, cmd, line_num)) {
         return false;
     }
 
-    // =============== Сохранение состояния для UNDO ===============
-    // Не сохраняем для UNDO, EXEC и IF (чтобы не засорять стек)
-    if (strcmp(cmd, "UNDO") != 0 && strcmp(cmd, "EXEC") != 0 && strncmp(cmd, "IF", 2) != 0) {
-        push_state(hist, f);
-    }
-
     // =============== Выполнение конкретных команд ===============
     bool success = true;
 
     if (strcmp(cmd, "START") == 0) {
-        // Нельзя вызывать START дважды
-        if (f->dino_placed) {
-            fprintf(stderr, "ОШИБКА (строка %d): START уже вызван\n", line_num);
-            return false;
-        }
-
         int x, y;
         if (sscanf(line, "START %d %d", &x, &y) != 2) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверный формат START\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверный формат START\n", line_num);
             return false;
         }
 
-        // Размещаем динозавра (координаты нормализуются внутри)
-        place_dinosaur(f, x, y);
+        if (!command_start(f, x, y, line_num)) return false;
     }
     else if (strcmp(cmd, "MOVE") == 0) {
         char dir[16];
         if (sscanf(line, "MOVE %15s", dir) != 1 || !is_direction(dir)) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверное направление MOVE\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверное направление MOVE\n", line_num);
             return false;
         }
         success = move_dino(f, dir);
@@ -229,7 +548,7 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
         char dir[16];
         int n;
         if (sscanf(line, "JUMP %15s %d", dir, &n) != 2 || !is_direction(dir) || n <= 0) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверный формат JUMP\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверный формат JUMP\n", line_num);
             return false;
         }
         success = jump_dino(f, dir, n);
@@ -237,15 +556,34 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
     else if (strcmp(cmd, "PAINT") == 0) {
         char c;
         if (sscanf(line, "PAINT %c", &c) != 1 || c < 'a' || c > 'z') {
-            fprintf(stderr, "ОШИБКА (строка %d): PAINT требует строчную букву\n", line_num);
+            event_log_message("ОШИБКА (строка %d): PAINT требует строчную букву\n", line_num);
             return false;
         }
         paint_cell(f, c);
     }
+    else if (strcmp(cmd, "PAINTRECT") == 0) {
+        int x, y, w, h;
+        char c;
+        if (sscanf(line, "PAINTRECT %d %d %d %d %c", &x, &y, &w, &h, &c) != 5 || w <= 0 || h <= 0 ||
+            c < 'a' || c > 'z') {
+            event_log_message("ОШИБКА (строка %d): Неверный формат PAINTRECT\n", line_num);
+            return false;
+        }
+        paint_rect(f, x, y, w, h, c);
+    }
+    else if (strcmp(cmd, "FILL") == 0) {
+        int x, y, w, h;
+        char sym;
+        if (sscanf(line, "FILL %d %d %d %d %c", &x, &y, &w, &h, &sym) != 5 ||
+            !fill_rect(f, x, y, w, h, sym)) {
+            event_log_message("ОШИБКА (строка %d): Неверный формат FILL\n", line_num);
+            return false;
+        }
+    }
     else if (strcmp(cmd, "DIG") == 0) {
         char dir[16];
         if (sscanf(line, "DIG %15s", dir) != 1 || !is_direction(dir)) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверное направление DIG\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверное направление DIG\n", line_num);
             return false;
         }
         modify_adjacent(f, dir, '%', true); // Яма только на пустой клетке
@@ -253,7 +591,7 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
     else if (strcmp(cmd, "MOUND") == 0) {
         char dir[16];
         if (sscanf(line, "MOUND %15s", dir) != 1 || !is_direction(dir)) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверное направление MOUND\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверное направление MOUND\n", line_num);
             return false;
         }
         modify_adjacent(f, dir, '^', true); // Гора только на пустой клетке
@@ -261,7 +599,7 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
     else if (strcmp(cmd, "GROW") == 0) {
         char dir[16];
         if (sscanf(line, "GROW %15s", dir) != 1 || !is_direction(dir)) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверное направление GROW\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверное направление GROW\n", line_num);
             return false;
         }
         modify_adjacent(f, dir, '&', true); // Дерево только на пустой клетке
@@ -269,7 +607,7 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
     else if (strcmp(cmd, "CUT") == 0) {
         char dir[16];
         if (sscanf(line, "CUT %15s", dir) != 1 || !is_direction(dir)) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверное направление CUT\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверное направление CUT\n", line_num);
             return false;
         }
         cut_tree(f, dir);
@@ -277,43 +615,86 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
     else if (strcmp(cmd, "MAKE") == 0) {
         char dir[16];
         if (sscanf(line, "MAKE %15s", dir) != 1 || !is_direction(dir)) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверное направление MAKE\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неверное направление MAKE\n", line_num);
             return false;
         }
         modify_adjacent(f, dir, '@', true); // Камень только на пустой клетке
     }
     else if (strcmp(cmd, "PUSH") == 0) {
         char dir[16];
-        if (sscanf(line, "PUSH %15s", dir) != 1 || !is_direction(dir)) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неверное направление PUSH\n", line_num);
+        char mode[16];
+        int parsed = sscanf(line, "PUSH %15s %15s", dir, mode);
+        if (parsed < 1 || !is_direction(dir)) {
+            event_log_message("ОШИБКА (строка %d): Неверное направление PUSH\n", line_num);
+            return false;
+        }
+        if (parsed == 2 && strcmp(mode, "SLIDE") != 0) {
+            event_log_message("ОШИБКА (строка %d): Неверный режим PUSH (ожидается SLIDE)\n", line_num);
             return false;
         }
-        push_stone(f, dir);
+        if (parsed == 2) {
+            push_stone_slide(f, dir); // Камень скользит до препятствия или ямы
+        } else {
+            push_stone(f, dir);
+        }
     }
     else if (strcmp(cmd, "EXEC") == 0) {
         char fname[256];
         if (sscanf(line, "EXEC %255s", fname) != 1) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неправильный формат EXEC\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неправильный формат EXEC\n", line_num);
             return false;
         }
-        // Рекурсивно выполняем другой файл
-        if (!parse_and_execute_file(fname, f, hist, opts)) {
+        // Рекурсивно выполняем другой файл (при --atomic-exec — одним действием для UNDO)
+        ExecUnit unit;
+        if (!exec_unit_begin(f, hist, opts, line_num, &unit)) return false;
+        bool done = parse_and_execute_file(fname, f, hist, opts);
+        exec_unit_end(f, hist, &unit, done);
+        if (!done) return false;
+    }
+    else if (strcmp(cmd, "SAVE") == 0) {
+        char fname[256];
+        if (sscanf(line, "SAVE %255s", fname) != 1) {
+            event_log_message("ОШИБКА (строка %d): Неверный формат SAVE\n", line_num);
             return false;
         }
+        // Снимок записывается в фоне, выполнение не ждёт диска
+        snapshot_save(f, fname, opts->field_format);
     }
     else if (strcmp(cmd, "UNDO") == 0) {
         // Восстанавливаем предыдущее состояние
-        if (!pop_state(hist, f)) {
-            fprintf(stderr, "ВНИМАНИЕ (строка %d): Нечего отменять\n", line_num);
-        }
+        command_undo(f, hist);
         // Пропускаем визуализацию после UNDO (goto ниже)
         goto skip_display;
     }
+    else if (strcmp(cmd, "REDO") == 0) {
+        command_redo(f, hist);
+    }
+    else if (strcmp(cmd, "BRANCH") == 0 || strcmp(cmd, "CHECKOUT") == 0) {
+        char name[BRANCH_NAME_MAX];
+        int n = -1;
+        if (sscanf(line + strlen(cmd), " %63s%n", name, &n) != 1 || line[strlen(cmd) + n] != '\0') {
+            event_log_message("ОШИБКА (строка %d): Неверный формат %s\n", line_num, cmd);
+            return false;
+        }
+        bool branch = strcmp(cmd, "BRANCH") == 0;
+        if (branch ? !command_branch(f, hist, name, line_num) : !command_checkout(f, hist, name, line_num)) {
+            return false;
+        }
+    }
+    else if (strcmp(cmd, "BEGIN") == 0) {
+        if (!command_transaction_begin(f, hist, line_num)) return false;
+    }
+    else if (strcmp(cmd, "COMMIT") == 0) {
+        command_commit(f);
+    }
+    else if (strcmp(cmd, "ROLLBACK") == 0) {
+        command_rollback(f, hist);
+    }
     else if (strncmp(cmd, "IF", 2) == 0) {
         // Находим остаток строки после "IF "
         char* rest = strchr(line, ' ');
         if (!rest) {
-            fprintf(stderr, "ОШИБКА (строка %d): Неправильный синтаксис IF\n", line_num);
+            event_log_message("ОШИБКА (строка %d): Неправильный синтаксис IF\n", line_num);
             return false;
         }
         rest++; // Пропускаем пробел
@@ -324,7 +705,7 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
     }
     else {
         // Неизвестная команда
-        fprintf(stderr, "ОШИБКА (строка %d): Незнакомая команда '%s'\n", line_num, cmd);
+        event_log_message("ОШИБКА (строка %d): Незнакомая команда '%s'\n", line_num, cmd);
         return false;
     }
 
@@ -333,33 +714,19 @@ bool execute_command(Field* f, History* hist, char* line, int line_num, const Op
 
     // =============== Визуализация ===============
 skip_display:
-    if (opts->display) {
-        clear_screen();      // Очищаем консоль
-        print_field(f);      // Выводим поле
-        delay_seconds(opts->interval); // Ждём заданное время
-    }
+    command_show(f, opts);
 
     return true;
 }
 
 /**
- * Основная функция чтения файла.
- * Читает построчно, пропускает комментарии и пустые строки,
- * проверяет формат и вызывает execute_command.
+ * Читает из fp следующую строку с командой.
+ * Удаляет перевод строки и пробелы в конце, пропускает пустые строки и комментарии.
  */
-bool parse_and_execute_file(const char* filename, Field* f, History* hist, const Options* opts) {
-    FILE* fp = fopen(filename, "r");
-    if (!fp) {
-        fprintf(stderr, "ОШИБКА: Невозможно открыть файл '%s'\n", filename);
-        return false;
-    }
-
-    char buffer[4096]; // Буфер фиксированного размера
-    int line_num = 0;
-
-    // Читаем файл построчно
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        line_num++;
+int read_script_line(FILE* fp, char* buffer, int size, int* line_num) {
+    // Читаем файл построчно
+    while (fgets(buffer, size, fp) != NULL) {
+        (*line_num)++;
 
         // Удаляем символ новой строки
         char* nl = strchr(buffer, '\n');
@@ -379,19 +746,1143 @@ bool parse_and_execute_file(const char* filename, Field* f, History* hist, const
 
         // Проверяем пробелы в начале строки
         if (isspace((unsigned char)buffer[0])) {
-            fprintf(stderr, "ОШИБКА (строка %d): Пробелы в начале строки запрещены\n", line_num);
-            fclose(fp);
-            return false;
+            return -1;
         }
+        return 1;
+    }
+    return 0;
+}
 
-        // Выполняем команду
-        if (!execute_command(f, hist, buffer, line_num, opts)) {
-            fclose(fp);
+/**
+ * Вид строки скрипта после предварительного разбора.
+ */
+typedef enum {
+    LINE_COMMAND,   // Обычная команда: выполняется через execute_command
+    LINE_IF,        // IF с уже разобранным условием
+    LINE_WHILE,     // WHILE условие
+    LINE_END,       // Конец цикла WHILE
+    LINE_LABEL,     // LABEL имя
+    LINE_GOTO       // GOTO имя
+} LineKind;
+
+#define LABEL_NAME_MAX 64
+
+/**
+ * Строка скрипта. Условия IF и WHILE разбираются один раз при загрузке файла,
+ * переходы тоже находятся заранее, поэтому повторное выполнение цикла
+ * не разбирает строк.
+ * - target: WHILE — строка после парного END, END — строка WHILE,
+ *   GOTO и IF ... THEN GOTO — строка LABEL; -1 — пары нет
+ */
+typedef struct {
+    LineKind kind;
+    int line_num;
+    char* text;
+    Predicate pred;           // IF, WHILE
+    bool valid;               // WHILE, LABEL, GOTO: формат верный
+    char* then_cmd;           // IF: команда после THEN (внутри text)
+    bool then_goto;           // IF ... THEN GOTO имя
+    char label[LABEL_NAME_MAX];
+    int target;
+} ScriptLine;
+
+typedef struct PeepOp PeepOp;
+
+typedef struct {
+    ScriptLine* lines;
+    int count;
+    int cap;
+    int bad_line;   // Строка с пробелом в начале (0 — нет): на ней чтение остановилось
+    FILE* stream;   // Поток, из которого строки дочитываются по мере выполнения (NULL — файл прочитан)
+    int line_num;   // Номер последней прочитанной строки потока
+    bool out_of_memory;
+    PeepOp* peep;   // Шаги блоков MOVE/PAINT (compile_peephole)
+    int peep_count;
+    int* peep_block; // По строкам: первый шаг блока, который начинается строкой, или -1
+} Script;
+
+// Разбирает "LABEL имя" / "GOTO имя" (ровно одно слово после команды)
+static bool parse_label(const char* text, const char* fmt, char* label) {
+    int n = -1;
+    return sscanf(text, fmt, label, &n) == 1 && n >= 0 && text[n] == '\0';
+}
+
+/**
+ * Определяет вид строки и разбирает условие и метки.
+ * Строки с ошибкой формата IF остаются обычными командами: ошибку
+ * выведет execute_command в момент выполнения, как и раньше.
+ */
+static void compile_line(ScriptLine* l) {
+    char cmd[32];
+    l->kind = LINE_COMMAND;
+    l->target = -1;
+    if (sscanf(l->text, "%31s", cmd) != 1) return;
+
+    if (strcmp(cmd, "WHILE") == 0) {
+        int n;
+        l->kind = LINE_WHILE;
+        l->valid = l->text[5] == ' ' && parse_predicate(l->text + 6, &l->pred, &n) && l->text[6 + n] == '\0';
+    } else if (strcmp(cmd, "END") == 0) {
+        l->kind = LINE_END;
+    } else if (strcmp(cmd, "LABEL") == 0) {
+        l->kind = LINE_LABEL;
+        l->valid = parse_label(l->text, "LABEL %63s%n", l->label);
+    } else if (strcmp(cmd, "GOTO") == 0) {
+        l->kind = LINE_GOTO;
+        l->valid = parse_label(l->text, "GOTO %63s%n", l->label);
+    } else if (strncmp(cmd, "IF", 2) == 0) {
+        char* rest = strchr(l->text, ' ');
+        int then_offset;
+        if (!rest || !parse_if(rest + 1, &l->pred, &then_offset)) return;
+        l->kind = LINE_IF;
+        l->then_cmd = rest + 1 + then_offset;
+        l->then_goto = parse_label(l->then_cmd, "GOTO %63s%n", l->label);
+    }
+}
+
+/**
+ * Находит пары WHILE/END и метки для GOTO.
+ */
+static bool resolve_jumps(Script* s) {
+    int* stack = malloc((s->count ? s->count : 1) * sizeof(int));
+    if (!stack) return false;
+    int depth = 0;
+
+    for (int i = 0; i < s->count; i++) {
+        ScriptLine* l = &s->lines[i];
+        if (l->kind == LINE_WHILE) {
+            stack[depth++] = i;
+        } else if (l->kind == LINE_END && depth > 0) {
+            int w = stack[--depth];
+            s->lines[w].target = i + 1;
+            l->target = w;
+        } else if (l->kind == LINE_GOTO || (l->kind == LINE_IF && l->then_goto)) {
+            // Переход к первой метке с таким именем
+            for (int j = 0; j < s->count; j++) {
+                if (s->lines[j].kind == LINE_LABEL && s->lines[j].valid &&
+                    strcmp(s->lines[j].label, l->label) == 0) {
+                    l->target = j;
+                    break;
+                }
+            }
+        }
+    }
+    free(stack);
+    return true;
+}
+
+static void free_script(Script* s) {
+    for (int i = 0; i < s->count; i++) free(s->lines[i].text);
+    free(s->lines);
+    free(s->peep);
+    free(s->peep_block);
+}
+
+/**
+ * Дочитывает из s->stream одну команду и разбирает её.
+ * Возвращает false в конце потока или на строке с пробелом в начале
+ * (её номер попадает в s->bad_line, дальше поток не читается).
+ */
+static bool read_more(Script* s) {
+    if (!s->stream) return false;
+
+    char buffer[4096]; // Буфер фиксированного размера
+    int status = read_script_line(s->stream, buffer, sizeof(buffer), &s->line_num);
+    if (status <= 0) {
+        if (status < 0) s->bad_line = s->line_num;
+        s->stream = NULL;
+        return false;
+    }
+
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 64;
+        ScriptLine* lines = realloc(s->lines, cap * sizeof(ScriptLine));
+        if (!lines) {
+            s->out_of_memory = true;
+            s->stream = NULL;
             return false;
         }
+        s->lines = lines;
+        s->cap = cap;
     }
+    char* text = malloc(strlen(buffer) + 1);
+    if (!text) {
+        s->out_of_memory = true;
+        s->stream = NULL;
+        return false;
+    }
+
+    ScriptLine* l = &s->lines[s->count++];
+    memset(l, 0, sizeof(*l));
+    l->line_num = s->line_num;
+    l->text = strcpy(text, buffer);
+    compile_line(l);
+    return true;
+}
+
+/**
+ * Читает все строки файла и разбирает их. Чтение останавливается на строке
+ * с пробелом в начале — её номер попадает в s->bad_line.
+ */
+static bool load_script(FILE* fp, Script* s) {
+    memset(s, 0, sizeof(*s));
+    s->stream = fp;
+    while (read_more(s)) {}
+    s->stream = NULL;
+    return !s->out_of_memory && resolve_jumps(s);
+}
 
-    // Освобождаем буфер и закрываем файл
+/**
+ * Находит переход строки pc, если он ещё не найден, дочитывая поток
+ * (ввод из stdin): WHILE ждёт своего END, GOTO — своей метки.
+ * Правила те же, что в resolve_jumps для целого файла.
+ */
+static void resolve_streamed(Script* s, int pc) {
+    ScriptLine* l = &s->lines[pc];
+    if (l->target >= 0 || !s->stream) return;
+
+    if (l->kind == LINE_WHILE) {
+        int depth = 0;
+        for (int i = pc + 1; i < s->count || read_more(s); i++) {
+            if (s->lines[i].kind == LINE_WHILE) depth++;
+            else if (s->lines[i].kind == LINE_END && depth-- == 0) {
+                s->lines[pc].target = i + 1;
+                s->lines[i].target = pc;
+                return;
+            }
+        }
+    } else if (l->kind == LINE_END) {
+        // END, до которого дошли не через свой WHILE (например, по GOTO)
+        int depth = 0;
+        for (int i = pc - 1; i >= 0; i--) {
+            if (s->lines[i].kind == LINE_END) depth++;
+            else if (s->lines[i].kind == LINE_WHILE && depth-- == 0) {
+                l->target = i;
+                s->lines[i].target = pc + 1;
+                return;
+            }
+        }
+    } else if (l->kind == LINE_GOTO || (l->kind == LINE_IF && l->then_goto)) {
+        for (int i = 0; i < s->count || read_more(s); i++) {
+            if (s->lines[i].kind == LINE_LABEL && s->lines[i].valid &&
+                strcmp(s->lines[i].label, s->lines[pc].label) == 0) {
+                s->lines[pc].target = i;
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * =============== Анализ снимков UNDO ===============
+ * Перед выполнением скрипта (вместе с файлами EXEC) строится граф переходов
+ * по строкам, и для каждой строки, которая сохраняет состояние, выясняется,
+ * может ли UNDO когда-нибудь восстановить именно этот снимок. Для точки
+ * программы по всем путям до конца выполнения считаются:
+ * - reach: достижим ли UNDO;
+ * - demand: на сколько состояний UNDO опускаются ниже текущей вершины
+ *   стека — максимум по началам пути числа UNDO минус число снимков;
+ * - growth: максимум по началам пути числа снимков минус число UNDO.
+ * Если после команды UNDO недостижим или demand == 0, её снимок никогда
+ * не восстанавливается, пока стек не переполнен: запас growth проверяется
+ * при выполнении (snapshot_needed). Вместо снимка в стеке занимается место
+ * (skip_state), поэтому переполнение стека наступает там же, где раньше.
+ * Значение UNDO_INF считается бесконечным. Файлы EXEC разбираются один раз
+ * для всех мест вызова: выход из файла ведёт ко всем строкам после его EXEC.
+ */
+#define UNDO_INF MAX_UNDO_DEPTH
+
+// Действие узла графа со стеком истории
+typedef enum {
+    ACT_NONE,
+    ACT_PUSH,       // Команда сохраняет состояние
+    ACT_UNDO,
+    ACT_UNKNOWN     // Файл EXEC, который не удалось прочитать: возможно всё
+} UndoAct;
+
+typedef struct {
+    UndoAct act;
+    bool reach;            // Значения перед узлом
+    int demand, growth;
+    bool queued;
+} UndoNode;
+
+typedef struct {
+    char* filename;
+    Script script;
+    bool loaded;
+    bool owned;            // script прочитан анализом и освобождается им
+    int first;             // Узел первой строки; first + count — выход из файла
+    int* push_node;        // Узел, где строка сохраняет состояние, или -1
+} UndoFile;
+
+// EXEC: узел node вызывает файл file, после возврата — узел next
+typedef struct {
+    int node, file, next;
+} UndoCall;
+
+typedef struct {
+    UndoFile* files;
+    int file_count, file_cap;
+    UndoNode* nodes;
+    int node_count, node_cap;
+    int (*edges)[2];
+    int edge_count, edge_cap;
+    UndoCall* calls;
+    int call_count, call_cap;
+    bool failed;           // Не хватило памяти или есть транзакции: снимки сохраняются везде
+} UndoGraph;
+
+// Результат анализа для одного файла
+typedef struct {
+    char* filename;
+    uint64_t hash;         // Хеш строк: сверяется, когда файл выполняется
+    int* margin;           // По строкам: SNAP_ALWAYS, SNAP_NEVER или запас
+} UndoPlanFile;
+
+static _Thread_local UndoPlanFile* undo_plan;
+static _Thread_local int undo_plan_count;
+
+// Увеличивает массив *items до count + 1 элементов. false — не хватило памяти
+static bool undo_reserve(void** items, int* cap, int count, size_t size, bool* failed) {
+    if (count < *cap) return true;
+    int new_cap = *cap ? *cap * 2 : 64;
+    void* p = realloc(*items, (size_t)new_cap * size);
+    if (!p) {
+        *failed = true;
+        return false;
+    }
+    *items = p;
+    *cap = new_cap;
+    return true;
+}
+
+static int undo_node(UndoGraph* g, UndoAct act) {
+    if (!undo_reserve((void**)&g->nodes, &g->node_cap, g->node_count, sizeof(UndoNode), &g->failed)) return 0;
+    g->nodes[g->node_count] = (UndoNode){ .act = act };
+    return g->node_count++;
+}
+
+static void undo_edge(UndoGraph* g, int from, int to) {
+    if (!undo_reserve((void**)&g->edges, &g->edge_cap, g->edge_count, sizeof(*g->edges), &g->failed)) return;
+    g->edges[g->edge_count][0] = from;
+    g->edges[g->edge_count][1] = to;
+    g->edge_count++;
+}
+
+// Номер файла в графе; новый файл читается и разбирается позже (undo_build)
+static int undo_file(UndoGraph* g, const char* filename) {
+    for (int i = 0; i < g->file_count; i++) {
+        if (strcmp(g->files[i].filename, filename) == 0) return i;
+    }
+    if (!undo_reserve((void**)&g->files, &g->file_cap, g->file_count, sizeof(UndoFile), &g->failed)) return -1;
+    UndoFile* uf = &g->files[g->file_count];
+    memset(uf, 0, sizeof(*uf));
+    uf->filename = malloc(strlen(filename) + 1);
+    if (!uf->filename) {
+        g->failed = true;
+        return -1;
+    }
+    strcpy(uf->filename, filename);
+    return g->file_count++;
+}
+
+/**
+ * Команда text в узле n (строка или часть после THEN), next — следующая строка.
+ * Команды, на которых выполнение остановится с ошибкой, остаются без переходов.
+ * Возвращает узел, где команда сохраняет состояние, или -1.
+ */
+static int undo_action(UndoGraph* g, int n, const char* text, int next) {
+    char cmd[32];
+    if (sscanf(text, "%31s", cmd) != 1) return -1;
+
+    if (strncmp(cmd, "IF", 2) == 0) {
+        // Условие не выполнено — следующая строка, выполнено — команда после THEN
+        const char* rest = strchr(text, ' ');
+        Predicate p;
+        int then_offset;
+        if (!rest || !parse_if(rest + 1, &p, &then_offset)) return -1;
+        int m = undo_node(g, ACT_NONE);
+        undo_edge(g, n, next);
+        undo_edge(g, n, m);
+        return undo_action(g, m, rest + 1 + then_offset, next);
+    }
+    if (strcmp(cmd, "WHILE") == 0 || strcmp(cmd, "END") == 0 ||
+        strcmp(cmd, "LABEL") == 0 || strcmp(cmd, "GOTO") == 0) {
+        return -1;
+    }
+    if (strcmp(cmd, "BEGIN") == 0 || strcmp(cmd, "COMMIT") == 0 || strcmp(cmd, "ROLLBACK") == 0 ||
+        strcmp(cmd, "REDO") == 0) {
+        // ROLLBACK возвращает стек к BEGIN, REDO кладёт в него снятые UNDO состояния,
+        // и UNDO после них доходит до снимков, которые граф считает недостижимыми
+        g->failed = true;
+        return -1;
+    }
+    if (strcmp(cmd, "EXEC") == 0) {
+        char fname[256];
+        if (sscanf(text, "EXEC %255s", fname) != 1) return -1;
+        int file = undo_file(g, fname);
+        if (file >= 0 &&
+            undo_reserve((void**)&g->calls, &g->call_cap, g->call_count, sizeof(UndoCall), &g->failed)) {
+            g->calls[g->call_count++] = (UndoCall){ n, file, next };
+        }
+        return -1;
+    }
+
+    undo_edge(g, n, next);
+    if (strcmp(cmd, "UNDO") == 0) {
+        g->nodes[n].act = ACT_UNDO;
+        return -1;
+    }
+    if (strcmp(cmd, "SIZE") == 0 || strcmp(cmd, "LOAD") == 0 ||
+        strcmp(cmd, "GENERATE") == 0 || strcmp(cmd, "SAVE") == 0 || strcmp(cmd, "BRANCH") == 0) {
+        return -1;
+    }
+    g->nodes[n].act = ACT_PUSH;
+    return n;
+}
+
+// Узлы и переходы строк файла fi. Разбор EXEC может добавить файлы,
+// поэтому g->files перечитывается по номеру
+static void undo_add_file(UndoGraph* g, int fi) {
+    const Script s = g->files[fi].script;
+    int first = g->node_count;
+    for (int i = 0; i <= s.count; i++) undo_node(g, ACT_NONE);
+    int* push_node = malloc((s.count ? s.count : 1) * sizeof(int));
+    g->files[fi].first = first;
+    g->files[fi].push_node = push_node;
+    if (g->failed || !push_node) {
+        g->failed = true;
+        return;
+    }
+
+    for (int pc = 0; pc < s.count; pc++) {
+        const ScriptLine* l = &s.lines[pc];
+        int n = first + pc;
+        int next = n + 1;
+        push_node[pc] = -1;
+
+        switch (l->kind) {
+        case LINE_COMMAND:
+        case LINE_IF:
+            if (l->kind == LINE_COMMAND || !l->then_goto) {
+                push_node[pc] = undo_action(g, n, l->text, next);
+                break;
+            }
+            // Без метки переход по выполненному условию — ошибка
+            undo_edge(g, n, next);
+            if (l->target >= 0) undo_edge(g, n, first + l->target);
+            break;
+        case LINE_WHILE:
+            if (l->valid && l->target >= 0) {
+                undo_edge(g, n, next);
+                undo_edge(g, n, first + l->target);
+            }
+            break;
+        case LINE_END:
+            if (l->target >= 0) undo_edge(g, n, first + l->target);
+            break;
+        case LINE_LABEL:
+            if (l->valid) undo_edge(g, n, next);
+            break;
+        case LINE_GOTO:
+            if (l->valid && l->target >= 0) undo_edge(g, n, first + l->target);
+            break;
+        }
+    }
+}
+
+// Читает файл для анализа. false — файл недоступен
+static bool undo_load(UndoFile* uf) {
+    FILE* fp = fopen(uf->filename, "r");
+    if (!fp) return false;
+    bool ok = load_script(fp, &uf->script);
     fclose(fp);
+    uf->owned = true;
+    return ok;
+}
+
+// Переходы EXEC: в начало вызванного файла и из его конца обратно
+static void undo_link_calls(UndoGraph* g) {
+    for (int i = 0; i < g->call_count; i++) {
+        const UndoCall* c = &g->calls[i];
+        const UndoFile* uf = &g->files[c->file];
+        if (!uf->loaded) {
+            undo_edge(g, c->node, undo_node(g, ACT_UNKNOWN));
+            continue;
+        }
+        undo_edge(g, c->node, uf->first);
+        // Файл со строкой, начинающейся с пробела, заканчивается ошибкой
+        if (!uf->script.bad_line) undo_edge(g, uf->first + uf->script.count, c->next);
+    }
+}
+
+// Значения после узла: объединение по следующим узлам
+static void undo_out(const UndoGraph* g, const int* succ_start, const int* succ, int n,
+                     bool* reach, int* demand, int* growth) {
+    *reach = false;
+    *demand = 0;
+    *growth = 0;
+    for (int i = succ_start[n]; i < succ_start[n + 1]; i++) {
+        const UndoNode* s = &g->nodes[succ[i]];
+        *reach |= s->reach;
+        if (s->demand > *demand) *demand = s->demand;
+        if (s->growth > *growth) *growth = s->growth;
+    }
+}
+
+// Значения перед узлом по значениям после него
+static void undo_transfer(UndoAct act, bool* reach, int* demand, int* growth) {
+    switch (act) {
+    case ACT_PUSH:
+        if (*demand > 0 && *demand < UNDO_INF) (*demand)--;
+        if (*growth < UNDO_INF) (*growth)++;
+        break;
+    case ACT_UNDO:
+        *reach = true;
+        if (*demand < UNDO_INF) (*demand)++;
+        if (*growth > 0 && *growth < UNDO_INF) (*growth)--;
+        break;
+    case ACT_UNKNOWN:
+        *reach = true;
+        *demand = UNDO_INF;
+        *growth = UNDO_INF;
+        break;
+    case ACT_NONE:
+        break;
+    }
+}
+
+// Строит списки переходов по узлам: start[n]..start[n + 1] в list
+static bool undo_adjacency(const UndoGraph* g, int side, int** start, int** list) {
+    *start = calloc(g->node_count + 1, sizeof(int));
+    *list = malloc((g->edge_count ? g->edge_count : 1) * sizeof(int));
+    if (!*start || !*list) return false;
+    for (int i = 0; i < g->edge_count; i++) (*start)[g->edges[i][side] + 1]++;
+    for (int n = 0; n < g->node_count; n++) (*start)[n + 1] += (*start)[n];
+    int* pos = malloc((g->node_count ? g->node_count : 1) * sizeof(int));
+    if (!pos) return false;
+    memcpy(pos, *start, g->node_count * sizeof(int));
+    for (int i = 0; i < g->edge_count; i++) (*list)[pos[g->edges[i][side]]++] = g->edges[i][1 - side];
+    free(pos);
+    return true;
+}
+
+/**
+ * Решает уравнения потока данных от конца программы к началу (очередь узлов,
+ * значения только растут). Возвращает списки следующих узлов для undo_margin.
+ */
+static bool undo_solve(UndoGraph* g, int** succ_start, int** succ) {
+    int *pred_start = NULL, *pred = NULL;
+    int* queue = malloc((g->node_count ? g->node_count : 1) * sizeof(int));
+    bool ok = queue && undo_adjacency(g, 0, succ_start, succ) && undo_adjacency(g, 1, &pred_start, &pred);
+
+    if (ok) {
+        int head = 0, size = 0;
+        for (int n = g->node_count; n-- > 0;) {
+            queue[size++] = n;
+            g->nodes[n].queued = true;
+        }
+        while (size > 0) {
+            int n = queue[head];
+            head = (head + 1) % g->node_count;
+            size--;
+            UndoNode* node = &g->nodes[n];
+            node->queued = false;
+
+            bool reach;
+            int demand, growth;
+            undo_out(g, *succ_start, *succ, n, &reach, &demand, &growth);
+            undo_transfer(node->act, &reach, &demand, &growth);
+            if (reach == node->reach && demand == node->demand && growth == node->growth) continue;
+            node->reach = reach;
+            node->demand = demand;
+            node->growth = growth;
+
+            for (int i = pred_start[n]; i < pred_start[n + 1]; i++) {
+                UndoNode* p = &g->nodes[pred[i]];
+                if (p->queued) continue;
+                p->queued = true;
+                queue[(head + size++) % g->node_count] = pred[i];
+            }
+        }
+    }
+    free(queue);
+    free(pred_start);
+    free(pred);
+    return ok;
+}
+
+// Нужен ли снимок в узле n (SNAP_ALWAYS, SNAP_NEVER или запас стека)
+static int undo_margin(const UndoGraph* g, const int* succ_start, const int* succ, int n) {
+    bool reach;
+    int demand, growth;
+    undo_out(g, succ_start, succ, n, &reach, &demand, &growth);
+    if (!reach) return SNAP_NEVER;
+    if (demand == 0 && growth < UNDO_INF) return growth;
+    return SNAP_ALWAYS;
+}
+
+// Хеш строк скрипта (FNV-1a)
+static uint64_t script_hash(const Script* s) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < s->count; i++) {
+        for (const char* c = s->lines[i].text; ; c++) {
+            h = (h ^ (unsigned char)*c) * 0x100000001B3ULL;
+            if (!*c) break;
+        }
+    }
+    return (h ^ (uint32_t)s->bad_line) * 0x100000001B3ULL;
+}
+
+static void undo_plan_free(void) {
+    for (int i = 0; i < undo_plan_count; i++) {
+        free(undo_plan[i].filename);
+        free(undo_plan[i].margin);
+    }
+    free(undo_plan);
+    undo_plan = NULL;
+    undo_plan_count = 0;
+}
+
+// Переносит результат анализа в undo_plan
+static bool undo_plan_fill(UndoGraph* g, const int* succ_start, const int* succ) {
+    undo_plan = calloc(g->file_count, sizeof(UndoPlanFile));
+    if (!undo_plan) return false;
+    for (int i = 0; i < g->file_count; i++) {
+        UndoFile* uf = &g->files[i];
+        if (!uf->loaded) continue;
+        UndoPlanFile* pf = &undo_plan[undo_plan_count++];
+        pf->filename = uf->filename;
+        uf->filename = NULL;
+        pf->hash = script_hash(&uf->script);
+        pf->margin = malloc((uf->script.count > 0 ? (size_t)uf->script.count : 1) * sizeof(int));
+        if (!pf->margin) return false;
+        for (int pc = 0; pc < uf->script.count; pc++) {
+            int n = uf->push_node[pc];
+            pf->margin[pc] = n >= 0 ? undo_margin(g, succ_start, succ, n) : SNAP_ALWAYS;
+        }
+    }
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * Анализирует скрипт main файла filename и все файлы, которые он вызывает
+ * через EXEC, и запоминает для них результат (undo_plan).
+ * Если памяти не хватило, плана нет — снимки сохраняются перед каждой командой.
+ */
+static void undo_plan_build(const char* filename, const Script* main) {
+    UndoGraph g = {0};
+    int *succ_start = NULL, *succ = NULL;
+
+    if (undo_file(&g, filename) == 0) {
+        g.files[0].script = *main;
+        g.files[0].loaded = true;
+        // Файлы EXEC добавляются в конец списка по мере разбора
+        for (int i = 0; i < g.file_count && !g.failed; i++) {
+            if (i > 0) g.files[i].loaded = undo_load(&g.files[i]);
+            if (g.files[i].loaded) undo_add_file(&g, i);
+        }
+        undo_link_calls(&g);
+    }
+
+    bool ok = !g.failed && undo_solve(&g, &succ_start, &succ) && !g.failed &&
+              undo_plan_fill(&g, succ_start, succ);
+    if (!ok) undo_plan_free();
+
+    for (int i = 0; i < g.file_count; i++) {
+        if (g.files[i].owned) free_script(&g.files[i].script);
+        free(g.files[i].filename);
+        free(g.files[i].push_node);
+    }
+    free(g.files);
+    free(g.nodes);
+    free(g.edges);
+    free(g.calls);
+    free(succ_start);
+    free(succ);
+}
+
+// Результат анализа для файла filename, если он не изменился после анализа
+static const int* undo_plan_find(const char* filename, const Script* s) {
+    if (!undo_plan || s->stream) return NULL;
+    for (int i = 0; i < undo_plan_count; i++) {
+        if (strcmp(undo_plan[i].filename, filename) == 0) {
+            return undo_plan[i].hash == script_hash(s) ? undo_plan[i].margin : NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * =============== Оптимизатор блоков MOVE/PAINT ===============
+ * Подряд идущие строки MOVE и PAINT (блок) заменяются более короткой
+ * последовательностью шагов:
+ * - ходы вдоль одной оси — один шаг WALK: динозавр проходит отрезок
+ *   [lo, hi] вокруг начальной клетки и встаёт в клетку end (серия
+ *   MOVE RIGHT — один шаг, пары MOVE LEFT / MOVE RIGHT сокращаются);
+ * - из нескольких PAINT подряд остаётся последний.
+ * WALK выполняется, только если на отрезке нет ям и препятствий: тогда ни
+ * одна строка не выводит предупреждений и не завершает программу, а
+ * пройденные клетки освобождаются так же, как при ходах по одному.
+ * Иначе строки шага (и остальные строки блока) выполняются как обычно,
+ * с теми же сообщениями и номерами строк.
+ * Блоки сокращаются там, где после них UNDO недостижим (анализ снимков
+ * выше), и когда строки не видны по отдельности (см. peephole_enabled).
+ */
+typedef enum {
+    PEEP_WALK,
+    PEEP_PAINT
+} PeepKind;
+
+struct PeepOp {
+    PeepKind kind;
+    int dx, dy;          // WALK: ось — (1, 0) или (0, 1)
+    int lo, hi, end;     // WALK: отрезок и конечная клетка относительно начальной
+    char color;          // PAINT
+    int lines;           // Сколько строк скрипта заменяет шаг
+    bool last;           // Последний шаг блока
+};
+
+static _Thread_local PeepholeStats peep_stats;
+
+PeepholeStats peephole_stats(void) {
+    return peep_stats;
+}
+
+// Строки не видны по отдельности: сокращение блоков ничего не меняет снаружи
+static bool peephole_enabled(const History* hist, const Options* opts) {
+    return opts->peephole && opts->undo_analysis && hist && !opts->display && !opts->profiler &&
+           !opts->shm && !opts->agent && opts->snapshot_every == 0 && !opts->checkpoint_path &&
+           !heatmap_enabled() && !opts->trace;
+}
+
+/**
+ * Строка блока: 1 — MOVE (смещение в *dx, *dy), 2 — PAINT (цвет в *color),
+ * 0 — другая строка или неверный формат (его ошибку выведет execute_command).
+ */
+static int peep_line(const ScriptLine* l, int* dx, int* dy, char* color) {
+    char cmd[32], dir[16];
+    if (l->kind != LINE_COMMAND || sscanf(l->text, "%31s", cmd) != 1) return 0;
+    if (strcmp(cmd, "MOVE") == 0) {
+        if (sscanf(l->text, "MOVE %15s", dir) != 1 || !is_direction(dir)) return 0;
+        get_delta(dir, dx, dy);
+        return 1;
+    }
+    if (strcmp(cmd, "PAINT") == 0) {
+        if (sscanf(l->text, "PAINT %c", color) != 1 || *color < 'a' || *color > 'z') return 0;
+        return 2;
+    }
+    return 0;
+}
+
+// Добавляет шаг в s->peep. NULL — не хватило памяти
+static PeepOp* peep_add(Script* s, int* cap) {
+    if (s->peep_count == *cap) {
+        int new_cap = *cap ? *cap * 2 : 16;
+        PeepOp* ops = realloc(s->peep, new_cap * sizeof(PeepOp));
+        if (!ops) return NULL;
+        s->peep = ops;
+        *cap = new_cap;
+    }
+    PeepOp* op = &s->peep[s->peep_count++];
+    memset(op, 0, sizeof(*op));
+    return op;
+}
+
+/**
+ * Разбивает скрипт на блоки и строит их шаги. Остаются только блоки,
+ * где шагов меньше, чем строк. Если памяти не хватило, блоков нет.
+ */
+static void compile_peephole(Script* s) {
+    s->peep_block = malloc((s->count > 0 ? (size_t)s->count : 1) * sizeof(int));
+    if (!s->peep_block) return;
+    int cap = 0;
+
+    for (int pc = 0; pc < s->count;) {
+        s->peep_block[pc] = -1;
+        int dx, dy;
+        char color;
+        if (!peep_line(&s->lines[pc], &dx, &dy, &color)) {
+            pc++;
+            continue;
+        }
+
+        int start = pc, first = s->peep_count;
+        PeepOp* op = NULL;
+        int kind;
+        while (pc < s->count && (kind = peep_line(&s->lines[pc], &dx, &dy, &color)) != 0) {
+            if (pc > start) s->peep_block[pc] = -1;
+            pc++;
+            if (kind == 2) {
+                // PAINT сразу после PAINT закрашивает ту же клетку
+                if (!op || op->kind != PEEP_PAINT) op = peep_add(s, &cap);
+                if (!op) break;
+                op->kind = PEEP_PAINT;
+                op->color = color;
+                op->lines++;
+                continue;
+            }
+            int axis_x = dx != 0, d = dx + dy;
+            if (!op || op->kind != PEEP_WALK || op->dx != axis_x) {
+                op = peep_add(s, &cap);
+                if (!op) break;
+                op->kind = PEEP_WALK;
+                op->dx = axis_x;
+                op->dy = !axis_x;
+            }
+            op->end += d;
+            if (op->end < op->lo) op->lo = op->end;
+            if (op->end > op->hi) op->hi = op->end;
+            op->lines++;
+        }
+        if (!op) {
+            free(s->peep_block);
+            s->peep_block = NULL;
+            return;
+        }
+
+        if (s->peep_count - first < pc - start) {
+            s->peep[s->peep_count - 1].last = true;
+            s->peep_block[start] = first;
+        } else {
+            s->peep_count = first;
+        }
+    }
+}
+
+/**
+ * Шаг WALK: проверяет, что на отрезке нет ям и препятствий, освобождает
+ * пройденные клетки (цвет остаётся) и ставит динозавра в конечную.
+ * Возвращает false, если шаг нужно выполнить строками.
+ */
+static bool peep_walk(Field* f, const PeepOp* op) {
+    int size = op->dx ? f->width : f->height;
+    int n = op->hi - op->lo + 1;
+    if (n > size) n = size; // Отрезок длиннее оборота — пройдены все клетки
+
+    int x0 = op->dx ? field_wrap_x(f, f->dino_x + op->lo) : f->dino_x;
+    int y0 = op->dy ? field_wrap_y(f, f->dino_y + op->lo) : f->dino_y;
+    int x = x0, y = y0;
+    for (int i = 0; i < n; i++) {
+        if (cell_is_blocked(f->grid[y][x])) return false;
+        x = field_step_x(f, x, op->dx);
+        y = field_step_y(f, y, op->dy);
+    }
+
+    x = x0;
+    y = y0;
+    for (int i = 0; i < n; i++) {
+        journal_touch(f, x, y);
+        field_vacate(f, x, y);
+        x = field_step_x(f, x, op->dx);
+        y = field_step_y(f, y, op->dy);
+    }
+    place_dinosaur(f, f->dino_x + op->dx * op->end, f->dino_y + op->dy * op->end);
+    return true;
+}
+
+/**
+ * Выполняет шаги блока, начинающегося строкой pc, пока проверки проходят.
+ * Возвращает число выполненных строк (0 — блок выполняется строками).
+ */
+static int run_peephole(Field* f, History* hist, const Script* s, int pc) {
+    if (!f->field_created || !f->dino_placed) return 0; // Ошибку выведет первая строка
+
+    int done = 0;
+    for (const PeepOp* op = &s->peep[s->peep_block[pc]];; op++) {
+        if (op->kind == PEEP_PAINT) {
+            paint_cell(f, op->color);
+        } else if (!peep_walk(f, op)) {
+            peep_stats.fallbacks++;
+            break;
+        }
+        // Снимки строк не нужны, но место в стеке они занимают
+        for (int i = 0; i < op->lines; i++) skip_state(hist);
+        done += op->lines;
+        peep_stats.removed += op->lines - 1;
+        if (op->last) break;
+    }
+    peep_stats.lines += done;
+    return done;
+}
+
+/**
+ * Выполняет строку pc. В *next — номер следующей строки (меняется переходами).
+ */
+static bool execute_line(Field* f, History* hist, Script* s, int pc, int* next, const Options* opts) {
+    resolve_streamed(s, pc);
+    const ScriptLine* l = &s->lines[pc];
+
+    switch (l->kind) {
+    case LINE_COMMAND:
+        return execute_command(f, hist, l->text, l->line_num, opts);
+
+    case LINE_IF:
+        // Те же проверки, что и в execute_command, но без повторного разбора
+        if (!command_begin(f, hist, "IF", l->line_num)) return false;
+        if (predicate_holds(f, &l->pred)) {
+            if (!l->then_goto) {
+                if (!execute_command(f, hist, l->then_cmd, l->line_num, opts)) return false;
+            } else if (l->target < 0) {
+                event_log_message("ОШИБКА (строка %d): Метка '%s' не найдена\n", l->line_num, l->label);
+                return false;
+            } else {
+                *next = l->target;
+            }
+        }
+        command_show(f, opts);
+        return true;
+
+    case LINE_WHILE:
+        if (!l->valid) {
+            event_log_message("ОШИБКА (строка %d): Неверный формат WHILE\n", l->line_num);
+            return false;
+        }
+        if (l->target < 0) {
+            event_log_message("ОШИБКА (строка %d): WHILE без END\n", l->line_num);
+            return false;
+        }
+        if (!command_begin(f, hist, "WHILE", l->line_num)) return false;
+        // Условие не выполнено — выходим из цикла за END
+        if (!predicate_holds(f, &l->pred)) *next = l->target;
+        return true;
+
+    case LINE_END:
+        if (l->target < 0) {
+            event_log_message("ОШИБКА (строка %d): END без WHILE\n", l->line_num);
+            return false;
+        }
+        *next = l->target; // Назад к WHILE: условие проверяется снова
+        return true;
+
+    case LINE_LABEL:
+        if (!l->valid) {
+            event_log_message("ОШИБКА (строка %d): Неверный формат LABEL\n", l->line_num);
+            return false;
+        }
+        return true;
+
+    case LINE_GOTO:
+        if (!l->valid) {
+            event_log_message("ОШИБКА (строка %d): Неверный формат GOTO\n", l->line_num);
+            return false;
+        }
+        if (l->target < 0) {
+            event_log_message("ОШИБКА (строка %d): Метка '%s' не найдена\n", l->line_num, l->label);
+            return false;
+        }
+        *next = l->target;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Стек выполняемых файлов потока: по нему строится контрольная точка.
+ * Имена указывают на строки вызывающих (аргумент EXEC, имя скрипта).
+ */
+static _Thread_local CheckpointFrame* exec_frames;
+static _Thread_local int exec_depth;
+static _Thread_local int exec_cap;
+
+// Число строк, выполненных во всех файлах (для --snapshot-every и --every)
+static _Thread_local long executed_lines;
+
+// Стек файлов, который восстанавливает --resume (resume_depth == 0 — нет)
+static const CheckpointFrame* resume_frames;
+static int resume_depth;
+
+void set_resume_point(const CheckpointFrame* frames, int depth, long lines) {
+    resume_frames = frames;
+    resume_depth = depth;
+    executed_lines = lines;
+}
+
+// Добавляет файл в стек выполнения. Возвращает его уровень или -1
+static int push_exec_frame(const char* filename) {
+    if (exec_depth == exec_cap) {
+        int cap = exec_cap ? exec_cap * 2 : 16;
+        CheckpointFrame* frames = realloc(exec_frames, cap * sizeof(CheckpointFrame));
+        if (!frames) return -1;
+        exec_frames = frames;
+        exec_cap = cap;
+    }
+    exec_frames[exec_depth].filename = filename;
+    exec_frames[exec_depth].pc = 0;
+    return exec_depth++;
+}
+
+static void pop_exec_frame(void) {
+    if (--exec_depth == 0) {
+        free(exec_frames);
+        exec_frames = NULL;
+        exec_cap = 0;
+    }
+}
+
+/**
+ * Выводит строку состояния (--status): номер строки, результат,
+ * позицию динозавра и хеш поля. Накопленные события выводятся раньше неё.
+ */
+static void print_status(const Field* f, int line_num, bool ok) {
+    event_log_flush();
+    printf("STATUS %d %s %d %d %016llx\n", line_num, ok ? "OK" : "ERROR",
+           f->dino_x, f->dino_y, (unsigned long long)field_hash(f));
+    fflush(stdout);
+}
+
+/**
+ * Восстанавливает файл уровня level из точки продолжения: строка, с которой
+ * продолжить, и признак того, что эта строка — прерванный EXEC.
+ */
+static bool resume_file(const char* filename, const Script* script, int level, int* pc, bool* in_exec) {
+    const CheckpointFrame* r = &resume_frames[level];
+    if (strcmp(r->filename, filename) != 0 || r->pc < 0 || r->pc > script->count) {
+        event_log_message("ОШИБКА: Контрольная точка не соответствует файлу '%s'\n", filename);
+        resume_depth = 0;
+        return false;
+    }
+    *pc = r->pc;
+    *in_exec = level + 1 < resume_depth;
+    // Самый вложенный файл восстановлен — дальше выполнение обычное
+    if (!*in_exec) resume_depth = 0;
+    return true;
+}
+
+/**
+ * Выполняет загруженный (или читаемый из потока) скрипт s файла filename.
+ * Освобождает s.
+ */
+static bool run_script(Script* s, const char* filename, Field* f, History* hist, const Options* opts) {
+    int level = push_exec_frame(filename);
+    if (level < 0) {
+        event_log_message("ОШИБКА: Недостаточно памяти для файла '%s'\n", filename);
+        free_script(s);
+        return false;
+    }
+
+    // Номер файла для профилировщика (регистрируется один раз на открытие)
+    int prof_file = opts->profiler ? profiler_file_id(opts->profiler, filename) : -1;
+    int log_file = event_log_file(filename);
+    // Строка состояния после каждой команды потока (--status)
+    bool status = opts->status && s->stream;
+
+    // Снимки UNDO по результату анализа (если файл разобран заранее)
+    const int* margins = undo_plan_find(filename, s);
+    const int* blocks = margins ? s->peep_block : NULL;
+
+    bool ok = true;
+    int pc = 0;
+    bool in_exec = false;
+    if (level < resume_depth) ok = resume_file(filename, s, level, &pc, &in_exec);
+
+    // Строки потока читаются по одной: каждая выполняется, как только пришла
+    while (ok && (pc < s->count || read_more(s))) {
+        // Строки потока могут перемещаться при дочитывании — копируем номер
+        int line_num = s->lines[pc].line_num;
+        int next = pc + 1;
+        exec_frames[level].pc = pc;
+
+        // Блок MOVE/PAINT без снимков UNDO — сокращёнными шагами
+        if (blocks && blocks[pc] >= 0 && margins[pc] == SNAP_NEVER && !in_exec) {
+            int done = run_peephole(f, hist, s, pc);
+            if (done > 0) {
+                executed_lines += done;
+                pc += done;
+                continue;
+            }
+        }
+
+        event_log_set_location(log_file, line_num);
+        if (in_exec) {
+            // Строка EXEC была прервана: её начало уже выполнено, продолжаем вложенный файл
+            in_exec = false;
+            ok = parse_and_execute_file(resume_frames[level + 1].filename, f, hist, opts);
+            if (ok) command_show(f, opts);
+        } else {
+            // Выполняем строку (под профилировщиком — с замером времени строки)
+            if (opts->profiler) profiler_enter(opts->profiler, prof_file, line_num);
+            if (opts->shm) shm_export_begin(opts->shm);
+            // При совместном выполнении (--world) — блокировки плиток на время строки
+            ok = !opts->agent || world_acquire(opts->agent, f, s->lines[pc].text, line_num);
+            snapshot_margin = margins ? margins[pc] : SNAP_ALWAYS;
+            if (ok) ok = execute_line(f, hist, s, pc, &next, opts);
+            snapshot_margin = SNAP_ALWAYS;
+            if (opts->agent) world_release(opts->agent);
+            if (opts->shm) shm_export_end(opts->shm, f, log_file, filename, line_num);
+            if (opts->profiler) profiler_leave(opts->profiler);
+        }
+
+        executed_lines++;
+        // Запись выполнения (--record): изменение поля этой строкой
+        if (opts->trace) trace_step(opts->trace, f);
+        // Промежуточный снимок каждые N выполненных строк (--snapshot-every)
+        if (ok && opts->snapshot_every > 0 && opts->snapshot_path && f->field_created &&
+            executed_lines % opts->snapshot_every == 0) {
+            snapshot_save(f, opts->snapshot_path, opts->field_format);
+        }
+        // Контрольная точка (--checkpoint --every): в этом файле продолжить со строки next
+        // (не внутри транзакции: журнал в контрольную точку не попадает)
+        if (ok && opts->checkpoint_every > 0 && opts->checkpoint_path && journal_depth == 0 &&
+            executed_lines % opts->checkpoint_every == 0) {
+            exec_frames[level].pc = next;
+            checkpoint_save(opts->checkpoint_path, f, hist, exec_frames, exec_depth, executed_lines);
+        }
+        if (status) print_status(f, line_num, ok);
+
+        pc = next;
+    }
+    pop_exec_frame();
+
+    if (ok && s->out_of_memory) {
+        event_log_message("ОШИБКА: Недостаточно памяти для файла '%s'\n", filename);
+        ok = false;
+    }
+    if (ok && s->bad_line) {
+        event_log_message("ОШИБКА (строка %d): Пробелы в начале строки запрещены\n", s->bad_line);
+        ok = false;
+    }
+
+    free_script(s);
+    return ok;
+}
+
+/**
+ * Основная функция чтения файла.
+ * Читает файл целиком (пропуская комментарии и пустые строки), разбирает
+ * условия и переходы, затем выполняет строки по порядку с учётом
+ * WHILE/END и GOTO.
+ */
+bool parse_and_execute_file(const char* filename, Field* f, History* hist, const Options* opts) {
+    FILE* fp = prefetch_fopen(filename);
+    if (!fp) {
+        event_log_message("ОШИБКА: Невозможно открыть файл '%s'\n", filename);
+        return false;
+    }
+
+    Script script;
+    bool loaded = load_script(fp, &script);
+    fclose(fp);
+    if (!loaded) {
+        event_log_message("ОШИБКА: Недостаточно памяти для файла '%s'\n", filename);
+        free_script(&script);
+        return false;
+    }
+
+    // Весь скрипт известен заранее: находим снимки, которые UNDO не восстановит
+    // (EXEC одним действием сам переписывает стек UNDO — тогда без анализа)
+    bool plan = exec_depth == 0 && hist && opts->undo_analysis && !opts->atomic_exec;
+    if (plan) undo_plan_build(filename, &script);
+    if (peephole_enabled(hist, opts)) compile_peephole(&script);
+    bool ok = run_script(&script, filename, f, hist, opts);
+    if (plan) undo_plan_free();
+    return ok;
+}
+
+bool parse_and_execute_stream(FILE* fp, const char* name, Field* f, History* hist, const Options* opts) {
+    Script script;
+    memset(&script, 0, sizeof(script));
+    script.stream = fp;
+    return run_script(&script, name, f, hist, opts);
+}
@@ -4,7 +4,10 @@
 #include "field.h"    
 #include "history.h"  
 #include "command.h"  
+#include "generate.h"
+#include "checkpoint.h"
 #include <stdbool.h>
+#include <stdio.h>
 
 /**
  * Основная функция: читает файл с командами и выполняет их.
@@ -16,6 +19,20 @@
  */
 bool parse_and_execute_file(const char* filename, Field* f, History* hist, const Options* opts);
 
+/**
+ * Выполняет команды из потока fp (stdin, канал) по мере поступления:
+ * каждая строка выполняется, как только прочитана целиком. WHILE ждёт
+ * своего END, GOTO вперёд — своей метки. name — имя для сообщений.
+ */
+bool parse_and_execute_stream(FILE* fp, const char* name, Field* f, History* hist, const Options* opts);
+
+/**
+ * Задаёт точку продолжения (--resume): следующий parse_and_execute_file
+ * пройдёт по стеку файлов frames и продолжит выполнение с сохранённых строк.
+ * lines — число уже выполненных строк (счётчик для --every и --snapshot-every).
+ */
+void set_resume_point(const CheckpointFrame* frames, int depth, long lines);
+
 /**
  * Выполняет одну строку команды.
  * - line: строка из файла (без перевода строки)
@@ -24,4 +41,124 @@ bool parse_and_execute_file(const char* filename, Field* f, History* hist, const
  */
 bool execute_command(Field* f, History* hist, char* line, int line_num, const Options* opts);
 
+/**
+ * Читает следующую строку с командой из fp в buffer.
+ * Пустые строки и комментарии (//) пропускаются, *line_num увеличивается на каждую строку.
+ * Возвращает 1 — команда прочитана, 0 — конец файла,
+ * -1 — строка начинается с пробела (это ошибка, номер строки — в *line_num).
+ */
+int read_script_line(FILE* fp, char* buffer, int size, int* line_num);
+
+/*
+ * Шаги выполнения команд. Их вызывает execute_command, а также код,
+ * сгенерированный транслятором (--emit-c), поэтому поведение и сообщения
+ * об ошибках в обоих случаях одинаковые.
+ */
+
+// SIZE w h (проверяет, что SIZE ещё не вызывался)
+bool command_size(Field* f, int w, int h, int line_num);
+
+// LOAD fname (проверяет, что это первая команда)
+bool command_load(Field* f, const char* fname, int line_num);
+
+// GENERATE seed доли... (после SIZE и до START), threads — число потоков
+bool command_generate(Field* f, const GenParams* p, int threads, int line_num);
+
+// Проверки перед командой cmd и сохранение состояния для UNDO
+bool command_begin(Field* f, History* hist, const char* cmd, int line_num);
+
+// START x y (проверяет, что START ещё не вызывался)
+bool command_start(Field* f, int x, int y, int line_num);
+
+// UNDO (при пустой истории — предупреждение)
+void command_undo(Field* f, History* hist);
+
+// REDO (нечего повторять — предупреждение)
+void command_redo(Field* f, History* hist);
+
+// BRANCH имя (false — не хватило памяти)
+bool command_branch(Field* f, History* hist, const char* name, int line_num);
+
+// CHECKOUT имя (false — ветки нет)
+bool command_checkout(Field* f, History* hist, const char* name, int line_num);
+
+// BEGIN (открывает точку сохранения, false — не хватило памяти)
+bool command_transaction_begin(Field* f, History* hist, int line_num);
+
+// COMMIT (без BEGIN — предупреждение)
+void command_commit(Field* f);
+
+// ROLLBACK (без BEGIN — предупреждение)
+void command_rollback(Field* f, History* hist);
+
+/**
+ * EXEC одним действием для UNDO (--atomic-exec): exec_unit_begin перед
+ * выполнением файла (false — не хватило памяти, ошибка выведена),
+ * exec_unit_end после (ok — файл выполнен без ошибок).
+ * Снимки UNDO строк файла заменяются одним — полем до EXEC, которое
+ * собирается из журнала изменённых клеток. Без --atomic-exec ничего не делают.
+ */
+typedef struct {
+    int level;              // Точка сохранения EXEC; -1 — EXEC выполняется как обычно
+    int history_count;      // Стек UNDO до EXEC
+    int history_skipped;
+} ExecUnit;
+
+bool exec_unit_begin(Field* f, History* hist, const Options* opts, int line_num, ExecUnit* u);
+void exec_unit_end(Field* f, History* hist, const ExecUnit* u, bool ok);
+
+/**
+ * Условие IF и WHILE, разобранное один раз: проверка одной клетки
+ * или числа клеток в прямоугольнике либо на всём поле.
+ * - relative: false — CELL x y (клетка x, y);
+ *   true — AHEAD DIR (клетка рядом с динозавром, x и y — смещение)
+ * - expected: символ, с которым сравнивается клетка; 0 — не совпадает ни с чем
+ * - w, h: COUNT x y w h sym IS count — размер прямоугольника с углом (x, y);
+ *   0 — проверяется одна клетка
+ * - total: COUNT по всему полю (COUNT_SYMBOL, COUNT_COLOR), считается
+ *   по счётчикам поля; COUNT_NONE — клетка или прямоугольник
+ */
+typedef struct {
+    bool relative;
+    int x, y;
+    char expected;
+    int w, h;
+    int count;
+    int total;
+} Predicate;
+
+#define COUNT_NONE   0
+#define COUNT_SYMBOL 1  // COUNT sym IS n — клетки, которые выводятся символом sym
+#define COUNT_COLOR  2  // COUNT COLOR c IS n — клетки цвета c, в том числе под объектами
+
+// Разбирает "CELL x y IS sym", "AHEAD DIR IS sym", "COUNT x y w h sym IS n",
+// "COUNT sym IS n" или "COUNT COLOR c IS n" в начале text.
+// В *len — длина разобранной части. Возвращает false при неверном формате
+bool parse_predicate(const char* text, Predicate* p, int* len);
+
+// Разбирает остаток строки IF: "условие THEN команда".
+// В *then_offset — начало команды в rest. Возвращает false при неверном формате
+bool parse_if(const char* rest, Predicate* p, int* then_offset);
+
+// Выполнено ли условие на поле f
+bool predicate_holds(const Field* f, const Predicate* p);
+
+/**
+ * Статистика оптимизатора блоков MOVE/PAINT в текущем потоке:
+ * - lines: сколько строк выполнено блоками
+ * - removed: сколько из них не выполнялось отдельной командой
+ * - fallbacks: сколько раз на пути была яма или препятствие
+ *   и строки выполнялись по одной
+ */
+typedef struct {
+    long lines;
+    long removed;
+    long fallbacks;
+} PeepholeStats;
+
+PeepholeStats peephole_stats(void);
+
+// Визуализация после команды (если включена)
+void command_show(Field* f, const Options* opts);
+
 #endif
\ No newline at end of file
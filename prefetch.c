@@ -0,0 +1,224 @@
+#define _POSIX_C_SOURCE 200809L // fmemopen
+#include "prefetch.h"
+#include "parser.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+// Без потоков POSIX и fmemopen файлы всегда открываются напрямую
+void prefetch_start(const char* script) { (void)script; }
+
+FILE* prefetch_fopen(const char* filename) {
+    return fopen(filename, "r");
+}
+
+void prefetch_finish(void) {}
+
+#else
+
+#include <pthread.h>
+
+// Состояние файла в очереди
+typedef enum {
+    PF_QUEUED,      // Найден, ещё не читался
+    PF_READING,     // Читается потоком
+    PF_READY,       // Содержимое в памяти
+    PF_FAILED       // Прочитать не удалось (откроется обычным fopen с той же ошибкой)
+} PrefetchState;
+
+typedef struct {
+    char* name;
+    bool is_script;  // Скрипт (в нём ищутся EXEC и LOAD) или файл поля для LOAD
+    PrefetchState state;
+    char* data;
+    size_t size;
+} PrefetchEntry;
+
+static struct {
+    bool active;
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;   // Сигнал: какой-то файл дочитан
+
+    PrefetchEntry* entries; // Очередь: поток берёт файлы по порядку
+    int count;
+    int cap;
+    int next;
+} pf = { .lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER };
+
+// Добавляет файл в очередь, если его там ещё нет. Вызывается под pf.lock
+static void enqueue_locked(const char* name, bool is_script) {
+    for (int i = 0; i < pf.count; i++) {
+        if (strcmp(pf.entries[i].name, name) == 0) return;
+    }
+    if (pf.count == pf.cap) {
+        int cap = pf.cap ? pf.cap * 2 : 16;
+        PrefetchEntry* entries = realloc(pf.entries, cap * sizeof(PrefetchEntry));
+        if (!entries) return;
+        pf.entries = entries;
+        pf.cap = cap;
+    }
+    char* copy = malloc(strlen(name) + 1);
+    if (!copy) return;
+    strcpy(copy, name);
+
+    PrefetchEntry* e = &pf.entries[pf.count++];
+    e->name = copy;
+    e->is_script = is_script;
+    e->state = PF_QUEUED;
+    e->data = NULL;
+    e->size = 0;
+}
+
+// Читает файл целиком. Возвращает NULL при ошибке
+static char* read_whole_file(const char* name, size_t* size) {
+    FILE* fp = fopen(name, "rb");
+    if (!fp) return NULL;
+
+    size_t cap = 4096, used = 0;
+    char* data = malloc(cap);
+    while (data) {
+        used += fread(data + used, 1, cap - used, fp);
+        if (used < cap) break;
+        char* grown = realloc(data, cap * 2);
+        if (!grown) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        cap *= 2;
+    }
+    if (data && ferror(fp)) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    *size = used;
+    return data;
+}
+
+/**
+ * Ищет в команде имена файлов EXEC и LOAD и добавляет их в очередь.
+ * IF ... THEN команда разбирается так же, как в execute_command.
+ * Вызывается под pf.lock
+ */
+static void scan_command_locked(const char* line) {
+    char fname[256];
+    Predicate cond;
+    int then_offset;
+
+    for (int depth = 0; depth < 16; depth++) {
+        if (sscanf(line, "EXEC %255s", fname) == 1) {
+            enqueue_locked(fname, true);
+            return;
+        }
+        if (sscanf(line, "LOAD %255s", fname) == 1) {
+            enqueue_locked(fname, false);
+            return;
+        }
+        if (strncmp(line, "IF", 2) != 0) return;
+
+        const char* rest = strchr(line, ' ');
+        if (!rest || !parse_if(rest + 1, &cond, &then_offset)) return;
+        line = rest + 1 + then_offset;
+    }
+}
+
+// Разбирает скрипт построчно и ставит в очередь найденные файлы. Вызывается под pf.lock
+static void scan_script_locked(const char* data, size_t size) {
+    char line[4096];
+    size_t pos = 0;
+    while (pos < size) {
+        const char* start = data + pos;
+        const char* nl = memchr(start, '\n', size - pos);
+        size_t len = nl ? (size_t)(nl - start) : size - pos;
+        pos += len + 1;
+
+        // Строки с пробелом в начале и комментарии не выполняются
+        if (len == 0 || start[0] == ' ' || start[0] == '\t' || start[0] == '/') continue;
+        if (len >= sizeof(line)) len = sizeof(line) - 1;
+        memcpy(line, start, len);
+        line[len] = '\0';
+        scan_command_locked(line);
+    }
+}
+
+static void* prefetch_thread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&pf.lock);
+    while (!pf.stop && pf.next < pf.count) {
+        int i = pf.next++;
+        pf.entries[i].state = PF_READING;
+        char* name = pf.entries[i].name;
+        pthread_mutex_unlock(&pf.lock);
+
+        // Чтение идёт без блокировки: выполнение в это время не ждёт
+        size_t size = 0;
+        char* data = read_whole_file(name, &size);
+
+        pthread_mutex_lock(&pf.lock);
+        PrefetchEntry* e = &pf.entries[i];
+        e->data = data;
+        e->size = size;
+        e->state = data ? PF_READY : PF_FAILED;
+        if (data && e->is_script) scan_script_locked(data, size);
+        pthread_cond_broadcast(&pf.ready);
+    }
+    pthread_mutex_unlock(&pf.lock);
+    return NULL;
+}
+
+void prefetch_start(const char* script) {
+    pthread_mutex_lock(&pf.lock);
+    enqueue_locked(script, true);
+    pthread_mutex_unlock(&pf.lock);
+
+    pf.stop = false;
+    pf.active = pthread_create(&pf.thread, NULL, prefetch_thread, NULL) == 0;
+}
+
+FILE* prefetch_fopen(const char* filename) {
+    if (!pf.active) return fopen(filename, "r");
+
+    FILE* fp = NULL;
+    pthread_mutex_lock(&pf.lock);
+    for (int i = 0; i < pf.count; i++) {
+        if (strcmp(pf.entries[i].name, filename) != 0) continue;
+        // Файл в очереди или читается — ждём (поток обычно впереди выполнения)
+        while (pf.entries[i].state == PF_QUEUED || pf.entries[i].state == PF_READING) {
+            pthread_cond_wait(&pf.ready, &pf.lock);
+        }
+        PrefetchEntry* e = &pf.entries[i];
+        // Пустой файл fmemopen открыть не может — его читаем напрямую
+        if (e->state == PF_READY && e->size > 0) fp = fmemopen(e->data, e->size, "r");
+        break;
+    }
+    pthread_mutex_unlock(&pf.lock);
+
+    // Файл не найден предварительным разбором или не прочитан — обычное открытие
+    if (!fp) fp = fopen(filename, "r");
+    return fp;
+}
+
+void prefetch_finish(void) {
+    if (pf.active) {
+        pthread_mutex_lock(&pf.lock);
+        pf.stop = true;
+        pthread_mutex_unlock(&pf.lock);
+        pthread_join(pf.thread, NULL);
+        pf.active = false;
+    }
+    for (int i = 0; i < pf.count; i++) {
+        free(pf.entries[i].name);
+        free(pf.entries[i].data);
+    }
+    free(pf.entries);
+    pf.entries = NULL;
+    pf.count = pf.cap = pf.next = 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdio.h>
+
+/**
+ * Фоновая загрузка файлов EXEC и LOAD (--prefetch).
+ * prefetch_start запускает поток ввода-вывода: он читает скрипт целиком,
+ * находит в нём имена файлов EXEC и LOAD (в том числе в IF ... THEN EXEC)
+ * и так же читает их, включая вложенные. Выполнение тем временем идёт.
+ * Когда выполнение доходит до EXEC или LOAD, prefetch_fopen отдаёт уже
+ * прочитанное содержимое без обращения к диску.
+ */
+
+// Запускает фоновую загрузку, начиная со скрипта script
+void prefetch_start(const char* script);
+
+/**
+ * Открывает файл для чтения: из загруженного содержимого, если фоновая
+ * загрузка включена и нашла этот файл, иначе — обычным fopen.
+ * Если файл ещё читается, ждёт окончания чтения.
+ */
+FILE* prefetch_fopen(const char* filename);
+
+// Останавливает поток и освобождает загруженное содержимое
+void prefetch_finish(void);
+
+#endif
@@ -0,0 +1,369 @@
+#include "profiler.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Статистика одной строки файла.
+ * active — сколько раз строка сейчас находится в стеке (рекурсивный EXEC):
+ * полное время добавляется только при выходе из самого внешнего вызова,
+ * чтобы не считать одно и то же время дважды.
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t inclusive_ns;
+    uint64_t exclusive_ns;
+    int active;
+} LineStats;
+
+/**
+ * Файл, который встречался при выполнении.
+ * lines[i] — статистика строки с номером i (нумерация с 1, элемент 0 не используется).
+ */
+typedef struct {
+    char* name;
+    LineStats* lines;
+    int lines_cap;
+} ProfFile;
+
+/**
+ * Узел дерева вызовов: строка в конкретном стеке вложенных EXEC.
+ * parent == -1 у строк верхнего уровня.
+ */
+typedef struct {
+    int parent;
+    int file_id;
+    int line;
+    uint64_t exclusive_ns;
+} ProfNode;
+
+/**
+ * Активная строка в стеке выполнения.
+ */
+typedef struct {
+    int file_id;
+    int line;
+    int node;
+    uint64_t start_ns;
+    uint64_t child_ns;   // Время вложенных строк (EXEC)
+} ProfFrame;
+
+struct Profiler {
+    ProfFile* files;
+    int file_count;
+    int file_cap;
+
+    ProfNode* nodes;
+    int node_count;
+    int node_cap;
+
+    // Хеш-таблица (parent, file, line) -> узел, открытая адресация
+    int* node_index;
+    int index_cap;       // Всегда степень двойки
+
+    ProfFrame* stack;
+    int depth;
+    int stack_cap;
+    int dropped;         // Вложенные строки, для которых не хватило места в стеке
+};
+
+Profiler* profiler_create(void) {
+    Profiler* p = calloc(1, sizeof(Profiler));
+    if (!p) return NULL;
+
+    p->index_cap = 1024;
+    p->node_index = malloc(p->index_cap * sizeof(int));
+    if (!p->node_index) {
+        free(p);
+        return NULL;
+    }
+    memset(p->node_index, -1, p->index_cap * sizeof(int));
+    return p;
+}
+
+int profiler_file_id(Profiler* p, const char* filename) {
+    // Файлов обычно немного, линейный поиск выполняется один раз на открытие файла
+    for (int i = 0; i < p->file_count; i++) {
+        if (strcmp(p->files[i].name, filename) == 0) return i;
+    }
+
+    if (p->file_count == p->file_cap) {
+        int cap = p->file_cap ? p->file_cap * 2 : 8;
+        ProfFile* files = realloc(p->files, cap * sizeof(ProfFile));
+        if (!files) return -1;
+        p->files = files;
+        p->file_cap = cap;
+    }
+
+    char* name = malloc(strlen(filename) + 1);
+    if (!name) return -1;
+    strcpy(name, filename);
+
+    ProfFile* pf = &p->files[p->file_count];
+    pf->name = name;
+    pf->lines = NULL;
+    pf->lines_cap = 0;
+    return p->file_count++;
+}
+
+/**
+ * Возвращает статистику строки line, при необходимости расширяя массив.
+ */
+static LineStats* line_stats(Profiler* p, int file_id, int line) {
+    ProfFile* pf = &p->files[file_id];
+    if (line >= pf->lines_cap) {
+        int cap = pf->lines_cap ? pf->lines_cap : 64;
+        while (cap <= line) cap *= 2;
+        LineStats* lines = realloc(pf->lines, cap * sizeof(LineStats));
+        if (!lines) return NULL;
+        memset(lines + pf->lines_cap, 0, (cap - pf->lines_cap) * sizeof(LineStats));
+        pf->lines = lines;
+        pf->lines_cap = cap;
+    }
+    return &pf->lines[line];
+}
+
+static unsigned node_hash(int parent, int file_id, int line) {
+    unsigned h = (unsigned)parent * 2654435761u;
+    h ^= (unsigned)file_id * 40503u + (unsigned)line * 2246822519u;
+    h ^= h >> 15;
+    return h;
+}
+
+/**
+ * Увеличивает хеш-таблицу узлов вдвое и перераскладывает узлы.
+ */
+static bool grow_node_index(Profiler* p) {
+    int cap = p->index_cap * 2;
+    int* index = malloc(cap * sizeof(int));
+    if (!index) return false;
+    memset(index, -1, cap * sizeof(int));
+
+    for (int i = 0; i < p->node_count; i++) {
+        ProfNode* n = &p->nodes[i];
+        unsigned slot = node_hash(n->parent, n->file_id, n->line) & (cap - 1);
+        while (index[slot] != -1) slot = (slot + 1) & (cap - 1);
+        index[slot] = i;
+    }
+
+    free(p->node_index);
+    p->node_index = index;
+    p->index_cap = cap;
+    return true;
+}
+
+/**
+ * Находит или создаёт узел дерева вызовов. Возвращает -1 при нехватке памяти.
+ */
+static int find_node(Profiler* p, int parent, int file_id, int line) {
+    unsigned mask = p->index_cap - 1;
+    unsigned slot = node_hash(parent, file_id, line) & mask;
+    while (p->node_index[slot] != -1) {
+        ProfNode* n = &p->nodes[p->node_index[slot]];
+        if (n->parent == parent && n->file_id == file_id && n->line == line) {
+            return p->node_index[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    // Узла нет — создаём новый (таблица заполнена не больше чем наполовину)
+    if ((p->node_count + 1) * 2 > p->index_cap) {
+        if (!grow_node_index(p)) return -1;
+        return find_node(p, parent, file_id, line);
+    }
+    if (p->node_count == p->node_cap) {
+        int cap = p->node_cap ? p->node_cap * 2 : 256;
+        ProfNode* nodes = realloc(p->nodes, cap * sizeof(ProfNode));
+        if (!nodes) return -1;
+        p->nodes = nodes;
+        p->node_cap = cap;
+    }
+
+    int id = p->node_count++;
+    p->nodes[id].parent = parent;
+    p->nodes[id].file_id = file_id;
+    p->nodes[id].line = line;
+    p->nodes[id].exclusive_ns = 0;
+    p->node_index[slot] = id;
+    return id;
+}
+
+void profiler_enter(Profiler* p, int file_id, int line) {
+    // Внутри пропущенной строки пропускаются и вложенные, чтобы leave снимал их по порядку
+    if (p->dropped > 0) {
+        p->dropped++;
+        return;
+    }
+    if (p->depth == p->stack_cap) {
+        int cap = p->stack_cap ? p->stack_cap * 2 : 16;
+        ProfFrame* stack = realloc(p->stack, cap * sizeof(ProfFrame));
+        if (!stack) {
+            p->dropped++;
+            return;
+        }
+        p->stack = stack;
+        p->stack_cap = cap;
+    }
+
+    int parent = p->depth > 0 ? p->stack[p->depth - 1].node : -1;
+
+    ProfFrame* fr = &p->stack[p->depth++];
+    fr->file_id = file_id;
+    fr->line = line;
+    fr->node = file_id >= 0 ? find_node(p, parent, file_id, line) : -1;
+    fr->child_ns = 0;
+
+    LineStats* ls = file_id >= 0 ? line_stats(p, file_id, line) : NULL;
+    if (ls) ls->active++;
+
+    // Время берём последним, чтобы учёт профилировщика не попал в строку
+    fr->start_ns = monotonic_ns();
+}
+
+void profiler_leave(Profiler* p) {
+    uint64_t now = monotonic_ns();
+    if (p->dropped > 0) {
+        p->dropped--;
+        return;
+    }
+    if (p->depth == 0) return;
+
+    ProfFrame* fr = &p->stack[--p->depth];
+    uint64_t elapsed = now - fr->start_ns;
+    uint64_t own = elapsed > fr->child_ns ? elapsed - fr->child_ns : 0;
+
+    if (fr->file_id >= 0) {
+        LineStats* ls = line_stats(p, fr->file_id, fr->line);
+        if (ls) {
+            ls->count++;
+            ls->exclusive_ns += own;
+            if (--ls->active == 0) ls->inclusive_ns += elapsed;
+        }
+    }
+    if (fr->node >= 0) p->nodes[fr->node].exclusive_ns += own;
+
+    // Всё время этой строки — вложенное для строки уровнем выше
+    if (p->depth > 0) p->stack[p->depth - 1].child_ns += elapsed;
+}
+
+/**
+ * Строка отчёта для сортировки.
+ */
+typedef struct {
+    int file_id;
+    int line;
+    const LineStats* stats;
+} ReportRow;
+
+static int compare_rows(const void* a, const void* b) {
+    const ReportRow* ra = a;
+    const ReportRow* rb = b;
+    if (ra->stats->exclusive_ns != rb->stats->exclusive_ns)
+        return ra->stats->exclusive_ns < rb->stats->exclusive_ns ? 1 : -1;
+    if (ra->stats->inclusive_ns != rb->stats->inclusive_ns)
+        return ra->stats->inclusive_ns < rb->stats->inclusive_ns ? 1 : -1;
+    if (ra->file_id != rb->file_id) return ra->file_id - rb->file_id;
+    return ra->line - rb->line;
+}
+
+bool profiler_write_report(Profiler* p, const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) return false;
+
+    // Собираем все выполнявшиеся строки
+    int total = 0;
+    for (int i = 0; i < p->file_count; i++) {
+        for (int l = 0; l < p->files[i].lines_cap; l++) {
+            if (p->files[i].lines[l].count) total++;
+        }
+    }
+    ReportRow* rows = malloc((total ? total : 1) * sizeof(ReportRow));
+    if (!rows) {
+        fclose(fp);
+        return false;
+    }
+
+    int n = 0;
+    uint64_t total_ns = 0;
+    for (int i = 0; i < p->file_count; i++) {
+        for (int l = 0; l < p->files[i].lines_cap; l++) {
+            const LineStats* ls = &p->files[i].lines[l];
+            if (!ls->count) continue;
+            rows[n].file_id = i;
+            rows[n].line = l;
+            rows[n].stats = ls;
+            total_ns += ls->exclusive_ns;
+            n++;
+        }
+    }
+    qsort(rows, n, sizeof(ReportRow), compare_rows);
+
+    fprintf(fp, "# total %.3f ms, %d lines\n", total_ns / 1e6, n);
+    fprintf(fp, "%12s %12s %7s %12s  %s\n", "self_ms", "total_ms", "self%", "count", "file:line");
+    for (int i = 0; i < n; i++) {
+        const LineStats* ls = rows[i].stats;
+        fprintf(fp, "%12.3f %12.3f %6.2f%% %12llu  %s:%d\n",
+                ls->exclusive_ns / 1e6, ls->inclusive_ns / 1e6,
+                total_ns ? 100.0 * ls->exclusive_ns / total_ns : 0.0,
+                (unsigned long long)ls->count,
+                p->files[rows[i].file_id].name, rows[i].line);
+    }
+
+    free(rows);
+    fclose(fp);
+    return true;
+}
+
+bool profiler_write_folded(Profiler* p, const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) return false;
+
+    int* path = NULL;
+    int path_cap = 0;
+
+    for (int i = 0; i < p->node_count; i++) {
+        if (p->nodes[i].exclusive_ns == 0) continue;
+
+        // Поднимаемся к корню, собирая путь (от листа к корню)
+        int len = 0;
+        for (int n = i; n != -1; n = p->nodes[n].parent) {
+            if (len == path_cap) {
+                int cap = path_cap ? path_cap * 2 : 32;
+                int* grown = realloc(path, cap * sizeof(int));
+                if (!grown) {
+                    free(path);
+                    fclose(fp);
+                    return false;
+                }
+                path = grown;
+                path_cap = cap;
+            }
+            path[len++] = n;
+        }
+
+        // Выводим от корня к листу
+        for (int k = len - 1; k >= 0; k--) {
+            const ProfNode* node = &p->nodes[path[k]];
+            fprintf(fp, "%s:%d%c", p->files[node->file_id].name, node->line, k ? ';' : ' ');
+        }
+        fprintf(fp, "%llu\n", (unsigned long long)p->nodes[i].exclusive_ns);
+    }
+
+    free(path);
+    fclose(fp);
+    return true;
+}
+
+void profiler_free(Profiler* p) {
+    if (!p) return;
+    for (int i = 0; i < p->file_count; i++) {
+        free(p->files[i].name);
+        free(p->files[i].lines);
+    }
+    free(p->files);
+    free(p->nodes);
+    free(p->node_index);
+    free(p->stack);
+    free(p);
+}
@@ -0,0 +1,57 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Профилировщик строк скрипта (режим --profile).
+ * Для каждой пары (файл, строка) считает:
+ * - count: сколько раз выполнялась строка;
+ * - inclusive: полное время строки, включая вложенные EXEC и IF;
+ * - exclusive: время самой строки без вложенных строк.
+ * Дополнительно строит дерево вызовов для collapsed-stack отчёта
+ * (формат flamegraph.pl / speedscope / inferno).
+ */
+typedef struct Profiler Profiler;
+
+/**
+ * Создаёт пустой профилировщик. Возвращает NULL при нехватке памяти.
+ */
+Profiler* profiler_create(void);
+
+/**
+ * Возвращает номер файла для имени filename (регистрирует его при первом вызове).
+ * Возвращает -1 при нехватке памяти.
+ */
+int profiler_file_id(Profiler* p, const char* filename);
+
+/**
+ * Отмечает начало выполнения строки line файла file_id.
+ * Вызовы могут быть вложенными (EXEC внутри строки).
+ */
+void profiler_enter(Profiler* p, int file_id, int line);
+
+/**
+ * Отмечает конец строки, начатой последним profiler_enter.
+ */
+void profiler_leave(Profiler* p);
+
+/**
+ * Записывает текстовый отчёт, отсортированный по собственному времени строк.
+ * Возвращает false, если файл не удалось открыть.
+ */
+bool profiler_write_report(Profiler* p, const char* filename);
+
+/**
+ * Записывает collapsed-stack файл: "файл:строка;файл:строка наносекунды".
+ * Возвращает false, если файл не удалось открыть.
+ */
+bool profiler_write_folded(Profiler* p, const char* filename);
+
+/**
+ * Освобождает память профилировщика.
+ */
+void profiler_free(Profiler* p);
+
+#endif
@@ -0,0 +1,222 @@
+#include "shmexport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>    // Для O_* констант
+    #include <sys/mman.h> // Для shm_open(), mmap()
+    #include <sys/stat.h>
+    #include <time.h>     // Для nanosleep()
+    #include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+// Разделяемая память POSIX на Windows не поддерживается
+ShmExport* shm_export_create(const char* name) {
+    (void)name;
+    fprintf(stderr, "ОШИБКА: --shm не поддерживается на этой платформе\n");
+    return NULL;
+}
+
+void shm_export_begin(ShmExport* s) { (void)s; }
+
+void shm_export_end(ShmExport* s, Field* f, int file_id, const char* filename, int line) {
+    (void)s; (void)f; (void)file_id; (void)filename; (void)line;
+}
+
+void shm_export_close(ShmExport* s) { (void)s; }
+
+int shm_watch(const char* name, long samples, int interval_ms, bool show_field) {
+    (void)name; (void)samples; (void)interval_ms; (void)show_field;
+    fprintf(stderr, "ОШИБКА: --shm-watch не поддерживается на этой платформе\n");
+    return 1;
+}
+
+#else
+
+struct ShmExport {
+    ShmState* state;
+    int file_id;                    // Файл, имя которого сейчас записано в state->file
+    char name[SHM_FILE_NAME_MAX];
+};
+
+ShmExport* shm_export_create(const char* name) {
+    ShmExport* s = calloc(1, sizeof(ShmExport));
+    if (!s) return NULL;
+
+    // Имя сегмента POSIX должно начинаться с '/'
+    snprintf(s->name, sizeof(s->name), "%s%s", name[0] == '/' ? "" : "/", name);
+
+    int fd = shm_open(s->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(ShmState)) != 0) {
+        fprintf(stderr, "ОШИБКА: Невозможно создать разделяемую память '%s'\n", s->name);
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(s->name);
+        }
+        free(s);
+        return NULL;
+    }
+    s->state = mmap(NULL, sizeof(ShmState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s->state == MAP_FAILED) {
+        fprintf(stderr, "ОШИБКА: Невозможно отобразить разделяемую память '%s'\n", s->name);
+        shm_unlink(s->name);
+        free(s);
+        return NULL;
+    }
+
+    // ftruncate заполнил сегмент нулями; magic пишется последним
+    s->file_id = -1;
+    s->state->version = SHM_STATE_VERSION;
+    atomic_store_explicit(&s->state->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s->state->magic = SHM_STATE_MAGIC;
+    return s;
+}
+
+void shm_export_begin(ShmExport* s) {
+    uint32_t seq = atomic_load_explicit(&s->state->seq, memory_order_relaxed);
+    if (seq & 1) return;
+    atomic_store_explicit(&s->state->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void shm_export_end(ShmExport* s, Field* f, int file_id, const char* filename, int line) {
+    ShmState* st = s->state;
+
+    // После вложенного EXEC запись уже закрыта — открываем её снова
+    shm_export_begin(s);
+    uint32_t seq = atomic_load_explicit(&st->seq, memory_order_relaxed);
+
+    // Поле только что создано (SIZE/LOAD): дальше команды пишут прямо в сегмент
+    if (f->field_created && !f->shared_cells) {
+        field_attach_cells(f, st->cells);
+        st->width = f->width;
+        st->height = f->height;
+    }
+    // Имя файла копируется только при переходе в другой файл
+    if (file_id != s->file_id) {
+        snprintf(st->file, sizeof(st->file), "%s", filename);
+        s->file_id = file_id;
+    }
+
+    st->dino_x = f->dino_x;
+    st->dino_y = f->dino_y;
+    st->dino_placed = f->dino_placed;
+    st->line = line;
+    st->commands++;
+
+    atomic_store_explicit(&st->seq, seq + 1, memory_order_release);
+}
+
+void shm_export_close(ShmExport* s) {
+    if (!s) return;
+
+    shm_export_begin(s);
+    uint32_t seq = atomic_load_explicit(&s->state->seq, memory_order_relaxed);
+    s->state->finished = 1;
+    atomic_store_explicit(&s->state->seq, seq + 1, memory_order_release);
+
+    // Уже подключённые читатели сохраняют отображение и видят итоговое состояние
+    munmap(s->state, sizeof(ShmState));
+    shm_unlink(s->name);
+    free(s);
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * Согласованная копия сегмента: повторяет чтение, пока писатель не закончит
+ * запись. Копируются только width * height клеток.
+ */
+static void read_state(const ShmState* st, ShmState* out) {
+    for (int spins = 0;; spins++) {
+        uint32_t s1 = atomic_load_explicit(&((ShmState*)st)->seq, memory_order_acquire);
+        if (s1 & 1) {
+            // Команда может долго ждать (--interval) — не занимаем процессор
+            if (spins > 1000) sleep_ms(1);
+            continue;
+        }
+
+        out->finished = st->finished;
+        out->width = st->width;
+        out->height = st->height;
+        out->dino_x = st->dino_x;
+        out->dino_y = st->dino_y;
+        out->dino_placed = st->dino_placed;
+        out->line = st->line;
+        out->commands = st->commands;
+        memcpy(out->file, st->file, sizeof(out->file));
+        int w = out->width, h = out->height;
+        if (w > 0 && h > 0 && w <= MAX_WIDTH && h <= MAX_HEIGHT) {
+            memcpy(out->cells, st->cells, (size_t)w * h);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t s2 = atomic_load_explicit(&((ShmState*)st)->seq, memory_order_relaxed);
+        if (s1 == s2) return;
+    }
+}
+
+int shm_watch(const char* name, long samples, int interval_ms, bool show_field) {
+    char path[SHM_FILE_NAME_MAX];
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(ShmState)) {
+        fprintf(stderr, "ОШИБКА: Невозможно открыть разделяемую память '%s'\n", path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    const ShmState* st = mmap(NULL, sizeof(ShmState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (st == MAP_FAILED || st->magic != SHM_STATE_MAGIC || st->version != SHM_STATE_VERSION) {
+        fprintf(stderr, "ОШИБКА: '%s' не является сегментом состояния dino\n", path);
+        if (st != MAP_FAILED) munmap((void*)st, sizeof(ShmState));
+        return 1;
+    }
+
+    ShmState* snap = malloc(sizeof(ShmState));
+    if (!snap) {
+        munmap((void*)st, sizeof(ShmState));
+        return 1;
+    }
+
+    for (long n = 0; samples <= 0 || n < samples; n++) {
+        read_state(st, snap);
+
+        printf("команд: %llu  строка: %s:%d  ",
+               (unsigned long long)snap->commands, snap->file[0] ? snap->file : "-", snap->line);
+        if (snap->dino_placed) printf("динозавр: %d %d\n", snap->dino_x, snap->dino_y);
+        else printf("динозавр: -\n");
+
+        if (show_field && snap->width > 0) {
+            for (int y = 0; y < snap->height; y++) {
+                for (int x = 0; x < snap->width; x++) {
+                    putchar(cell_display(snap->cells[y * snap->width + x]));
+                }
+                putchar('\n');
+            }
+        }
+        fflush(stdout);
+
+        if (snap->finished) {
+            printf("выполнение завершено\n");
+            break;
+        }
+        sleep_ms(interval_ms);
+    }
+
+    free(snap);
+    munmap((void*)st, sizeof(ShmState));
+    return 0;
+}
+
+#endif
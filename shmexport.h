@@ -0,0 +1,59 @@
+#ifndef SHMEXPORT_H
+#define SHMEXPORT_H
+
+#include "field.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SHM_STATE_MAGIC   0x4F4E4944u  // "DINO" в памяти little-endian
+#define SHM_STATE_VERSION 1
+#define SHM_FILE_NAME_MAX 256
+
+/**
+ * Содержимое сегмента разделяемой памяти (--shm NAME).
+ * Публикуется через seqlock: seq нечётный, пока интерпретатор меняет данные.
+ * Читатель копирует данные и повторяет чтение, если seq был нечётным
+ * или изменился за время копирования. Писатель читателей не ждёт.
+ * cells — клетки текущего поля по строкам (width * height байт, формат Cell);
+ * интерпретатор меняет их на месте, без отдельного копирования.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint32_t seq;
+    uint32_t finished;      // 1 — выполнение завершено
+    int32_t width;          // 0, пока поле не создано
+    int32_t height;
+    int32_t dino_x;
+    int32_t dino_y;
+    int32_t dino_placed;
+    int32_t line;           // Строка последней выполненной команды
+    uint64_t commands;      // Сколько команд выполнено
+    char file[SHM_FILE_NAME_MAX];  // Файл последней выполненной команды
+    Cell cells[MAX_WIDTH * MAX_HEIGHT];
+} ShmState;
+
+typedef struct ShmExport ShmExport;
+
+// Создаёт сегмент name (например "/dino"). Возвращает NULL при ошибке
+ShmExport* shm_export_create(const char* name);
+
+// Начало команды: seq становится нечётным (во вложенном EXEC — уже нечётный)
+void shm_export_begin(ShmExport* s);
+
+// Конец команды: обновляет позицию, строку и счётчик, seq становится чётным.
+// При первом вызове после SIZE/LOAD клетки поля переносятся в сегмент
+void shm_export_end(ShmExport* s, Field* f, int file_id, const char* filename, int line);
+
+// Отмечает завершение, отключается от сегмента и удаляет его имя
+void shm_export_close(ShmExport* s);
+
+/**
+ * Подключается к сегменту name и выводит состояние каждые interval_ms
+ * миллисекунд: samples раз (0 — пока выполнение не завершится).
+ * show_field — выводить ли само поле. Возвращает код завершения программы.
+ */
+int shm_watch(const char* name, long samples, int interval_ms, bool show_field);
+
+#endif
@@ -0,0 +1,159 @@
+#include "snapshot.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Записывает снимок во временный файл и переименовывает его в path
+static bool write_atomically(Field* f, const char* path, FieldFormat format) {
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (!save_field_as(f, tmp, format)) return false;
+#ifdef _WIN32
+    remove(path); // rename в Windows не заменяет существующий файл
+#endif
+    if (rename(tmp, path) != 0) {
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+
+// Без потоков POSIX снимок записывается сразу
+void snapshot_save(const Field* f, const char* path, FieldFormat format) {
+    if (!write_atomically((Field*)f, path, format)) {
+        fprintf(stderr, "ОШИБКА: Невозможно записать снимок '%s'\n", path);
+    }
+}
+
+void snapshot_finish(void) {}
+
+#else
+
+#include <pthread.h>
+
+// Состояние буфера снимка
+typedef enum {
+    SLOT_FREE,      // Можно заполнять
+    SLOT_PENDING,   // Заполнен, ждёт записи
+    SLOT_WRITING    // Записывается потоком
+} SlotState;
+
+typedef struct {
+    SlotState state;
+    char path[256];
+    FieldFormat format;
+    Field view;                 // Размеры и динозавр; grid указывает на rows
+    Cell* rows[MAX_HEIGHT];
+    Cell cells[MAX_WIDTH * MAX_HEIGHT];
+} SnapshotSlot;
+
+static struct {
+    bool active;
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // Буфер заполнен или освободился
+    SnapshotSlot slots[2];
+    unsigned long order;        // Номер последнего заполненного буфера
+    unsigned long slot_order[2];
+} snap = { .lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER };
+
+// Самый ранний из ждущих записи буферов или -1. Вызывается под snap.lock
+static int next_pending_locked(void) {
+    int best = -1;
+    for (int i = 0; i < 2; i++) {
+        if (snap.slots[i].state != SLOT_PENDING) continue;
+        if (best < 0 || snap.slot_order[i] < snap.slot_order[best]) best = i;
+    }
+    return best;
+}
+
+static void* snapshot_thread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&snap.lock);
+    for (;;) {
+        int i = next_pending_locked();
+        if (i < 0) {
+            if (snap.stop) break;
+            pthread_cond_wait(&snap.changed, &snap.lock);
+            continue;
+        }
+        SnapshotSlot* s = &snap.slots[i];
+        s->state = SLOT_WRITING;
+        pthread_mutex_unlock(&snap.lock);
+
+        // Запись идёт без блокировки: выполнение в это время заполняет другой буфер
+        if (!write_atomically(&s->view, s->path, s->format)) {
+            fprintf(stderr, "ОШИБКА: Невозможно записать снимок '%s'\n", s->path);
+        }
+
+        pthread_mutex_lock(&snap.lock);
+        s->state = SLOT_FREE;
+        pthread_cond_broadcast(&snap.changed);
+    }
+    pthread_mutex_unlock(&snap.lock);
+    return NULL;
+}
+
+// Копирует поле в буфер
+static void fill_slot(SnapshotSlot* s, const Field* f, const char* path, FieldFormat format) {
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    s->format = format;
+    s->view = *f;
+    s->view.grid = s->rows;
+    s->view.shared_cells = true;
+    for (int y = 0; y < f->height; y++) {
+        s->rows[y] = s->cells + y * f->width;
+        memcpy(s->rows[y], f->grid[y], f->width * sizeof(Cell));
+    }
+}
+
+void snapshot_save(const Field* f, const char* path, FieldFormat format) {
+    pthread_mutex_lock(&snap.lock);
+    if (!snap.active) {
+        snap.stop = false;
+        snap.active = pthread_create(&snap.thread, NULL, snapshot_thread, NULL) == 0;
+        if (!snap.active) {
+            // Поток не создан — пишем сразу
+            pthread_mutex_unlock(&snap.lock);
+            if (!write_atomically((Field*)f, path, format)) {
+                fprintf(stderr, "ОШИБКА: Невозможно записать снимок '%s'\n", path);
+            }
+            return;
+        }
+    }
+
+    int slot = -1;
+    for (;;) {
+        // Ждущий снимок того же файла устарел — заменяем его
+        for (int i = 0; i < 2 && slot < 0; i++) {
+            if (snap.slots[i].state == SLOT_PENDING && strcmp(snap.slots[i].path, path) == 0) slot = i;
+        }
+        for (int i = 0; i < 2 && slot < 0; i++) {
+            if (snap.slots[i].state == SLOT_FREE) slot = i;
+        }
+        if (slot >= 0) break;
+        pthread_cond_wait(&snap.changed, &snap.lock);
+    }
+
+    fill_slot(&snap.slots[slot], f, path, format);
+    snap.slots[slot].state = SLOT_PENDING;
+    snap.slot_order[slot] = ++snap.order;
+    pthread_cond_broadcast(&snap.changed);
+    pthread_mutex_unlock(&snap.lock);
+}
+
+void snapshot_finish(void) {
+    if (!snap.active) return;
+    pthread_mutex_lock(&snap.lock);
+    snap.stop = true;
+    pthread_cond_broadcast(&snap.changed);
+    pthread_mutex_unlock(&snap.lock);
+    // Поток завершается, когда запишет все ждущие снимки
+    pthread_join(snap.thread, NULL);
+    snap.active = false;
+}
+
+#endif
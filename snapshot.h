@@ -0,0 +1,22 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "field.h"
+
+/**
+ * Промежуточные снимки поля (команда SAVE и опция --snapshot-every).
+ * snapshot_save копирует клетки в один из двух буферов и сразу возвращается;
+ * файл записывает фоновый поток. Снимок пишется во временный файл
+ * path.tmp и переименовывается в path, поэтому в path всегда лежит
+ * целый снимок — прежний или новый.
+ * Если для того же файла уже ждёт запись, она заменяется новым снимком.
+ * Выполнение ждёт только когда оба буфера заняты снимками разных файлов.
+ */
+
+// Ставит в очередь снимок поля f в файл path в формате format
+void snapshot_save(const Field* f, const char* path, FieldFormat format);
+
+// Дожидается записи всех снимков и останавливает поток
+void snapshot_finish(void);
+
+#endif
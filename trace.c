@@ -0,0 +1,652 @@
+#include "trace.h"
+#include "utils.h"
+#include "viewport.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAGIC       "DINOTRC1"
+#define TRACE_INDEX_MAGIC "DINOTIDX"
+#define TRACE_VERSION     1
+#define TRACE_CELLS       (MAX_WIDTH * MAX_HEIGHT)
+
+/**
+ * Формат файла: заголовок (магия, версия u32, интервал кадров u32),
+ * затем записи; запись начинается с байта типа:
+ * - 'D' — изменение одной строки: число клеток (varint), для каждой —
+ *   пропуск от предыдущей (varint) и XOR клетки (u8), затем XOR
+ *   координат динозавра и флагов (по u8);
+ * - 'K' — полный кадр после изменения той же строки (каждые N строк);
+ * - 'R' — полный кадр вместо изменения (первая запись и новый размер поля);
+ * - 'I' — оглавление: число строк (u64), число кадров (u64),
+ *   пары (строка u64, смещение записи u64).
+ * Кадр: номер строки (u64), ширина, высота, x и y динозавра, флаги (по u8)
+ * и клетки по строкам (ширина 0 — поле ещё не создано).
+ * Файл заканчивается смещением оглавления (u64) и магией TRACE_INDEX_MAGIC.
+ * Числа — little-endian.
+ */
+#define REC_DELTA 'D'
+#define REC_KEY   'K'
+#define REC_RESET 'R'
+#define REC_INDEX 'I'
+
+#define FRAME_CREATED 1
+#define FRAME_PLACED  2
+
+typedef struct {
+    uint64_t cmd;
+    uint64_t offset;
+} KeyEntry;
+
+// Состояние поля в записи: клетки подряд по строкам
+typedef struct {
+    int width, height; // 0, если поле ещё не создано
+    int dino_x, dino_y;
+    unsigned flags;    // FRAME_CREATED, FRAME_PLACED
+    Cell cells[TRACE_CELLS];
+} Frame;
+
+static void frame_capture(Frame* fr, const Field* f) {
+    fr->width = f->field_created ? f->width : 0;
+    fr->height = f->field_created ? f->height : 0;
+    fr->dino_x = f->dino_x;
+    fr->dino_y = f->dino_y;
+    fr->flags = (f->field_created ? FRAME_CREATED : 0) | (f->dino_placed ? FRAME_PLACED : 0);
+    for (int y = 0; y < fr->height; y++) {
+        memcpy(fr->cells + (size_t)y * fr->width, f->grid[y], fr->width);
+    }
+}
+
+// =============== Запись ===============
+
+struct Trace {
+    FILE* fp;
+    long every;          // Интервал полных кадров
+    uint64_t cmd;        // Записано строк
+    uint64_t offset;     // Размер уже записанного
+    bool failed;
+    KeyEntry* keys;      // Полные кадры для оглавления
+    size_t key_count, key_cap;
+    Frame prev;          // Состояние после последней записанной строки
+    unsigned char buf[TRACE_CELLS * 4]; // Клетки изменения
+};
+
+static void out_bytes(Trace* t, const void* p, size_t n) {
+    if (fwrite(p, 1, n, t->fp) != n) t->failed = true;
+    t->offset += n;
+}
+
+static void out_u8(Trace* t, unsigned v) {
+    unsigned char c = (unsigned char)v;
+    out_bytes(t, &c, 1);
+}
+
+static void out_u32(Trace* t, uint32_t v) {
+    unsigned char c[4];
+    for (int i = 0; i < 4; i++) c[i] = (unsigned char)(v >> (8 * i));
+    out_bytes(t, c, 4);
+}
+
+static void out_u64(Trace* t, uint64_t v) {
+    out_u32(t, (uint32_t)v);
+    out_u32(t, (uint32_t)(v >> 32));
+}
+
+// Пишет v в p, возвращает число байт
+static size_t put_varint(unsigned char* p, uint64_t v) {
+    size_t n = 0;
+    do {
+        p[n] = v & 0x7F;
+        v >>= 7;
+        if (v) p[n] |= 0x80;
+        n++;
+    } while (v);
+    return n;
+}
+
+// Пишет полный кадр t->prev и добавляет его в оглавление
+static void write_frame(Trace* t, int tag) {
+    if (t->key_count == t->key_cap) {
+        size_t cap = t->key_cap ? t->key_cap * 2 : 256;
+        KeyEntry* keys = realloc(t->keys, cap * sizeof(KeyEntry));
+        if (!keys) {
+            t->failed = true;
+            return;
+        }
+        t->keys = keys;
+        t->key_cap = cap;
+    }
+    t->keys[t->key_count].cmd = t->cmd;
+    t->keys[t->key_count].offset = t->offset;
+    t->key_count++;
+
+    const Frame* fr = &t->prev;
+    out_u8(t, tag);
+    out_u64(t, t->cmd);
+    out_u8(t, fr->width);
+    out_u8(t, fr->height);
+    out_u8(t, fr->dino_x);
+    out_u8(t, fr->dino_y);
+    out_u8(t, fr->flags);
+    out_bytes(t, fr->cells, (size_t)fr->width * fr->height);
+}
+
+Trace* trace_open(const char* path, long keyframe_every, const Field* f) {
+    Trace* t = calloc(1, sizeof(Trace));
+    if (!t) return NULL;
+    t->fp = fopen(path, "wb");
+    if (!t->fp) {
+        free(t);
+        return NULL;
+    }
+    setvbuf(t->fp, NULL, _IOFBF, 1 << 20);
+    t->every = keyframe_every > 0 ? keyframe_every : 1;
+
+    out_bytes(t, TRACE_MAGIC, 8);
+    out_u32(t, TRACE_VERSION);
+    out_u32(t, (uint32_t)t->every);
+    frame_capture(&t->prev, f);
+    write_frame(t, REC_RESET);
+    return t;
+}
+
+void trace_step(Trace* t, const Field* f) {
+    Frame* prev = &t->prev;
+    t->cmd++;
+
+    int w = f->field_created ? f->width : 0;
+    int h = f->field_created ? f->height : 0;
+    if (w != prev->width || h != prev->height) {
+        frame_capture(prev, f);
+        write_frame(t, REC_RESET);
+        return;
+    }
+
+    // Сравниваем строки целиком, клетки — только в изменившихся строках
+    size_t len = 0, count = 0;
+    int next = 0;
+    for (int y = 0; y < h; y++) {
+        const Cell* row = f->grid[y];
+        Cell* old = prev->cells + (size_t)y * w;
+        if (memcmp(row, old, w) == 0) continue;
+        for (int x = 0; x < w; x++) {
+            if (row[x] == old[x]) continue;
+            int i = y * w + x;
+            len += put_varint(t->buf + len, (uint64_t)(i - next));
+            t->buf[len++] = row[x] ^ old[x];
+            old[x] = row[x];
+            next = i + 1;
+            count++;
+        }
+    }
+
+    unsigned flags = (f->field_created ? FRAME_CREATED : 0) | (f->dino_placed ? FRAME_PLACED : 0);
+    unsigned char head[11];
+    head[0] = REC_DELTA;
+    out_bytes(t, head, 1 + put_varint(head + 1, count));
+    out_bytes(t, t->buf, len);
+    out_u8(t, (prev->dino_x ^ f->dino_x) & 0xFF);
+    out_u8(t, (prev->dino_y ^ f->dino_y) & 0xFF);
+    out_u8(t, prev->flags ^ flags);
+    prev->dino_x = f->dino_x;
+    prev->dino_y = f->dino_y;
+    prev->flags = flags;
+
+    if (t->cmd % (uint64_t)t->every == 0) write_frame(t, REC_KEY);
+}
+
+bool trace_close(Trace* t) {
+    if (!t) return true;
+    uint64_t index = t->offset;
+    out_u8(t, REC_INDEX);
+    out_u64(t, t->cmd);
+    out_u64(t, t->key_count);
+    for (size_t i = 0; i < t->key_count; i++) {
+        out_u64(t, t->keys[i].cmd);
+        out_u64(t, t->keys[i].offset);
+    }
+    out_u64(t, index);
+    out_bytes(t, TRACE_INDEX_MAGIC, 8);
+
+    bool ok = !t->failed;
+    if (fclose(t->fp) != 0) ok = false;
+    free(t->keys);
+    free(t);
+    return ok;
+}
+
+// =============== Чтение ===============
+
+typedef struct {
+    FILE* fp;
+    uint64_t pos; // Позиция чтения в файле
+    bool bad;
+} Input;
+
+static void in_seek(Input* in, uint64_t offset) {
+    in->bad = false;
+    if (offset == in->pos) return;
+    if (fseek(in->fp, (long)offset, SEEK_SET) != 0) in->bad = true;
+    in->pos = offset;
+}
+
+static unsigned in_u8(Input* in) {
+    int c = fgetc(in->fp);
+    if (c == EOF) {
+        in->bad = true;
+        return 0;
+    }
+    in->pos++;
+    return (unsigned)c;
+}
+
+static uint32_t in_u32(Input* in) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)in_u8(in) << (8 * i);
+    return v;
+}
+
+static uint64_t in_u64(Input* in) {
+    uint64_t lo = in_u32(in);
+    return lo | (uint64_t)in_u32(in) << 32;
+}
+
+static uint64_t in_varint(Input* in) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned c = in_u8(in);
+        if (in->bad) return 0;
+        v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return v;
+    }
+    in->bad = true;
+    return 0;
+}
+
+// Читает кадр (после байта типа) в fr. Возвращает номер строки кадра
+static uint64_t read_frame(Input* in, Frame* fr) {
+    uint64_t cmd = in_u64(in);
+    int w = (int)in_u8(in);
+    int h = (int)in_u8(in);
+    fr->dino_x = (int)in_u8(in);
+    fr->dino_y = (int)in_u8(in);
+    fr->flags = in_u8(in);
+    bool sized = w >= MIN_WIDTH && w <= MAX_WIDTH && h >= MIN_HEIGHT && h <= MAX_HEIGHT;
+    if (in->bad || !(sized || (w == 0 && h == 0))) {
+        in->bad = true;
+        return 0;
+    }
+    fr->width = w;
+    fr->height = h;
+    size_t n = (size_t)w * h;
+    if (fread(fr->cells, 1, n, in->fp) != n) in->bad = true;
+    in->pos += n;
+    return cmd;
+}
+
+// Применяет изменение (после байта типа) к fr; fr == NULL — только пропускает
+static void read_delta(Input* in, Frame* fr) {
+    uint64_t count = in_varint(in);
+    uint64_t total = fr ? (uint64_t)fr->width * fr->height : TRACE_CELLS;
+    uint64_t pos = 0;
+    for (uint64_t i = 0; i < count && !in->bad; i++) {
+        pos += in_varint(in);
+        unsigned x = in_u8(in);
+        if (pos >= total) {
+            in->bad = true;
+            return;
+        }
+        if (fr) fr->cells[pos] ^= (Cell)x;
+        pos++;
+    }
+    unsigned dx = in_u8(in);
+    unsigned dy = in_u8(in);
+    unsigned flags = in_u8(in);
+    if (fr && !in->bad) {
+        fr->dino_x ^= (int)dx;
+        fr->dino_y ^= (int)dy;
+        fr->flags ^= flags;
+    }
+}
+
+// =============== Просмотр ===============
+
+typedef struct {
+    Input in;
+    KeyEntry* keys;
+    size_t key_count;
+    uint64_t total;     // Число записанных строк
+    unsigned every;
+    Frame frame;        // Поле после строки cur
+    uint64_t cur;
+    bool loaded;
+    uint64_t next_off;  // Запись строки cur + 1
+    uint64_t* seg;      // Смещения записей строк seg_lo ... seg_lo + seg_n - 1
+    uint64_t seg_lo;
+    size_t seg_n, seg_cap;
+    Frame scratch;      // Пропускаемые кадры
+} Player;
+
+static bool add_key(Player* p, size_t* cap, uint64_t cmd, uint64_t offset) {
+    if (p->key_count == *cap) {
+        size_t grown = *cap ? *cap * 2 : 256;
+        KeyEntry* keys = realloc(p->keys, grown * sizeof(KeyEntry));
+        if (!keys) return false;
+        p->keys = keys;
+        *cap = grown;
+    }
+    p->keys[p->key_count].cmd = cmd;
+    p->keys[p->key_count].offset = offset;
+    p->key_count++;
+    return true;
+}
+
+// Читает оглавление в конце файла. Возвращает false, если его нет
+static bool load_index(Player* p) {
+    Input* in = &p->in;
+    if (fseek(in->fp, -16, SEEK_END) != 0) return false;
+    long end = ftell(in->fp);
+    if (end < 0) return false;
+    in->pos = (uint64_t)end;
+    in->bad = false;
+    uint64_t index = in_u64(in);
+    char magic[8];
+    for (int i = 0; i < 8; i++) magic[i] = (char)in_u8(in);
+    if (in->bad || memcmp(magic, TRACE_INDEX_MAGIC, 8) != 0 || index >= (uint64_t)end) return false;
+
+    in_seek(in, index);
+    if (in_u8(in) != REC_INDEX) return false;
+    p->total = in_u64(in);
+    uint64_t count = in_u64(in);
+    if (in->bad || count == 0 || count > ((uint64_t)end - index) / 16) return false;
+    p->keys = malloc((size_t)count * sizeof(KeyEntry));
+    if (!p->keys) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        p->keys[i].cmd = in_u64(in);
+        p->keys[i].offset = in_u64(in);
+    }
+    p->key_count = (size_t)count;
+    return !in->bad;
+}
+
+/**
+ * Оглавления нет (запись оборвалась): читаем записи подряд.
+ * Неполная последняя запись отбрасывается.
+ */
+static bool scan_index(Player* p, uint64_t start) {
+    free(p->keys);
+    p->keys = NULL;
+    p->key_count = 0;
+    size_t cap = 0;
+    uint64_t cmd = 0;
+    Input* in = &p->in;
+    in->pos = UINT64_MAX;
+    in_seek(in, start);
+    for (;;) {
+        uint64_t offset = in->pos;
+        unsigned tag = in_u8(in);
+        if (in->bad) break;
+        if (tag == REC_DELTA) {
+            read_delta(in, NULL);
+            if (in->bad) break;
+            cmd++;
+        } else if (tag == REC_KEY || tag == REC_RESET) {
+            uint64_t c = read_frame(in, &p->scratch);
+            if (in->bad) break;
+            if (!add_key(p, &cap, c, offset)) return false;
+            cmd = c;
+        } else {
+            break;
+        }
+    }
+    p->total = cmd;
+    return p->key_count > 0;
+}
+
+static bool player_open(Player* p, const char* path) {
+    p->in.fp = fopen(path, "rb");
+    if (!p->in.fp) return false;
+    char magic[8];
+    for (int i = 0; i < 8; i++) magic[i] = (char)in_u8(&p->in);
+    uint32_t version = in_u32(&p->in);
+    p->every = in_u32(&p->in);
+    if (p->in.bad || memcmp(magic, TRACE_MAGIC, 8) != 0 || version != TRACE_VERSION) return false;
+    uint64_t start = p->in.pos;
+    if (load_index(p)) return true;
+    fprintf(stderr, "ВНИМАНИЕ: В записи нет оглавления (запись оборвалась?), файл читается целиком\n");
+    return scan_index(p, start);
+}
+
+static void player_close(Player* p) {
+    if (p->in.fp) fclose(p->in.fp);
+    free(p->keys);
+    free(p->seg);
+}
+
+// Последний полный кадр не позже строки cmd
+static size_t key_before(const Player* p, uint64_t cmd) {
+    size_t lo = 0, hi = p->key_count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (p->keys[mid].cmd <= cmd) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static bool player_load_key(Player* p, size_t k) {
+    Input* in = &p->in;
+    in_seek(in, p->keys[k].offset);
+    unsigned tag = in_u8(in);
+    if (tag != REC_KEY && tag != REC_RESET) return false;
+    p->cur = read_frame(in, &p->frame);
+    p->next_off = in->pos;
+    p->loaded = !in->bad;
+    return p->loaded;
+}
+
+// Переходит к строке cur + 1. Возвращает false в конце записи или при ошибке
+static bool player_forward(Player* p) {
+    if (p->cur >= p->total) return false;
+    Input* in = &p->in;
+    in_seek(in, p->next_off);
+    for (;;) {
+        unsigned tag = in_u8(in);
+        if (in->bad) return false;
+        if (tag == REC_KEY) {
+            // Полный кадр той же строки, что уже применена
+            read_frame(in, &p->scratch);
+            continue;
+        }
+        if (tag == REC_DELTA) {
+            read_delta(in, &p->frame);
+            p->cur++;
+        } else if (tag == REC_RESET) {
+            p->cur = read_frame(in, &p->frame);
+        } else {
+            return false;
+        }
+        p->next_off = in->pos;
+        return !in->bad;
+    }
+}
+
+// Переходит к строке target: от ближайшего кадра или от текущей строки, если она ближе
+static bool player_seek(Player* p, uint64_t target) {
+    if (target > p->total) target = p->total;
+    size_t k = key_before(p, target);
+    if (!p->loaded || p->cur > target || p->cur < p->keys[k].cmd) {
+        if (!player_load_key(p, k)) return false;
+    }
+    while (p->cur < target) {
+        if (!player_forward(p)) return false;
+    }
+    return true;
+}
+
+/**
+ * Запоминает смещения записей строк от ближайшего кадра до cur:
+ * шаги назад в этом отрезке не читают файл заново.
+ */
+static bool build_segment(Player* p) {
+    Input* in = &p->in;
+    size_t k = key_before(p, p->cur - 1);
+    in_seek(in, p->keys[k].offset);
+    in_u8(in);
+    uint64_t c = read_frame(in, &p->scratch);
+    p->seg_lo = c + 1;
+    p->seg_n = 0;
+    while (c < p->cur && !in->bad) {
+        uint64_t offset = in->pos;
+        unsigned tag = in_u8(in);
+        if (tag == REC_KEY) {
+            read_frame(in, &p->scratch);
+            continue;
+        }
+        if (p->seg_n == p->seg_cap) {
+            size_t cap = p->seg_cap ? p->seg_cap * 2 : 1024;
+            uint64_t* seg = realloc(p->seg, cap * sizeof(uint64_t));
+            if (!seg) return false;
+            p->seg = seg;
+            p->seg_cap = cap;
+        }
+        p->seg[p->seg_n++] = offset;
+        if (tag == REC_DELTA) read_delta(in, NULL);
+        else if (tag == REC_RESET) read_frame(in, &p->scratch);
+        else return false;
+        c++;
+    }
+    return !in->bad;
+}
+
+// Переходит к строке cur - 1: то же изменение XOR снимает строку cur
+static bool player_backward(Player* p) {
+    if (p->cur == 0) return false;
+    if (!(p->seg_n && p->cur >= p->seg_lo && p->cur - p->seg_lo < p->seg_n)) {
+        if (!build_segment(p)) return false;
+    }
+    uint64_t offset = p->seg[p->cur - p->seg_lo];
+    Input* in = &p->in;
+    in_seek(in, offset);
+    if (in_u8(in) != REC_DELTA) {
+        // Строка cur сменила размер поля — предыдущее поле только от кадра раньше
+        return player_seek(p, p->cur - 1);
+    }
+    read_delta(in, &p->frame);
+    if (in->bad) return false;
+    p->cur--;
+    p->next_off = offset;
+    return true;
+}
+
+// Переносит кадр в поле *view (пересоздаёт его при смене размера)
+static bool frame_to_field(const Frame* fr, Field** view) {
+    if (!(fr->flags & FRAME_CREATED)) return false;
+    if (!*view || (*view)->width != fr->width || (*view)->height != fr->height) {
+        free_field(*view);
+        *view = create_field(fr->width, fr->height);
+        if (!*view) return false;
+    }
+    Field* f = *view;
+    for (int y = 0; y < f->height; y++) {
+        memcpy(f->grid[y], fr->cells + (size_t)y * f->width, f->width);
+    }
+    field_recount(f);
+    f->dino_x = fr->dino_x;
+    f->dino_y = fr->dino_y;
+    f->field_created = true;
+    f->dino_placed = (fr->flags & FRAME_PLACED) != 0;
+    return true;
+}
+
+static void show_frame(const Player* p, Field** view, const Viewport* vp) {
+    clear_screen();
+    printf("Строка %llu из %llu\n", (unsigned long long)p->cur, (unsigned long long)p->total);
+    if (!frame_to_field(&p->frame, view)) {
+        printf("Поле ещё не создано\n");
+    } else if (vp->enabled) {
+        viewport_print(*view, vp);
+    } else {
+        print_field(*view);
+    }
+    fflush(stdout);
+}
+
+int trace_replay(int argc, char* argv[]) {
+    const char* path = argv[0];
+    uint64_t seek = 0;
+    long play = 0;
+    int fps = 10;
+    bool display = true;
+    bool info = false;
+    const char* out = NULL;
+    Viewport vp = { .enabled = false, .width = MAX_WIDTH, .height = MAX_HEIGHT };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc) {
+            seek = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+            play = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+            if (fps < 0) fps = 0;
+        } else if (strcmp(argv[i], "--no-display") == 0) {
+            display = false;
+        } else if (strcmp(argv[i], "--viewport") == 0 && i + 1 < argc) {
+            if (!viewport_parse(argv[++i], &vp)) {
+                fprintf(stderr, "ВНИМАНИЕ: Неверный формат --viewport '%s' (ожидается WxH или auto)\n", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--info") == 0) {
+            info = true;
+        }
+    }
+
+    Player* p = calloc(1, sizeof(Player));
+    if (!p) return 1;
+    if (!player_open(p, path)) {
+        fprintf(stderr, "ОШИБКА: Невозможно прочитать запись '%s'\n", path);
+        player_close(p);
+        free(p);
+        return 1;
+    }
+    if (info) {
+        printf("Строк: %llu, полных кадров: %zu, интервал кадров: %u\n",
+               (unsigned long long)p->total, p->key_count, p->every);
+    }
+    if (seek > p->total) {
+        fprintf(stderr, "ВНИМАНИЕ: В записи %llu строк, показывается последняя\n", (unsigned long long)p->total);
+    }
+
+    bool ok = player_seek(p, seek);
+    Field* view = NULL;
+    if (ok && display) show_frame(p, &view, &vp);
+
+    // Проигрывание: по строке за кадр вперёд или назад
+    for (long n = play < 0 ? -play : play; ok && n > 0; n--) {
+        if (!(play > 0 ? player_forward(p) : player_backward(p))) break;
+        if (display) {
+            if (fps > 0) delay_ms(1000 / fps);
+            show_frame(p, &view, &vp);
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "ОШИБКА: Запись '%s' повреждена\n", path);
+    } else if (out) {
+        if (!frame_to_field(&p->frame, &view)) {
+            fprintf(stderr, "ОШИБКА: В строке %llu поле ещё не создано\n", (unsigned long long)p->cur);
+            ok = false;
+        } else if (!save_field_to_file(view, out)) {
+            fprintf(stderr, "ОШИБКА: Невозможно записать файл '%s'\n", out);
+            ok = false;
+        }
+    }
+
+    free_field(view);
+    player_close(p);
+    free(p);
+    return ok ? 0 : 1;
+}
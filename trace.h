@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "field.h"
+#include <stdbool.h>
+
+/**
+ * Запись выполнения (--record FILE) и её просмотр (--replay FILE).
+ * После каждой выполненной строки в файл пишется изменение поля:
+ * XOR изменившихся клеток, позиции динозавра и флагов. XOR обратим,
+ * поэтому то же изменение переводит поле и на шаг назад.
+ * Каждые keyframe_every строк пишется полный кадр, по которому
+ * просмотр переходит к любой строке, не читая файл с начала.
+ * Смена размера поля (SIZE, LOAD) записывается полным кадром вместо изменения.
+ * В конце файла — оглавление кадров; если запись оборвалась,
+ * просмотр собирает оглавление, прочитав файл целиком.
+ */
+typedef struct Trace Trace;
+
+/**
+ * Создаёт файл записи path; состояние f становится кадром строки 0.
+ * Возвращает NULL, если файл не удалось открыть.
+ */
+Trace* trace_open(const char* path, long keyframe_every, const Field* f);
+
+// Записывает состояние поля f после очередной выполненной строки
+void trace_step(Trace* t, const Field* f);
+
+/**
+ * Дописывает оглавление и закрывает файл.
+ * Возвращает false, если при записи была ошибка.
+ */
+bool trace_close(Trace* t);
+
+/**
+ * Режим просмотра: dino --replay trace.bin [--seek K] [--play N] [--fps F]
+ * [--no-display] [--viewport WxH|auto] [--out field.txt] [--info].
+ * Выводит поле после строки K, затем N строк вперёд (N < 0 — назад)
+ * со скоростью F кадров в секунду (0 — без пауз).
+ * Возвращает код завершения программы.
+ */
+int trace_replay(int argc, char* argv[]);
+
+#endif
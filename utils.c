@@ -1,7 +1,11 @@
 #include "utils.h"
 #include <stdio.h>
 #include <string.h>
+#include <time.h>   // Для clock_gettime(), nanosleep()
 #include <unistd.h> // Для sleep()
+#ifndef _WIN32
+    #include <sys/ioctl.h> // Для TIOCGWINSZ
+#endif
 
 // Определение команды очистки в зависимости от ОС
 #ifdef _WIN32
@@ -33,6 +37,19 @@ void delay_seconds(int sec) {
 #endif
 }
 
+/**
+ * Делает паузу на ms миллисекунд (Sleep() на Windows, nanosleep() на Unix).
+ */
+void delay_ms(int ms) {
+    if (ms <= 0) return;
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+}
+
 /**
  * Проверяет, совпадает ли строка s с одним из четырёх направлений.
  */
@@ -56,4 +73,41 @@ void get_delta(const char* dir, int* dx, int* dy) {
     } else if (strcmp(dir, "RIGHT") == 0) {
         *dx = 1;  // Вправо — увеличение x
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Монотонные часы в наносекундах.
+ * На Windows — QueryPerformanceCounter, на Unix — clock_gettime(CLOCK_MONOTONIC).
+ */
+uint64_t monotonic_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart * (1000000000.0 / freq.QuadPart));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Размер терминала в символах.
+ * На Windows — GetConsoleScreenBufferInfo, на Unix — ioctl(TIOCGWINSZ).
+ */
+bool terminal_size(int* cols, int* rows) {
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) return false;
+    *cols = info.srWindow.Right - info.srWindow.Left + 1;
+    *rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+    return true;
+#else
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0) return false;
+    *cols = ws.ws_col;
+    *rows = ws.ws_row;
+    return true;
+#endif
+}
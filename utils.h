@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * Очищает консоль.
@@ -14,6 +15,11 @@ void clear_screen(void);
  */
 void delay_seconds(int sec);
 
+/**
+ * Делает паузу на указанное количество миллисекунд.
+ */
+void delay_ms(int ms);
+
 /**
  * Проверяет, является ли строка допустимым направлением движения.
  */
@@ -24,4 +30,16 @@ bool is_direction(const char* s);
  */
 void get_delta(const char* dir, int* dx, int* dy);
 
+/**
+ * Возвращает показания монотонных часов в наносекундах
+ * (для замеров времени: профилировщик, бенчмарки).
+ */
+uint64_t monotonic_ns(void);
+
+/**
+ * Записывает размер терминала (столбцы и строки) в *cols и *rows.
+ * Возвращает false, если вывод не в терминал.
+ */
+bool terminal_size(int* cols, int* rows);
+
 #endif
\ No newline at end of file
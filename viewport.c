@@ -0,0 +1,101 @@
+#include "viewport.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+// Буфер кадра: окно не больше поля, плюс карта и заголовки
+#define VIEWPORT_BUFFER_SIZE ((MAX_WIDTH + 1) * MAX_HEIGHT + \
+                              (MINIMAP_MAX_WIDTH + 1) * MINIMAP_MAX_HEIGHT + 256)
+
+bool viewport_parse(const char* spec, Viewport* vp) {
+    if (strcmp(spec, "auto") == 0) {
+        vp->enabled = true;
+        vp->follow_terminal = true;
+        vp->width = 80;   // Если вывод не в терминал
+        vp->height = 24;
+        return true;
+    }
+
+    int w, h;
+    char sep;
+    if (sscanf(spec, "%d%c%d", &w, &sep, &h) != 3 || (sep != 'x' && sep != 'X') || w <= 0 || h <= 0) {
+        return false;
+    }
+    vp->enabled = true;
+    vp->follow_terminal = false;
+    vp->width = w;
+    vp->height = h;
+    return true;
+}
+
+// Сколько клеток поля по одной оси приходится на один символ карты
+static int minimap_scale(int size, int max_chars) {
+    return (size + max_chars - 1) / max_chars;
+}
+
+// Первая клетка окна по оси: окно с центром в pos или вся ось, если окно не меньше её
+static int window_start(int pos, int win, int size) {
+    if (win >= size) return 0;
+    return wrap(pos - win / 2, size);
+}
+
+void viewport_print(const Field* f, const Viewport* vp) {
+    if (!f || !f->field_created) return;
+
+    int sx = minimap_scale(f->width, MINIMAP_MAX_WIDTH);
+    int sy = minimap_scale(f->height, MINIMAP_MAX_HEIGHT);
+    int map_w = (f->width + sx - 1) / sx;
+    int map_h = (f->height + sy - 1) / sy;
+
+    // Размер окна: заданный или по терминалу (минус заголовки и карта)
+    int vw = vp->width;
+    int vh = vp->height;
+    int cols, rows;
+    if (vp->follow_terminal && terminal_size(&cols, &rows)) {
+        vw = cols;
+        vh = rows - 1 - (vp->minimap ? map_h + 1 : 0);
+        if (vh < 1) vh = 1;
+    }
+    if (vw > f->width) vw = f->width;
+    if (vh > f->height) vh = f->height;
+
+    int cx = f->dino_placed ? f->dino_x : 0;
+    int cy = f->dino_placed ? f->dino_y : 0;
+    int x0 = window_start(cx, vw, f->width);
+    int y0 = window_start(cy, vh, f->height);
+
+    char out[VIEWPORT_BUFFER_SIZE];
+    int n = snprintf(out, sizeof(out), "Окно: x %d..%d, y %d..%d (поле %dx%d)\n",
+                     x0, (x0 + vw - 1) % f->width, y0, (y0 + vh - 1) % f->height,
+                     f->width, f->height);
+
+    // Строка окна — не больше двух непрерывных кусков строки поля (перенос по тору)
+    int first = f->width - x0 < vw ? f->width - x0 : vw;
+    for (int j = 0; j < vh; j++) {
+        int y = y0 + j;
+        if (y >= f->height) y -= f->height;
+        const Cell* row = f->grid[y];
+        for (int i = 0; i < first; i++) out[n++] = cell_display(row[x0 + i]);
+        for (int i = 0; i < vw - first; i++) out[n++] = cell_display(row[i]);
+        out[n++] = '\n';
+    }
+
+    // Карта: по одной клетке из центра каждого блока sx × sy, блок с динозавром — '#'
+    if (vp->minimap) {
+        n += snprintf(out + n, sizeof(out) - n, "Карта (1 символ = %dx%d клеток):\n", sx, sy);
+        for (int by = 0; by < map_h; by++) {
+            int py = by * sy + sy / 2;
+            if (py >= f->height) py = f->height - 1;
+            for (int bx = 0; bx < map_w; bx++) {
+                int px = bx * sx + sx / 2;
+                if (px >= f->width) px = f->width - 1;
+                bool dino_here = f->dino_placed && cx / sx == bx && cy / sy == by;
+                out[n++] = dino_here ? '#' : cell_display(f->grid[py][px]);
+            }
+            out[n++] = '\n';
+        }
+    }
+
+    fwrite(out, 1, n, stdout);
+    fflush(stdout);
+}
@@ -0,0 +1,33 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include "field.h"
+#include <stdbool.h>
+
+#define MINIMAP_MAX_WIDTH  32
+#define MINIMAP_MAX_HEIGHT 16
+
+/**
+ * Окно вывода (--viewport WxH или --viewport auto).
+ * Выводится не всё поле, а только окно вокруг динозавра (с переносом по тору),
+ * поэтому время отрисовки зависит от размера окна, а не поля.
+ * - enabled: окно включено (иначе print_field выводит всё поле)
+ * - width, height: размер окна в клетках
+ * - follow_terminal: размер окна берётся из размера терминала на каждом кадре
+ * - minimap: под окном выводится уменьшенная карта всего поля (--minimap)
+ */
+typedef struct {
+    bool enabled;
+    int width;
+    int height;
+    bool follow_terminal;
+    bool minimap;
+} Viewport;
+
+// Разбирает "WxH" или "auto" в vp. Возвращает false при неверном формате
+bool viewport_parse(const char* spec, Viewport* vp);
+
+// Выводит окно (и карту) в консоль одной записью
+void viewport_print(const Field* f, const Viewport* vp);
+
+#endif
@@ -0,0 +1,429 @@
+#include "world.h"
+#include "parser.h"
+#include "history.h"
+#include "eventlog.h"
+#include "snapshot.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+// Потоки POSIX на Windows не поддерживаются
+int world_run(int argc, char* argv[]) {
+    (void)argc; (void)argv;
+    fprintf(stderr, "ОШИБКА: --world не поддерживается на этой платформе\n");
+    return 1;
+}
+
+bool world_acquire(WorldAgent* a, const Field* f, const char* line, int line_num) {
+    (void)a; (void)f; (void)line; (void)line_num;
+    return true;
+}
+
+void world_release(WorldAgent* a) { (void)a; }
+
+#else
+
+#include <pthread.h>
+
+/**
+ * Мьютекс плитки. Каждый занимает свою кэш-линию, чтобы потоки,
+ * работающие с соседними плитками, не мешали друг другу.
+ */
+typedef struct {
+    _Alignas(64) pthread_mutex_t m;
+} TileLock;
+
+typedef struct {
+    Field field;            // Общее поле
+    int tile;               // Сторона плитки в клетках
+    int tiles_x, tiles_y;
+    TileLock* locks;
+
+    bool deterministic;     // Ходы по очереди (--deterministic)
+    pthread_mutex_t turn_lock;
+    int turn;               // Номер агента, который сейчас ходит (-1 — все завершились)
+
+    WorldAgent* agents;
+    int agent_count;
+} World;
+
+struct WorldAgent {
+    World* world;
+    int id;
+    const char* script;
+    Field view;             // Общие клетки + собственный динозавр
+    Options opts;
+    bool ok;
+    bool done;
+    bool has_turn;
+    pthread_cond_t turn_cond;  // Будит агента, когда ход переходит к нему
+
+    int* tiles;             // Плитки, которые держит агент (по возрастанию)
+    int tile_count;
+    unsigned char* mark;    // mark[t] = 1, если плитка t уже в tiles
+};
+
+// Добавляет плитку клетки (x, y) в набор агента
+static void add_cell(WorldAgent* a, int x, int y) {
+    World* w = a->world;
+    x = field_wrap_x(&w->field, x);
+    y = field_wrap_y(&w->field, y);
+    int t = (y / w->tile) * w->tiles_x + x / w->tile;
+    if (!a->mark[t]) {
+        a->mark[t] = 1;
+        a->tiles[a->tile_count++] = t;
+    }
+}
+
+// Добавляет клетки от динозавра на n шагов в направлении dir (не больше одного оборота)
+static void add_path(WorldAgent* a, const Field* f, const char* dir, int n) {
+    if (!is_direction(dir)) return;
+    int dx = 0, dy = 0;
+    get_delta(dir, &dx, &dy);
+    int len = dx ? f->width : f->height;
+    if (n >= len) n = len - 1;
+    for (int k = 0; k <= n; k++) {
+        add_cell(a, f->dino_x + dx * k, f->dino_y + dy * k);
+    }
+}
+
+// Добавляет клетки прямоугольника w x h с углом (x, y): по одной клетке на плитку
+static void add_rect(WorldAgent* a, const Field* f, int x, int y, int w, int h) {
+    int tile = a->world->tile;
+    if (w > f->width) w = f->width;
+    if (h > f->height) h = f->height;
+    for (int j = 0; j < h; j++) {
+        int cy = field_wrap_y(f, y + j);
+        if (j > 0 && cy % tile != 0) continue;
+        for (int i = 0; i < w; i++) {
+            int cx = field_wrap_x(f, x + i);
+            if (i == 0 || cx % tile == 0) add_cell(a, cx, cy);
+        }
+    }
+}
+
+// Добавляет все плитки поля
+static void add_all(WorldAgent* a) {
+    World* w = a->world;
+    for (int ty = 0; ty < w->tiles_y; ty++) {
+        for (int tx = 0; tx < w->tiles_x; tx++) add_cell(a, tx * w->tile, ty * w->tile);
+    }
+}
+
+// Добавляет клетки, которые проверяет условие IF или WHILE
+static void add_predicate(WorldAgent* a, const Field* f, const Predicate* p) {
+    if (p->total) add_all(a);
+    else if (p->w > 0) add_rect(a, f, p->x, p->y, p->w, p->h);
+    else if (p->relative) add_cell(a, f->dino_x + p->x, f->dino_y + p->y);
+    else add_cell(a, p->x, p->y);
+}
+
+/**
+ * Собирает плитки, которых может коснуться команда line.
+ * Возвращает false для команд, недоступных при совместном выполнении
+ * (имя команды — в refused). UNDO, REDO, ветки и транзакции переводят
+ * всё поле в прежнюю версию, а плитки других агентов за это время меняются.
+ */
+static bool collect_tiles(WorldAgent* a, const Field* f, const char* line, char refused[32]) {
+    char cmd[32];
+    char dir[16];
+    char mode[16];
+    int x, y, n;
+
+    if (sscanf(line, "%31s", cmd) != 1) return true;
+
+    if (strcmp(cmd, "UNDO") == 0 || strcmp(cmd, "REDO") == 0 || strcmp(cmd, "BRANCH") == 0 ||
+        strcmp(cmd, "CHECKOUT") == 0 || strcmp(cmd, "BEGIN") == 0 ||
+        strcmp(cmd, "COMMIT") == 0 || strcmp(cmd, "ROLLBACK") == 0) {
+        strcpy(refused, cmd);
+        return false;
+    }
+
+    // Снимок копирует всё поле
+    if (strcmp(cmd, "SAVE") == 0) {
+        add_all(a);
+        return true;
+    }
+
+    if (strcmp(cmd, "START") == 0) {
+        if (sscanf(line, "START %d %d", &x, &y) == 2) add_cell(a, x, y);
+    } else if (strcmp(cmd, "PAINT") == 0) {
+        add_cell(a, f->dino_x, f->dino_y);
+    } else if (strcmp(cmd, "MOVE") == 0 || strcmp(cmd, "DIG") == 0 || strcmp(cmd, "MOUND") == 0 ||
+               strcmp(cmd, "GROW") == 0 || strcmp(cmd, "CUT") == 0 || strcmp(cmd, "MAKE") == 0) {
+        if (sscanf(line, "%*s %15s", dir) == 1) add_path(a, f, dir, 1);
+    } else if (strcmp(cmd, "PAINTRECT") == 0 || strcmp(cmd, "FILL") == 0) {
+        int w, h;
+        if (sscanf(line, "%*s %d %d %d %d", &x, &y, &w, &h) == 4 && w > 0 && h > 0) add_rect(a, f, x, y, w, h);
+    } else if (strcmp(cmd, "JUMP") == 0) {
+        if (sscanf(line, "JUMP %15s %d", dir, &n) == 2 && n > 0) add_path(a, f, dir, n);
+    } else if (strcmp(cmd, "PUSH") == 0) {
+        int parsed = sscanf(line, "PUSH %15s %15s", dir, mode);
+        // Камень рядом и клетка за ним; при скольжении — вся линия
+        if (parsed >= 1) add_path(a, f, dir, parsed == 2 ? MAX_WIDTH : 2);
+    } else if (strcmp(cmd, "WHILE") == 0) {
+        Predicate pred;
+        if (line[5] == ' ' && parse_predicate(line + 6, &pred, &n)) add_predicate(a, f, &pred);
+    } else if (strncmp(cmd, "IF", 2) == 0) {
+        const char* rest = strchr(line, ' ');
+        Predicate pred;
+        int then_offset;
+        if (rest && parse_if(rest + 1, &pred, &then_offset)) {
+            add_predicate(a, f, &pred);
+            // Строки EXEC берут блокировки сами
+            const char* then_cmd = rest + 1 + then_offset;
+            if (strncmp(then_cmd, "EXEC", 4) != 0) return collect_tiles(a, f, then_cmd, refused);
+        }
+    }
+    // EXEC, SIZE, LOAD и неизвестные команды клеток не трогают
+    return true;
+}
+
+// Ждёт хода агента (--deterministic)
+static void wait_turn(WorldAgent* a) {
+    World* w = a->world;
+    pthread_mutex_lock(&w->turn_lock);
+    while (w->turn != a->id) pthread_cond_wait(&a->turn_cond, &w->turn_lock);
+    pthread_mutex_unlock(&w->turn_lock);
+    a->has_turn = true;
+}
+
+// Передаёт ход следующему незавершённому агенту и будит только его.
+// Вызывается под turn_lock
+static void pass_turn_locked(World* w, int from) {
+    w->turn = -1;
+    for (int i = 1; i <= w->agent_count; i++) {
+        int next = (from + i) % w->agent_count;
+        if (!w->agents[next].done) {
+            w->turn = next;
+            pthread_cond_signal(&w->agents[next].turn_cond);
+            break;
+        }
+    }
+}
+
+static int compare_ints(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+bool world_acquire(WorldAgent* a, const Field* f, const char* line, int line_num) {
+    World* w = a->world;
+
+    // Вложенная строка (EXEC): внешняя уже не трогает поле
+    world_release(a);
+
+    char refused[32];
+    if (!collect_tiles(a, f, line, refused)) {
+        for (int i = 0; i < a->tile_count; i++) a->mark[a->tiles[i]] = 0;
+        a->tile_count = 0;
+        event_log_message("ОШИБКА (строка %d): %s недоступна при совместном выполнении\n", line_num, refused);
+        return false;
+    }
+
+    // Фиксированный порядок захвата исключает взаимные блокировки
+    qsort(a->tiles, a->tile_count, sizeof(int), compare_ints);
+
+    if (w->deterministic) wait_turn(a);
+    for (int i = 0; i < a->tile_count; i++) {
+        pthread_mutex_lock(&w->locks[a->tiles[i]].m);
+    }
+    return true;
+}
+
+void world_release(WorldAgent* a) {
+    World* w = a->world;
+    for (int i = a->tile_count - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&w->locks[a->tiles[i]].m);
+        a->mark[a->tiles[i]] = 0;
+    }
+    a->tile_count = 0;
+
+    if (a->has_turn) {
+        a->has_turn = false;
+        pthread_mutex_lock(&w->turn_lock);
+        pass_turn_locked(w, a->id);
+        pthread_mutex_unlock(&w->turn_lock);
+    }
+}
+
+static void* agent_main(void* arg) {
+    WorldAgent* a = arg;
+    World* w = a->world;
+
+    a->ok = parse_and_execute_file(a->script, &a->view, NULL, &a->opts);
+    world_release(a);
+
+    // Завершившийся агент больше не получает ход
+    pthread_mutex_lock(&w->turn_lock);
+    a->done = true;
+    if (w->turn == a->id) pass_turn_locked(w, a->id);
+    pthread_mutex_unlock(&w->turn_lock);
+    return NULL;
+}
+
+int world_run(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "ОШИБКА: --world требует output.txt, сценарий подготовки и хотя бы один скрипт агента\n");
+        return 1;
+    }
+
+    const char* output_file = argv[0];
+    const char* setup_file = argv[1];
+
+    // Скрипты агентов идут до первой опции
+    int first_opt = 2;
+    while (first_opt < argc && strncmp(argv[first_opt], "--", 2) != 0) first_opt++;
+    int agent_count = first_opt - 2;
+    if (agent_count < 1 || agent_count > WORLD_MAX_AGENTS) {
+        fprintf(stderr, "ОШИБКА: Число скриптов агентов должно быть от 1 до %d\n", WORLD_MAX_AGENTS);
+        return 1;
+    }
+
+    World w;
+    memset(&w, 0, sizeof(w));
+    w.tile = WORLD_DEFAULT_TILE;
+    for (int i = first_opt; i < argc; i++) {
+        if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            w.tile = atoi(argv[++i]);
+            if (w.tile < 1) w.tile = 1;
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            w.deterministic = true;
+        }
+    }
+
+    Options opts;
+    parse_options(argc - first_opt, argv + first_opt, &opts);
+    if (opts.profiler || opts.shm) {
+        fprintf(stderr, "ВНИМАНИЕ: --profile и --shm не поддерживаются вместе с --world\n");
+        profiler_free(opts.profiler);
+        shm_export_close(opts.shm);
+        opts.profiler = NULL;
+        opts.shm = NULL;
+    }
+    // Снимки по счётчику строк считали бы строки всех агентов без блокировок
+    if (opts.snapshot_every > 0) {
+        fprintf(stderr, "ВНИМАНИЕ: --snapshot-every не поддерживается вместе с --world (используйте SAVE)\n");
+        opts.snapshot_every = 0;
+    }
+    // Стек файлов у каждого агента свой, общей точки продолжения нет
+    if (opts.checkpoint_path || opts.resume_path) {
+        fprintf(stderr, "ВНИМАНИЕ: --checkpoint и --resume не поддерживаются вместе с --world\n");
+        opts.checkpoint_path = NULL;
+        opts.resume_path = NULL;
+    }
+    // Общее поле не выводится: потоки рисовали бы его одновременно
+    opts.display = false;
+    event_log_init(opts.quiet, opts.max_warnings);
+
+    // Сценарий подготовки выполняется обычным образом, с историей
+    History* history = create_history();
+    bool ok = parse_and_execute_file(setup_file, &w.field, history, &opts);
+    free_history(history);
+    snapshot_finish();
+    if (ok && !w.field.field_created) {
+        event_log_message("ОШИБКА: Сценарий подготовки не создал поле (не хватает SIZE или LOAD)\n");
+        ok = false;
+    }
+    if (!ok) {
+        free_field_cells(&w.field);
+        event_log_finish();
+        return 1;
+    }
+    // Динозавр сценария подготовки (например, из LOAD) не участвует
+    if (w.field.dino_placed) {
+        field_vacate(&w.field, w.field.dino_x, w.field.dino_y);
+        w.field.dino_placed = false;
+    }
+
+    w.tiles_x = (w.field.width + w.tile - 1) / w.tile;
+    w.tiles_y = (w.field.height + w.tile - 1) / w.tile;
+    int tile_total = w.tiles_x * w.tiles_y;
+    w.locks = aligned_alloc(_Alignof(TileLock), tile_total * sizeof(TileLock));
+    w.agents = calloc(agent_count, sizeof(WorldAgent));
+    pthread_t* threads = calloc(agent_count, sizeof(pthread_t));
+    if (!w.locks || !w.agents || !threads) {
+        fprintf(stderr, "ОШИБКА: Недостаточно памяти для --world\n");
+        free(w.locks);
+        free(w.agents);
+        free(threads);
+        free_field_cells(&w.field);
+        event_log_finish();
+        return 1;
+    }
+    for (int t = 0; t < tile_total; t++) pthread_mutex_init(&w.locks[t].m, NULL);
+    pthread_mutex_init(&w.turn_lock, NULL);
+    w.agent_count = agent_count;
+    w.turn = 0;
+
+    for (int i = 0; i < agent_count; i++) {
+        WorldAgent* a = &w.agents[i];
+        a->world = &w;
+        a->id = i;
+        a->script = argv[2 + i];
+        a->opts = opts;
+        a->opts.agent = a;
+        pthread_cond_init(&a->turn_cond, NULL);
+
+        // Клетки общие, динозавр у каждого агента свой
+        a->view = w.field;
+        a->view.shared_cells = true;
+        a->view.dino_placed = false;
+        a->view.dino_x = a->view.dino_y = 0;
+
+        a->tiles = malloc(tile_total * sizeof(int));
+        a->mark = calloc(tile_total, 1);
+        if (!a->tiles || !a->mark) {
+            fprintf(stderr, "ОШИБКА: Недостаточно памяти для --world\n");
+            return 1;
+        }
+    }
+
+    event_log_set_threaded(true);
+    int started = 0;
+    for (; started < agent_count; started++) {
+        if (pthread_create(&threads[started], NULL, agent_main, &w.agents[started]) != 0) {
+            fprintf(stderr, "ОШИБКА: Невозможно запустить поток агента '%s'\n", w.agents[started].script);
+            break;
+        }
+    }
+    // Агенты, для которых не нашлось потока, считаются завершёнными с ошибкой
+    if (started < agent_count) {
+        pthread_mutex_lock(&w.turn_lock);
+        for (int i = started; i < agent_count; i++) w.agents[i].done = true;
+        if (w.turn >= started) pass_turn_locked(&w, w.turn);
+        pthread_mutex_unlock(&w.turn_lock);
+        ok = false;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        if (!w.agents[i].ok) ok = false;
+    }
+    event_log_set_threaded(false);
+    snapshot_finish();
+
+    if (ok && opts.save) {
+        // В строку DINO файла результата попадает динозавр первого агента
+        w.field.dino_x = w.agents[0].view.dino_x;
+        w.field.dino_y = w.agents[0].view.dino_y;
+        save_field_as(&w.field, output_file, opts.field_format);
+    }
+
+    for (int i = 0; i < agent_count; i++) {
+        pthread_cond_destroy(&w.agents[i].turn_cond);
+        free(w.agents[i].tiles);
+        free(w.agents[i].mark);
+    }
+    for (int t = 0; t < tile_total; t++) pthread_mutex_destroy(&w.locks[t].m);
+    pthread_mutex_destroy(&w.turn_lock);
+    free(w.locks);
+    free(w.agents);
+    free(threads);
+    free_field_cells(&w.field);
+    event_log_finish();
+    return ok ? 0 : 1;
+}
+
+#endif
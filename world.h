@@ -0,0 +1,49 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "field.h"
+#include <stdbool.h>
+
+#define WORLD_MAX_AGENTS  64
+#define WORLD_DEFAULT_TILE 16
+
+/**
+ * Совместное выполнение нескольких скриптов на одном поле (--world).
+ * Сначала сценарий подготовки создаёт поле (SIZE/LOAD, препятствия),
+ * затем каждый скрипт-агент выполняется в своём потоке и управляет
+ * своим динозавром (его ставит START агента).
+ *
+ * Поле разбито на квадратные плитки со своими мьютексами. Перед каждой
+ * строкой агент берёт блокировки всех плиток, которых может коснуться
+ * команда (клетка динозавра, соседние клетки, путь прыжка или скольжения,
+ * клетка условия IF), — всегда в порядке возрастания номера плитки,
+ * поэтому взаимных блокировок не бывает. Далёкие друг от друга динозавры
+ * работают параллельно.
+ *
+ * С --deterministic агенты ходят по очереди (строка за строкой в порядке
+ * номеров), и результат одинаков при каждом запуске — для отладки.
+ *
+ * UNDO в скриптах агентов недоступна: история общего поля не ведётся.
+ * Динозавры друг другу не мешают — клетка с чужим динозавром проходима.
+ */
+typedef struct WorldAgent WorldAgent;
+
+/**
+ * Режим --world. Аргументы (после "--world"):
+ * output.txt setup.txt agent1.txt [agent2.txt ...] [--tile N] [--deterministic] [опции]
+ * Возвращает код завершения программы.
+ */
+int world_run(int argc, char* argv[]);
+
+/**
+ * Берёт блокировки плиток для строки line (вызывается перед командой).
+ * Блокировки внешней строки (EXEC, IF ... THEN EXEC) при этом отпускаются:
+ * к этому моменту она уже не трогает поле.
+ * Возвращает false, если команда недоступна при совместном выполнении.
+ */
+bool world_acquire(WorldAgent* a, const Field* f, const char* line, int line_num);
+
+// Отпускает блокировки, взятые world_acquire (и передаёт ход в --deterministic)
+void world_release(WorldAgent* a);
+
+#endif